@@ -0,0 +1,282 @@
+#ifndef BENCH_BASELINES_H_INCLUDED
+#define BENCH_BASELINES_H_INCLUDED
+
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <pthread.h>
+#endif
+
+#include "targets.h"
+#include "thread_safe_cache_line.h"
+#include "thread_safe_concurrent_deque.h"
+#include "thread_safe_unordered_map.h"
+
+// Alternatives to the thread_safe:: wrappers running the same workloads:
+// a std container behind one external mutex, the same behind a reader-writer
+// lock, sharded maps with and without cache line padding and the library's
+// two-lock concurrent_deque.
+
+namespace bench {
+
+// Reader-writer lock from the platform, C++11 has no std::shared_mutex
+class rw_lock
+{
+public:
+#if defined(_WIN32)
+	rw_lock() { InitializeSRWLock(&lock_); }
+	void lock() { AcquireSRWLockExclusive(&lock_); }
+	void unlock() { ReleaseSRWLockExclusive(&lock_); }
+	void lock_shared() { AcquireSRWLockShared(&lock_); }
+	void unlock_shared() { ReleaseSRWLockShared(&lock_); }
+#else
+	rw_lock() { pthread_rwlock_init(&lock_, nullptr); }
+	~rw_lock() { pthread_rwlock_destroy(&lock_); }
+	void lock() { pthread_rwlock_wrlock(&lock_); }
+	void unlock() { pthread_rwlock_unlock(&lock_); }
+	void lock_shared() { pthread_rwlock_rdlock(&lock_); }
+	void unlock_shared() { pthread_rwlock_unlock(&lock_); }
+#endif
+
+	rw_lock(const rw_lock&) = delete;
+	rw_lock& operator=(const rw_lock&) = delete;
+
+private:
+#if defined(_WIN32)
+	SRWLOCK lock_;
+#else
+	pthread_rwlock_t lock_;
+#endif
+};
+
+// Lock taken by reads: exclusive for a plain mutex, shared for rw_lock
+template <class Lock>
+class read_guard
+{
+public:
+	explicit read_guard(Lock& l) : l(l) { l.lock(); }
+	~read_guard() { l.unlock(); }
+private:
+	Lock& l;
+};
+
+template <>
+class read_guard<rw_lock>
+{
+public:
+	explicit read_guard(rw_lock& l) : l(l) { l.lock_shared(); }
+	~read_guard() { l.unlock_shared(); }
+private:
+	rw_lock& l;
+};
+
+// std::map / std::unordered_map behind one external lock
+template <class Map, class Lock>
+class locked_map_target : public target
+{
+public:
+	void set_name(const std::string&) override { }
+	void preload(uint64_t keys, uint64_t step) override
+	{
+		for (uint64_t k = 0; k < keys; k += step)
+			m.insert(std::make_pair(k, k));
+	}
+	size_t read(uint64_t key) override { read_guard<Lock> g(lock); return m.count(key); }
+	void write(uint64_t key) override { std::lock_guard<Lock> g(lock); m[key] = key; }
+	void erase(uint64_t key) override { std::lock_guard<Lock> g(lock); m.erase(key); }
+	void insert(uint64_t key) override { std::lock_guard<Lock> g(lock); m.insert(std::make_pair(key, key)); }
+	size_t scan(uint64_t key, unsigned len) override { read_guard<Lock> g(lock); return scan_records(m, key, len); }
+	size_t read_modify_write(uint64_t key) override
+	{
+		std::lock_guard<Lock> g(lock);
+		uint64_t& v = m[key];
+		return static_cast<size_t>(v++);
+	}
+
+private:
+	Lock lock;
+	Map m;
+};
+
+// std::set / std::unordered_set behind one external lock
+template <class Set, class Lock>
+class locked_set_target : public target
+{
+public:
+	void set_name(const std::string&) override { }
+	void preload(uint64_t keys, uint64_t step) override
+	{
+		for (uint64_t k = 0; k < keys; k += step)
+			s.insert(k);
+	}
+	size_t read(uint64_t key) override { read_guard<Lock> g(lock); return s.count(key); }
+	void write(uint64_t key) override { std::lock_guard<Lock> g(lock); s.insert(key); }
+	void erase(uint64_t key) override { std::lock_guard<Lock> g(lock); s.erase(key); }
+	size_t scan(uint64_t key, unsigned len) override { read_guard<Lock> g(lock); return scan_records(s, key, len); }
+	size_t read_modify_write(uint64_t key) override
+	{
+		std::lock_guard<Lock> g(lock);
+		return s.insert(key).second ? 0 : 1;
+	}
+
+private:
+	Lock lock;
+	Set s;
+};
+
+// A std::unordered_map and its mutex as a plain struct, with no padding
+struct packed_locked_map
+{
+	std::mutex lock;
+	std::unordered_map<uint64_t, uint64_t> m;
+};
+
+// Shard access for thread_safe::unordered_map and for the hand locked
+// packed_locked_map, bare or wrapped in thread_safe::cache_padded
+template <class Shard>
+struct shard_ops
+{
+	static void set_name(Shard& s, const std::string& name) { s.set_name(name); }
+	static size_t count(Shard& s, uint64_t key) { return s.count(key); }
+	static void assign(Shard& s, uint64_t key) { s[key] = key; }
+	static void erase(Shard& s, uint64_t key) { s.erase(key); }
+	static void insert(Shard& s, uint64_t key) { s.insert(std::make_pair(key, key)); }
+};
+
+template <>
+struct shard_ops<packed_locked_map>
+{
+	static void set_name(packed_locked_map&, const std::string&) { }
+	static size_t count(packed_locked_map& s, uint64_t key) { std::lock_guard<std::mutex> g(s.lock); return s.m.count(key); }
+	static void assign(packed_locked_map& s, uint64_t key) { std::lock_guard<std::mutex> g(s.lock); s.m[key] = key; }
+	static void erase(packed_locked_map& s, uint64_t key) { std::lock_guard<std::mutex> g(s.lock); s.m.erase(key); }
+	static void insert(packed_locked_map& s, uint64_t key) { std::lock_guard<std::mutex> g(s.lock); s.m.insert(std::make_pair(key, key)); }
+};
+
+template <class T>
+struct shard_ops<thread_safe::cache_padded<T>>
+{
+	typedef thread_safe::cache_padded<T> padded;
+	static void set_name(padded& s, const std::string& name) { shard_ops<T>::set_name(*s, name); }
+	static size_t count(padded& s, uint64_t key) { return shard_ops<T>::count(*s, key); }
+	static void assign(padded& s, uint64_t key) { shard_ops<T>::assign(*s, key); }
+	static void erase(padded& s, uint64_t key) { shard_ops<T>::erase(*s, key); }
+	static void insert(padded& s, uint64_t key) { shard_ops<T>::insert(*s, key); }
+};
+
+// Keys spread over 2^ShardBits independently locked maps held in one array.
+// With many shards two threads rarely want the same lock, so what is left is
+// the traffic between neighbouring shards that share a cache line: compare
+// the padded thread_safe::unordered_map with packed and cache_padded
+// packed_locked_map arrays.
+template <class Shard, unsigned ShardBits>
+class sharded_map_target : public target
+{
+public:
+	static const size_t kShards = size_t(1) << ShardBits;
+
+	void set_name(const std::string& name) override
+	{
+		for (size_t i = 0; i < kShards; i++)
+			ops::set_name(shards[i], name + "[" + std::to_string(i) + "]");
+	}
+	void preload(uint64_t keys, uint64_t step) override
+	{
+		for (uint64_t k = 0; k < keys; k += step)
+			ops::insert(shard(k), k);
+	}
+	size_t read(uint64_t key) override { return ops::count(shard(key), key); }
+	void write(uint64_t key) override { ops::assign(shard(key), key); }
+	void erase(uint64_t key) override { ops::erase(shard(key), key); }
+	void insert(uint64_t key) override { ops::insert(shard(key), key); }
+
+private:
+	typedef shard_ops<Shard> ops;
+
+	// High bits of a multiplicative hash, so neighbouring keys land on different shards
+	Shard& shard(uint64_t key) { return shards[(key * 0x9e3779b97f4a7c15ULL) >> (64 - ShardBits)]; }
+
+	Shard shards[kShards];
+};
+
+// FIFO on std::deque behind one mutex, the hand rolled equivalent of thread_safe::queue
+class locked_queue_target : public target
+{
+public:
+	void set_name(const std::string&) override { }
+	void preload(uint64_t keys, uint64_t step) override
+	{
+		for (uint64_t k = 0; k < keys; k += step)
+			q.push_back(k);
+	}
+	size_t read(uint64_t) override { std::lock_guard<std::mutex> g(lock); return q.size(); }
+	size_t scan(uint64_t key, unsigned) override { return read(key); }
+	void write(uint64_t key) override { std::lock_guard<std::mutex> g(lock); q.push_back(key); }
+	void erase(uint64_t) override
+	{
+		std::lock_guard<std::mutex> g(lock);
+		if (!q.empty())
+			q.pop_front();
+	}
+
+private:
+	std::mutex lock;
+	std::deque<uint64_t> q;
+};
+
+// FIFO on concurrent_deque: producers and consumers take different locks
+class concurrent_deque_target : public target
+{
+public:
+	void set_name(const std::string&) override { }
+	void preload(uint64_t keys, uint64_t step) override
+	{
+		for (uint64_t k = 0; k < keys; k += step)
+			q.push_back(k);
+	}
+	size_t read(uint64_t) override { return q.size(); }
+	size_t scan(uint64_t, unsigned) override { return q.size(); }
+	void write(uint64_t key) override { q.push_back(key); }
+	void erase(uint64_t) override
+	{
+		uint64_t v;
+		q.try_pop_front(v);
+	}
+
+private:
+	thread_safe::concurrent_deque<uint64_t> q;
+};
+
+// The baselines, reported after the thread_safe:: containers they compare to
+inline std::vector<target_factory> baseline_targets()
+{
+	std::vector<target_factory> t;
+	t.push_back(make_factory<locked_map_target<std::map<uint64_t, uint64_t>, std::mutex>>("std_map_mutex", true));
+	t.push_back(make_factory<locked_map_target<std::map<uint64_t, uint64_t>, rw_lock>>("std_map_rwlock", true));
+	t.push_back(make_factory<locked_map_target<std::unordered_map<uint64_t, uint64_t>, std::mutex>>("std_unordered_map_mutex", true));
+	t.push_back(make_factory<locked_map_target<std::unordered_map<uint64_t, uint64_t>, rw_lock>>("std_unordered_map_rwlock", true));
+	t.push_back(make_factory<sharded_map_target<thread_safe::unordered_map<uint64_t, uint64_t>, 4>>("sharded_unordered_map", true));
+	t.push_back(make_factory<sharded_map_target<thread_safe::unordered_map<uint64_t, uint64_t>, 6>>("array64_unordered_map", true));
+	t.push_back(make_factory<sharded_map_target<packed_locked_map, 6>>("array64_packed_map", true));
+	t.push_back(make_factory<sharded_map_target<thread_safe::cache_padded<packed_locked_map>, 6>>("array64_padded_map", true));
+	t.push_back(make_factory<locked_set_target<std::set<uint64_t>, std::mutex>>("std_set_mutex", true));
+	t.push_back(make_factory<locked_set_target<std::set<uint64_t>, rw_lock>>("std_set_rwlock", true));
+	t.push_back(make_factory<locked_set_target<std::unordered_set<uint64_t>, std::mutex>>("std_unordered_set_mutex", true));
+	t.push_back(make_factory<locked_queue_target>("std_deque_mutex", false));
+	t.push_back(make_factory<concurrent_deque_target>("concurrent_deque", false));
+	return t;
+}
+
+}
+
+#endif // BENCH_BASELINES_H_INCLUDED
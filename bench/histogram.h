@@ -0,0 +1,105 @@
+#ifndef BENCH_HISTOGRAM_H_INCLUDED
+#define BENCH_HISTOGRAM_H_INCLUDED
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace bench {
+
+// Log-linear latency histogram in the HDR style: values below 2^kSubBits are
+// counted exactly, above that every power of two is split into 2^kSubBits
+// equal buckets, so any recorded value is reported within ~3% of itself.
+// Recording is a bucket index computation and an increment with no atomics;
+// each thread owns its histograms and they are merged after the run.
+class histogram
+{
+public:
+	static const unsigned kSubBits = 5;
+	static const uint64_t kSubCount = 1ULL << kSubBits;
+	static const size_t kBucketCount = (64 - kSubBits + 1) * kSubCount;
+
+	histogram() : counts(kBucketCount, 0), total(0), max_value(0) { }
+
+	void record(uint64_t v)
+	{
+		counts[bucket_of(v)]++;
+		total++;
+		if (v > max_value)
+			max_value = v;
+	}
+
+	void merge(const histogram& other)
+	{
+		for (size_t i = 0; i < kBucketCount; i++)
+			counts[i] += other.counts[i];
+		total += other.total;
+		if (other.max_value > max_value)
+			max_value = other.max_value;
+	}
+
+	uint64_t count() const { return total; }
+	uint64_t max() const { return max_value; }
+
+	// Smallest recorded value v such that pct percent of all values are <= v,
+	// reported as the top of its bucket (never above the exact maximum)
+	uint64_t percentile(double pct) const
+	{
+		if (total == 0)
+			return 0;
+		uint64_t rank = static_cast<uint64_t>(pct / 100.0 * total + 0.5);
+		if (rank == 0)
+			rank = 1;
+		if (rank > total)
+			rank = total;
+		uint64_t seen = 0;
+		for (size_t i = 0; i < kBucketCount; i++)
+		{
+			seen += counts[i];
+			if (seen >= rank)
+			{
+				uint64_t top = bucket_top(i);
+				return top < max_value ? top : max_value;
+			}
+		}
+		return max_value;
+	}
+
+private:
+	static unsigned highest_bit(uint64_t v)
+	{
+#if defined(__GNUC__) || defined(__clang__)
+		return 63 - __builtin_clzll(v);
+#else
+		unsigned b = 0;
+		while (v >>= 1)
+			b++;
+		return b;
+#endif
+	}
+
+	static size_t bucket_of(uint64_t v)
+	{
+		if (v < kSubCount)
+			return static_cast<size_t>(v);
+		unsigned shift = highest_bit(v) - kSubBits;
+		return static_cast<size_t>((shift + 1) * kSubCount + ((v >> shift) - kSubCount));
+	}
+
+	static uint64_t bucket_top(size_t i)
+	{
+		if (i < kSubCount)
+			return i;
+		unsigned shift = static_cast<unsigned>(i / kSubCount - 1);
+		uint64_t low = (kSubCount + i % kSubCount) << shift;
+		return low + ((1ULL << shift) - 1);
+	}
+
+	std::vector<uint64_t> counts;
+	uint64_t total;
+	uint64_t max_value;
+};
+
+}
+
+#endif // BENCH_HISTOGRAM_H_INCLUDED
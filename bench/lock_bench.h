@@ -0,0 +1,86 @@
+#ifndef BENCH_LOCK_BENCH_H_INCLUDED
+#define BENCH_LOCK_BENCH_H_INCLUDED
+
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "targets.h"
+#include "thread_safe_locks.h"
+
+// The lock primitives on their own: every operation takes one shared lock
+// and does cs units of work on shared data inside it. Sweeping the critical
+// section length and the thread count shows where spinning stops paying off
+// and a sleeping mutex wins.
+
+namespace bench {
+
+template <class Lock>
+class lock_target : public target
+{
+public:
+	static const size_t kSlots = 64;
+
+	explicit lock_target(unsigned cs) : cs(cs), next(0)
+	{
+		for (size_t i = 0; i < kSlots; i++)
+			data[i] = 0;
+	}
+
+	void set_name(const std::string&) override { }
+	void preload(uint64_t, uint64_t) override { }
+	size_t read(uint64_t key) override { return critical(key); }
+	void write(uint64_t key) override { critical(key); }
+	void erase(uint64_t key) override { critical(key); }
+	size_t scan(uint64_t key, unsigned) override { return critical(key); }
+
+private:
+	// One unit is a dependent read-modify-write of a shared word
+	size_t critical(uint64_t key)
+	{
+		std::lock_guard<Lock> g(lock);
+		uint64_t v = key;
+		for (unsigned i = 0; i < cs; i++)
+		{
+			uint64_t& slot = data[next++ % kSlots];
+			v = slot = slot * 31 + v;
+		}
+		return static_cast<size_t>(v);
+	}
+
+	Lock lock;
+	const unsigned cs;
+	uint64_t next;
+	uint64_t data[kSlots];
+};
+
+template <class Lock>
+target_factory make_lock_factory(const std::string& lock_name, unsigned cs)
+{
+	target_factory f;
+	f.name = "lock/" + lock_name + "/cs=" + std::to_string(cs);
+	f.keyed = false;
+	f.make = [cs] { return std::unique_ptr<target>(new lock_target<Lock>(cs)); };
+	return f;
+}
+
+inline bool is_lock_target(const target_factory& t) { return t.name.compare(0, 5, "lock/") == 0; }
+
+// Every lock at every critical section length, grouped by length
+inline std::vector<target_factory> lock_targets(const std::vector<unsigned>& cs_lengths)
+{
+	std::vector<target_factory> t;
+	for (unsigned cs : cs_lengths)
+	{
+		t.push_back(make_lock_factory<std::mutex>("std_mutex", cs));
+		t.push_back(make_lock_factory<thread_safe::spin_lock>("spin_lock", cs));
+		t.push_back(make_lock_factory<thread_safe::ticket_lock>("ticket_lock", cs));
+		t.push_back(make_lock_factory<thread_safe::adaptive_mutex>("adaptive_mutex", cs));
+	}
+	return t;
+}
+
+}
+
+#endif // BENCH_LOCK_BENCH_H_INCLUDED
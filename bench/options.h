@@ -0,0 +1,289 @@
+#ifndef BENCH_OPTIONS_H_INCLUDED
+#define BENCH_OPTIONS_H_INCLUDED
+
+#include <cctype>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace bench {
+
+// Command line settings shared by every workload
+struct options
+{
+	std::vector<unsigned> threads;      // thread counts to sweep
+	unsigned duration_ms = 1000;        // measured time per run
+	unsigned warmup_ms = 200;           // unmeasured time before each run
+	unsigned repeat = 1;                // runs per (container, thread count)
+	size_t keys = 100000;               // key space, half of it preloaded (all of it for YCSB)
+	std::string workload;               // YCSB core workload a-f, empty for --mix
+	unsigned read_pct = 80;             // operation mix in percent
+	unsigned write_pct = 15;
+	unsigned insert_pct = 0;
+	unsigned scan_pct = 0;
+	unsigned rmw_pct = 0;
+	unsigned erase_pct = 5;
+	std::string distribution = "uniform";
+	double theta = 0.99;                // zipfian and latest skew
+	double hot_data = 0.2;              // hotspot: fraction of keys that are hot
+	double hot_ops = 0.8;               // hotspot: fraction of operations on hot keys
+	unsigned scan_length = 100;         // scans visit 1..scan_length records
+
+	bool ycsb() const { return !workload.empty(); }
+	std::vector<std::string> containers; // empty runs all of them
+	std::string format = "table";       // table, csv or json
+	std::string output;                 // file, stdout when empty
+	bool perf = false;                  // count perf events per run
+	std::vector<unsigned> lock_cs;      // lock microbenchmark critical section lengths, empty when off
+	bool list = false;
+};
+
+inline std::vector<std::string> split(const std::string& s, char sep)
+{
+	std::vector<std::string> parts;
+	std::stringstream ss(s);
+	std::string item;
+	while (std::getline(ss, item, sep))
+	{
+		if (!item.empty())
+			parts.push_back(item);
+	}
+	return parts;
+}
+
+// Count with an optional k, m or g suffix (powers of 1000), 0 on bad input
+inline uint64_t parse_count(const std::string& s)
+{
+	char* end = nullptr;
+	uint64_t n = std::strtoull(s.c_str(), &end, 10);
+	if (end == s.c_str())
+		return 0;
+	switch (*end)
+	{
+	case '\0': return n;
+	case 'k': case 'K': return end[1] ? 0 : n * 1000;
+	case 'm': case 'M': return end[1] ? 0 : n * 1000000;
+	case 'g': case 'G': return end[1] ? 0 : n * 1000000000;
+	default: return 0;
+	}
+}
+
+// YCSB core workloads, as in the YCSB workloads/ directory:
+//   a  50% read, 50% update, zipfian     (session store)
+//   b  95% read, 5% update, zipfian      (photo tagging)
+//   c  100% read, zipfian                (user profile cache)
+//   d  95% read, 5% insert, latest       (user status updates)
+//   e  95% scan, 5% insert, zipfian      (threaded conversations)
+//   f  50% read, 50% read-modify-write, zipfian
+// The distribution is only the default, --dist still overrides it.
+inline bool apply_ycsb_workload(options& opt, const std::string& name, bool keep_distribution)
+{
+	static const struct
+	{
+		char name;
+		unsigned read, update, insert, scan, rmw;
+		const char* distribution;
+	} workloads[] = {
+		{ 'a', 50, 50, 0, 0, 0, "zipfian" },
+		{ 'b', 95, 5, 0, 0, 0, "zipfian" },
+		{ 'c', 100, 0, 0, 0, 0, "zipfian" },
+		{ 'd', 95, 0, 5, 0, 0, "latest" },
+		{ 'e', 0, 0, 5, 95, 0, "zipfian" },
+		{ 'f', 50, 0, 0, 0, 50, "zipfian" },
+	};
+	if (name.size() != 1)
+		return false;
+	char c = static_cast<char>(std::tolower(static_cast<unsigned char>(name[0])));
+	for (const auto& w : workloads)
+	{
+		if (w.name != c)
+			continue;
+		opt.workload = std::string(1, c);
+		opt.read_pct = w.read;
+		opt.write_pct = w.update;
+		opt.insert_pct = w.insert;
+		opt.scan_pct = w.scan;
+		opt.rmw_pct = w.rmw;
+		opt.erase_pct = 0;
+		if (!keep_distribution)
+			opt.distribution = w.distribution;
+		return true;
+	}
+	return false;
+}
+
+// 1, 2, 4, ... up to and including the hardware thread count
+inline std::vector<unsigned> default_thread_counts()
+{
+	unsigned hw = std::thread::hardware_concurrency();
+	if (hw == 0)
+		hw = 1;
+	std::vector<unsigned> counts;
+	for (unsigned n = 1; n < hw; n *= 2)
+		counts.push_back(n);
+	counts.push_back(hw);
+	return counts;
+}
+
+inline void print_usage(const char* prog)
+{
+	std::cout << "usage: " << prog << " [options]\n"
+		<< "  --threads=1,2,4      thread counts to sweep (default 1,2,4..hardware threads)\n"
+		<< "  --duration=MS        measured milliseconds per run (default 1000)\n"
+		<< "  --warmup=MS          warmup milliseconds per run (default 200)\n"
+		<< "  --repeat=N           runs per configuration (default 1)\n"
+		<< "  --keys=N             key space size, half preloaded (default 100000, k/m/g suffixes)\n"
+		<< "  --mix=R:W:E          read/write/erase percentages (default 80:15:5)\n"
+		<< "  --workload=a..f      YCSB core workload instead of --mix, preloads all keys\n"
+		<< "  --dist=NAME          key distribution: uniform, sequential, zipfian, latest,\n"
+		<< "                       hotspot (default uniform, or the YCSB workload's)\n"
+		<< "  --theta=X            zipfian and latest skew (default 0.99)\n"
+		<< "  --hotspot=D:O        hotspot: fraction D of keys gets fraction O of ops (default 0.2:0.8)\n"
+		<< "  --scan-length=N      longest YCSB scan (default 100)\n"
+		<< "  --containers=a,b     containers to run (default all, see --list)\n"
+		<< "  --format=FMT         table, csv or json (default table)\n"
+		<< "  --output=FILE        write results to FILE instead of stdout\n"
+		<< "  --perf               count cycles, instructions, cache and branch misses and\n"
+		<< "                       context switches per operation (Linux perf_event_open)\n"
+		<< "  --locks[=0,16,128]   benchmark the lock primitives alone, each operation doing\n"
+		<< "                       that many units of work under the lock (default 0,16,128,1024)\n"
+		<< "  --list               list containers and exit\n";
+}
+
+// Returns false with a message in error on bad input
+inline bool parse_options(int argc, char** argv, options& opt, std::string& error)
+{
+	bool distribution_set = false;
+	std::string workload;
+	for (int i = 1; i < argc; i++)
+	{
+		std::string arg = argv[i];
+		std::string key = arg, value;
+		size_t eq = arg.find('=');
+		if (eq != std::string::npos)
+		{
+			key = arg.substr(0, eq);
+			value = arg.substr(eq + 1);
+		}
+
+		if (key == "--threads")
+		{
+			opt.threads.clear();
+			for (const std::string& t : split(value, ','))
+				opt.threads.push_back(static_cast<unsigned>(std::strtoul(t.c_str(), nullptr, 10)));
+		}
+		else if (key == "--duration")
+			opt.duration_ms = static_cast<unsigned>(std::strtoul(value.c_str(), nullptr, 10));
+		else if (key == "--warmup")
+			opt.warmup_ms = static_cast<unsigned>(std::strtoul(value.c_str(), nullptr, 10));
+		else if (key == "--repeat")
+			opt.repeat = static_cast<unsigned>(std::strtoul(value.c_str(), nullptr, 10));
+		else if (key == "--keys")
+			opt.keys = static_cast<size_t>(parse_count(value));
+		else if (key == "--mix")
+		{
+			std::vector<std::string> parts = split(value, ':');
+			if (parts.size() != 3)
+			{
+				error = "--mix needs three values R:W:E";
+				return false;
+			}
+			opt.read_pct = static_cast<unsigned>(std::strtoul(parts[0].c_str(), nullptr, 10));
+			opt.write_pct = static_cast<unsigned>(std::strtoul(parts[1].c_str(), nullptr, 10));
+			opt.erase_pct = static_cast<unsigned>(std::strtoul(parts[2].c_str(), nullptr, 10));
+		}
+		else if (key == "--workload")
+			workload = value;
+		else if (key == "--dist")
+		{
+			opt.distribution = value;
+			distribution_set = true;
+		}
+		else if (key == "--theta")
+			opt.theta = std::strtod(value.c_str(), nullptr);
+		else if (key == "--hotspot")
+		{
+			std::vector<std::string> parts = split(value, ':');
+			if (parts.size() != 2)
+			{
+				error = "--hotspot needs two fractions D:O";
+				return false;
+			}
+			opt.hot_data = std::strtod(parts[0].c_str(), nullptr);
+			opt.hot_ops = std::strtod(parts[1].c_str(), nullptr);
+		}
+		else if (key == "--scan-length")
+			opt.scan_length = static_cast<unsigned>(std::strtoul(value.c_str(), nullptr, 10));
+		else if (key == "--containers")
+			opt.containers = split(value, ',');
+		else if (key == "--format")
+			opt.format = value;
+		else if (key == "--output")
+			opt.output = value;
+		else if (key == "--perf")
+			opt.perf = true;
+		else if (key == "--locks")
+		{
+			opt.lock_cs.clear();
+			for (const std::string& c : split(value.empty() ? "0,16,128,1024" : value, ','))
+				opt.lock_cs.push_back(static_cast<unsigned>(std::strtoul(c.c_str(), nullptr, 10)));
+		}
+		else if (key == "--list")
+			opt.list = true;
+		else if (key == "--help" || key == "-h")
+		{
+			print_usage(argv[0]);
+			std::exit(0);
+		}
+		else
+		{
+			error = "unknown option " + arg;
+			return false;
+		}
+	}
+
+	if (!workload.empty() && !apply_ycsb_workload(opt, workload, distribution_set))
+	{
+		error = "unknown workload " + workload + " (a to f)";
+		return false;
+	}
+	if (opt.threads.empty())
+		opt.threads = default_thread_counts();
+	for (unsigned t : opt.threads)
+	{
+		if (t == 0)
+		{
+			error = "thread counts must be positive";
+			return false;
+		}
+	}
+	if (opt.read_pct + opt.write_pct + opt.insert_pct + opt.scan_pct + opt.rmw_pct + opt.erase_pct != 100)
+	{
+		error = "--mix percentages must add up to 100";
+		return false;
+	}
+	if (opt.keys == 0 || opt.repeat == 0 || opt.duration_ms == 0 || opt.scan_length == 0)
+	{
+		error = "--keys, --repeat, --duration and --scan-length must be positive";
+		return false;
+	}
+	if (opt.theta <= 0 || opt.hot_data <= 0 || opt.hot_data > 1 || opt.hot_ops < 0 || opt.hot_ops > 1)
+	{
+		error = "--theta must be positive and --hotspot fractions in (0, 1]";
+		return false;
+	}
+	if (opt.format != "table" && opt.format != "csv" && opt.format != "json")
+	{
+		error = "unknown format " + opt.format;
+		return false;
+	}
+	return true;
+}
+
+}
+
+#endif // BENCH_OPTIONS_H_INCLUDED
@@ -0,0 +1,241 @@
+#ifndef BENCH_PERF_COUNTERS_H_INCLUDED
+#define BENCH_PERF_COUNTERS_H_INCLUDED
+
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace bench {
+
+// Hardware events first, then the software events that remain available in
+// VMs and containers where the PMU is hidden or perf_event_paranoid is high
+enum counter_id
+{
+	ctr_cycles,
+	ctr_instructions,
+	ctr_l1d_misses,
+	ctr_llc_misses,
+	ctr_branch_misses,
+	ctr_context_switches,
+	ctr_cpu_migrations,
+	ctr_page_faults,
+	counter_count
+};
+
+inline const char* counter_name(int id)
+{
+	static const char* const names[counter_count] = {
+		"cycles", "instructions", "l1d_misses", "llc_misses", "branch_misses",
+		"context_switches", "cpu_migrations", "page_faults"
+	};
+	return names[id];
+}
+
+// Totals of one thread or, summed, of one run
+struct counter_values
+{
+	uint64_t value[counter_count];
+	bool valid[counter_count];
+
+	counter_values()
+	{
+		std::memset(value, 0, sizeof(value));
+		std::memset(valid, 0, sizeof(valid));
+	}
+
+	bool any() const
+	{
+		for (int i = 0; i < counter_count; i++)
+		{
+			if (valid[i])
+				return true;
+		}
+		return false;
+	}
+
+	// A counter stays valid only if every thread could count it
+	void merge(const counter_values& other, bool first)
+	{
+		for (int i = 0; i < counter_count; i++)
+		{
+			value[i] += other.value[i];
+			valid[i] = (first || valid[i]) && other.valid[i];
+		}
+	}
+};
+
+// Counts the events of the calling thread between start() and stop() with
+// perf_event_open. Events the kernel refuses are left invalid; context
+// switches then fall back to getrusage(RUSAGE_THREAD). On other systems
+// nothing is counted.
+class thread_counters
+{
+public:
+	explicit thread_counters(bool enabled)
+	{
+		for (int i = 0; i < counter_count; i++)
+		{
+			fds[i] = -1;
+			errors[i] = enabled ? 0 : -1;
+		}
+		rusage_switches = false;
+		switches_at_start = 0;
+		switches = 0;
+		if (!enabled)
+			return;
+#if defined(__linux__)
+		for (int i = 0; i < counter_count; i++)
+			fds[i] = open_event(i, errors[i]);
+		if (fds[ctr_context_switches] < 0)
+			rusage_switches = true;
+#else
+		for (int i = 0; i < counter_count; i++)
+			errors[i] = ENOSYS;
+#endif
+	}
+
+	~thread_counters()
+	{
+#if defined(__linux__)
+		for (int i = 0; i < counter_count; i++)
+		{
+			if (fds[i] >= 0)
+				close(fds[i]);
+		}
+#endif
+	}
+
+	thread_counters(const thread_counters&) = delete;
+	thread_counters& operator=(const thread_counters&) = delete;
+
+	void start()
+	{
+#if defined(__linux__)
+		for (int i = 0; i < counter_count; i++)
+		{
+			if (fds[i] >= 0)
+			{
+				ioctl(fds[i], PERF_EVENT_IOC_RESET, 0);
+				ioctl(fds[i], PERF_EVENT_IOC_ENABLE, 0);
+			}
+		}
+		if (rusage_switches)
+			switches_at_start = thread_switches();
+#endif
+	}
+
+	void stop()
+	{
+#if defined(__linux__)
+		for (int i = 0; i < counter_count; i++)
+		{
+			if (fds[i] >= 0)
+				ioctl(fds[i], PERF_EVENT_IOC_DISABLE, 0);
+		}
+		if (rusage_switches)
+			switches = thread_switches() - switches_at_start;
+#endif
+	}
+
+	// Values scaled up for the time the kernel multiplexed an event out
+	counter_values read() const
+	{
+		counter_values v;
+#if defined(__linux__)
+		for (int i = 0; i < counter_count; i++)
+		{
+			if (fds[i] < 0)
+				continue;
+			uint64_t data[3];
+			if (::read(fds[i], data, sizeof(data)) != static_cast<ssize_t>(sizeof(data)))
+				continue;
+			v.valid[i] = true;
+			v.value[i] = data[2] ? static_cast<uint64_t>(static_cast<double>(data[0]) * data[1] / data[2]) : data[0];
+		}
+		if (rusage_switches)
+		{
+			v.valid[ctr_context_switches] = true;
+			v.value[ctr_context_switches] = switches;
+		}
+#endif
+		return v;
+	}
+
+	// Why a counter could not be opened, empty when it is counted
+	std::string error(int id) const
+	{
+		if (errors[id] == 0)
+			return std::string();
+		if (id == ctr_context_switches && rusage_switches)
+			return std::string();
+		if (errors[id] < 0)
+			return "disabled";
+		return std::strerror(errors[id]);
+	}
+
+	bool uses_rusage_fallback() const { return rusage_switches; }
+
+private:
+#if defined(__linux__)
+	static int open_event(int id, int& error)
+	{
+		perf_event_attr attr;
+		std::memset(&attr, 0, sizeof(attr));
+		attr.size = sizeof(attr);
+		attr.disabled = 1;
+		attr.exclude_hv = 1;
+		attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+		switch (id)
+		{
+		case ctr_cycles: attr.type = PERF_TYPE_HARDWARE; attr.config = PERF_COUNT_HW_CPU_CYCLES; break;
+		case ctr_instructions: attr.type = PERF_TYPE_HARDWARE; attr.config = PERF_COUNT_HW_INSTRUCTIONS; break;
+		case ctr_l1d_misses:
+			attr.type = PERF_TYPE_HW_CACHE;
+			attr.config = PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+			break;
+		case ctr_llc_misses: attr.type = PERF_TYPE_HARDWARE; attr.config = PERF_COUNT_HW_CACHE_MISSES; break;
+		case ctr_branch_misses: attr.type = PERF_TYPE_HARDWARE; attr.config = PERF_COUNT_HW_BRANCH_MISSES; break;
+		case ctr_context_switches: attr.type = PERF_TYPE_SOFTWARE; attr.config = PERF_COUNT_SW_CONTEXT_SWITCHES; break;
+		case ctr_cpu_migrations: attr.type = PERF_TYPE_SOFTWARE; attr.config = PERF_COUNT_SW_CPU_MIGRATIONS; break;
+		default: attr.type = PERF_TYPE_SOFTWARE; attr.config = PERF_COUNT_SW_PAGE_FAULTS; break;
+		}
+
+		// Counting the kernel side needs perf_event_paranoid < 2, retry user only
+		int fd = static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+		if (fd < 0 && (errno == EACCES || errno == EPERM))
+		{
+			attr.exclude_kernel = 1;
+			fd = static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+		}
+		error = fd < 0 ? errno : 0;
+		return fd;
+	}
+
+	static uint64_t thread_switches()
+	{
+		rusage usage;
+		if (getrusage(RUSAGE_THREAD, &usage) != 0)
+			return 0;
+		return static_cast<uint64_t>(usage.ru_nvcsw + usage.ru_nivcsw);
+	}
+#endif
+
+	int fds[counter_count];
+	int errors[counter_count];
+	bool rusage_switches;
+	uint64_t switches_at_start;
+	uint64_t switches;
+};
+
+}
+
+#endif // BENCH_PERF_COUNTERS_H_INCLUDED
@@ -0,0 +1,297 @@
+#ifndef BENCH_REPORT_H_INCLUDED
+#define BENCH_REPORT_H_INCLUDED
+
+#include <algorithm>
+#include <cstdio>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "runner.h"
+
+namespace bench {
+
+inline std::string format_double(double v, const char* fmt)
+{
+	char buf[64];
+	std::snprintf(buf, sizeof(buf), fmt, v);
+	return buf;
+}
+
+// Percentiles reported for every container and operation type
+struct percentile_column
+{
+	const char* name;
+	double pct;
+};
+
+static const percentile_column kPercentiles[] = {
+	{ "p50", 50.0 }, { "p90", 90.0 }, { "p99", 99.0 }, { "p99.9", 99.9 }
+};
+static const size_t kPercentileCount = sizeof(kPercentiles) / sizeof(kPercentiles[0]);
+
+// CSV header safe form of a percentile name ("p99.9" -> "p999")
+inline std::string column_name(const char* name)
+{
+	std::string out;
+	for (const char* c = name; *c; c++)
+	{
+		if (*c != '.')
+			out += *c;
+	}
+	return out;
+}
+
+inline std::string json_escape(const std::string& s)
+{
+	std::string out;
+	for (char c : s)
+	{
+		if (c == '"' || c == '\\')
+			out += '\\';
+		out += c;
+	}
+	return out;
+}
+
+// Throughput versus threads, one row per container and workload and one
+// column per thread count, repeats averaged
+inline void write_scaling_table(std::ostream& os, const std::vector<run_result>& results)
+{
+	std::vector<unsigned> threads;
+	std::vector<std::pair<std::string, std::string> > rows;
+	for (const run_result& r : results)
+	{
+		if (std::find(threads.begin(), threads.end(), r.threads) == threads.end())
+			threads.push_back(r.threads);
+		std::pair<std::string, std::string> row(r.container, r.workload);
+		if (std::find(rows.begin(), rows.end(), row) == rows.end())
+			rows.push_back(row);
+	}
+	std::sort(threads.begin(), threads.end());
+
+	char line[256];
+	os << "\nops/sec by threads\n";
+	std::snprintf(line, sizeof(line), "%-24s %-20s", "container", "workload");
+	os << line;
+	for (unsigned t : threads)
+	{
+		std::snprintf(line, sizeof(line), " %12u", t);
+		os << line;
+	}
+	os << '\n';
+	for (const std::pair<std::string, std::string>& row : rows)
+	{
+		std::snprintf(line, sizeof(line), "%-24s %-20s", row.first.c_str(), row.second.c_str());
+		os << line;
+		for (unsigned t : threads)
+		{
+			double sum = 0;
+			unsigned runs = 0;
+			for (const run_result& r : results)
+			{
+				if (r.threads == t && r.container == row.first && r.workload == row.second)
+				{
+					sum += r.ops_per_sec();
+					runs++;
+				}
+			}
+			if (runs)
+				std::snprintf(line, sizeof(line), " %12.0f", sum / runs);
+			else
+				std::snprintf(line, sizeof(line), " %12s", "-");
+			os << line;
+		}
+		os << '\n';
+	}
+}
+
+inline bool any_counters(const std::vector<run_result>& results)
+{
+	for (const run_result& r : results)
+	{
+		if (r.counters.any())
+			return true;
+	}
+	return false;
+}
+
+// Average perf events per operation, "-" for events that were not counted
+inline void write_counter_table(std::ostream& os, const std::vector<run_result>& results)
+{
+	if (!any_counters(results))
+		return;
+	char line[256];
+	os << "\nevents per operation\n";
+	std::snprintf(line, sizeof(line), "%-24s %-20s %7s", "container", "workload", "threads");
+	os << line;
+	for (int c = 0; c < counter_count; c++)
+	{
+		std::snprintf(line, sizeof(line), " %16s", counter_name(c));
+		os << line;
+	}
+	os << "      ipc\n";
+	for (const run_result& r : results)
+	{
+		std::snprintf(line, sizeof(line), "%-24s %-20s %7u", r.container.c_str(), r.workload.c_str(), r.threads);
+		os << line;
+		double ops = static_cast<double>(r.total_ops());
+		for (int c = 0; c < counter_count; c++)
+		{
+			if (r.counters.valid[c] && ops > 0)
+				std::snprintf(line, sizeof(line), " %16.4f", r.counters.value[c] / ops);
+			else
+				std::snprintf(line, sizeof(line), " %16s", "-");
+			os << line;
+		}
+		if (r.counters.valid[ctr_cycles] && r.counters.valid[ctr_instructions] && r.counters.value[ctr_cycles])
+			std::snprintf(line, sizeof(line), " %8.2f\n", static_cast<double>(r.counters.value[ctr_instructions]) / r.counters.value[ctr_cycles]);
+		else
+			std::snprintf(line, sizeof(line), " %8s\n", "-");
+		os << line;
+	}
+}
+
+// Human readable, one line per run
+inline void write_table(std::ostream& os, const std::vector<run_result>& results)
+{
+	char line[256];
+	std::snprintf(line, sizeof(line), "%-24s %-20s %7s %14s %12s %9s %12s %12s\n",
+		"container", "workload", "threads", "ops/sec", "ns/op", "fairness", "min thr ops", "max thr ops");
+	os << line;
+	for (const run_result& r : results)
+	{
+		double ns_per_op = r.total_ops() ? r.seconds * 1e9 * r.threads / r.total_ops() : 0;
+		std::snprintf(line, sizeof(line), "%-24s %-20s %7u %14.0f %12.1f %9.3f %12llu %12llu\n",
+			r.container.c_str(), r.workload.c_str(), r.threads, r.ops_per_sec(), ns_per_op, r.fairness(),
+			static_cast<unsigned long long>(r.min_thread_ops()), static_cast<unsigned long long>(r.max_thread_ops()));
+		os << line;
+	}
+
+	write_scaling_table(os, results);
+	write_counter_table(os, results);
+
+	// Latency per operation type, in nanoseconds
+	os << '\n';
+	std::snprintf(line, sizeof(line), "%-24s %-20s %7s %-6s %12s", "container", "workload", "threads", "op", "count");
+	os << line;
+	for (size_t p = 0; p < kPercentileCount; p++)
+	{
+		std::snprintf(line, sizeof(line), " %9s", (std::string(kPercentiles[p].name) + " ns").c_str());
+		os << line;
+	}
+	os << "     max ns\n";
+	for (const run_result& r : results)
+	{
+		for (int op = 0; op < op_type_count; op++)
+		{
+			const histogram& h = r.latency[op];
+			if (!h.count())
+				continue;
+			std::snprintf(line, sizeof(line), "%-24s %-20s %7u %-6s %12llu", r.container.c_str(), r.workload.c_str(),
+				r.threads, op_name(static_cast<op_type>(op)), static_cast<unsigned long long>(h.count()));
+			os << line;
+			for (size_t p = 0; p < kPercentileCount; p++)
+			{
+				std::snprintf(line, sizeof(line), " %9llu", static_cast<unsigned long long>(h.percentile(kPercentiles[p].pct)));
+				os << line;
+			}
+			std::snprintf(line, sizeof(line), " %10llu\n", static_cast<unsigned long long>(h.max()));
+			os << line;
+		}
+	}
+}
+
+inline void write_csv(std::ostream& os, const std::vector<run_result>& results)
+{
+	os << "container,workload,threads,seconds,ops,ops_per_sec,fairness,min_thread_ops,max_thread_ops";
+	for (int op = 0; op < op_type_count; op++)
+	{
+		std::string prefix = op_name(static_cast<op_type>(op));
+		os << ',' << prefix << "_ops";
+		for (size_t p = 0; p < kPercentileCount; p++)
+			os << ',' << prefix << '_' << column_name(kPercentiles[p].name) << "_ns";
+		os << ',' << prefix << "_max_ns";
+	}
+	bool counters = any_counters(results);
+	for (int c = 0; counters && c < counter_count; c++)
+		os << ',' << counter_name(c) << "_per_op";
+	os << '\n';
+	for (const run_result& r : results)
+	{
+		os << r.container << ',' << r.workload << ',' << r.threads << ',' << format_double(r.seconds, "%.6f") << ','
+			<< r.total_ops() << ',' << format_double(r.ops_per_sec(), "%.1f") << ','
+			<< format_double(r.fairness(), "%.4f") << ',' << r.min_thread_ops() << ',' << r.max_thread_ops();
+		for (int op = 0; op < op_type_count; op++)
+		{
+			os << ',' << r.ops_by_type[op];
+			for (size_t p = 0; p < kPercentileCount; p++)
+				os << ',' << r.latency[op].percentile(kPercentiles[p].pct);
+			os << ',' << r.latency[op].max();
+		}
+		for (int c = 0; counters && c < counter_count; c++)
+		{
+			os << ',';
+			if (r.counters.valid[c] && r.total_ops())
+				os << format_double(static_cast<double>(r.counters.value[c]) / r.total_ops(), "%.4f");
+		}
+		os << '\n';
+	}
+}
+
+inline void write_json(std::ostream& os, const std::vector<run_result>& results)
+{
+	os << "[\n";
+	for (size_t i = 0; i < results.size(); i++)
+	{
+		const run_result& r = results[i];
+		os << "  {\"container\": \"" << json_escape(r.container) << "\", \"workload\": \"" << json_escape(r.workload) << "\""
+			<< ", \"threads\": " << r.threads
+			<< ", \"seconds\": " << format_double(r.seconds, "%.6f")
+			<< ", \"ops\": " << r.total_ops()
+			<< ", \"ops_per_sec\": " << format_double(r.ops_per_sec(), "%.1f")
+			<< ", \"fairness\": " << format_double(r.fairness(), "%.4f")
+			<< ", \"thread_ops\": [";
+		for (size_t t = 0; t < r.thread_ops.size(); t++)
+			os << (t ? ", " : "") << r.thread_ops[t];
+		os << "], \"latency_ns\": {";
+		for (int op = 0; op < op_type_count; op++)
+		{
+			const histogram& h = r.latency[op];
+			os << (op ? ", " : "") << "\"" << op_name(static_cast<op_type>(op)) << "\": {\"count\": " << r.ops_by_type[op];
+			for (size_t p = 0; p < kPercentileCount; p++)
+				os << ", \"" << kPercentiles[p].name << "\": " << h.percentile(kPercentiles[p].pct);
+			os << ", \"max\": " << h.max() << "}";
+		}
+		os << "}";
+		if (r.counters.any())
+		{
+			os << ", \"counters\": {";
+			bool first = true;
+			for (int c = 0; c < counter_count; c++)
+			{
+				if (!r.counters.valid[c])
+					continue;
+				os << (first ? "" : ", ") << "\"" << counter_name(c) << "\": " << r.counters.value[c];
+				first = false;
+			}
+			os << "}";
+		}
+		os << "}" << (i + 1 < results.size() ? "," : "") << "\n";
+	}
+	os << "]\n";
+}
+
+inline void write_results(std::ostream& os, const std::string& format, const std::vector<run_result>& results)
+{
+	if (format == "csv")
+		write_csv(os, results);
+	else if (format == "json")
+		write_json(os, results);
+	else
+		write_table(os, results);
+}
+
+}
+
+#endif // BENCH_REPORT_H_INCLUDED
@@ -0,0 +1,189 @@
+#ifndef BENCH_RUNNER_H_INCLUDED
+#define BENCH_RUNNER_H_INCLUDED
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "histogram.h"
+#include "options.h"
+#include "perf_counters.h"
+#include "targets.h"
+#include "timer.h"
+#include "workload.h"
+
+namespace bench {
+
+typedef std::chrono::steady_clock clock_type;
+
+// Result of one run of one container at one thread count
+struct run_result
+{
+	std::string container;
+	std::string workload;
+	unsigned threads = 0;
+	double seconds = 0;
+	std::vector<uint64_t> thread_ops;            // measured ops per thread
+	uint64_t ops_by_type[op_type_count] = { };
+	histogram latency[op_type_count];            // nanoseconds, merged over threads
+	counter_values counters;                     // summed over threads, with --perf
+
+	uint64_t total_ops() const
+	{
+		uint64_t n = 0;
+		for (uint64_t o : thread_ops)
+			n += o;
+		return n;
+	}
+
+	double ops_per_sec() const { return seconds > 0 ? total_ops() / seconds : 0; }
+
+	// Jain's fairness index: 1 when every thread did the same work, 1/n when one did all of it
+	double fairness() const
+	{
+		double sum = 0, squares = 0;
+		for (uint64_t o : thread_ops)
+		{
+			sum += static_cast<double>(o);
+			squares += static_cast<double>(o) * static_cast<double>(o);
+		}
+		return squares > 0 ? sum * sum / (thread_ops.size() * squares) : 1;
+	}
+
+	uint64_t min_thread_ops() const { return thread_ops.empty() ? 0 : *std::min_element(thread_ops.begin(), thread_ops.end()); }
+	uint64_t max_thread_ops() const { return thread_ops.empty() ? 0 : *std::max_element(thread_ops.begin(), thread_ops.end()); }
+};
+
+// Counters of one thread, kept on the thread's stack while it runs and
+// copied out at the end so threads never share a cache line
+struct thread_state
+{
+	uint64_t ops = 0;
+	uint64_t ops_by_type[op_type_count] = { };
+	histogram latency[op_type_count];
+	counter_values counters;
+	uint64_t sink = 0;
+};
+
+enum run_phase { phase_start, phase_warmup, phase_measure, phase_stop };
+
+// Runs the configured mix on one shared container from `threads` threads.
+// All threads start together after a barrier, run warmup_ms unmeasured, then
+// count operations for duration_ms. The phase flag is checked every kBatch
+// operations to keep it off the hot path.
+//
+// Every operation is timed into its thread's histogram for that op type.
+// Timestamps are chained, the end of one operation is the start of the next,
+// so there is one tick read per operation; the few nanoseconds spent picking
+// the next key and op are charged to the operation.
+//
+// With --perf each thread counts its own perf events over exactly the
+// batches it measures.
+inline run_result run_workload(target& t, const std::string& container, const std::string& workload, unsigned threads, const options& opt)
+{
+	const unsigned kBatch = 32;
+	std::atomic<int> phase(phase_start);
+	std::atomic<unsigned> ready(0);
+	std::vector<thread_state> states(threads);
+	op_mix mix(opt);
+	key_space space(opt.keys);
+	const double tick_ns = ns_per_tick();
+
+	std::vector<std::thread> workers;
+	for (unsigned i = 0; i < threads; i++)
+	{
+		workers.push_back(std::thread([&, i]
+		{
+			rng r(i + 1);
+			std::unique_ptr<key_generator> keys = make_key_generator(opt, space, i, threads);
+			thread_state state;
+			thread_counters perf(opt.perf);
+			bool counting = false;
+			ready.fetch_add(1);
+			while (phase.load(std::memory_order_acquire) == phase_start)
+				std::this_thread::yield();
+
+			uint64_t last = read_ticks();
+			for (;;)
+			{
+				int p = phase.load(std::memory_order_relaxed);
+				if (p == phase_stop)
+					break;
+				if (p == phase_measure && !counting)
+				{
+					perf.start();
+					counting = true;
+				}
+				for (unsigned b = 0; b < kBatch; b++)
+				{
+					op_type op = mix.next(r);
+					switch (op)
+					{
+					case op_read: state.sink += t.read(keys->next(r)); break;
+					case op_write: t.write(keys->next(r)); break;
+					case op_insert: t.insert(space.records.fetch_add(1, std::memory_order_relaxed)); break;
+					case op_scan: state.sink += t.scan(keys->next(r), 1 + static_cast<unsigned>(r.below(opt.scan_length))); break;
+					case op_rmw: state.sink += t.read_modify_write(keys->next(r)); break;
+					default: t.erase(keys->next(r)); break;
+					}
+					uint64_t now = read_ticks();
+					if (p == phase_measure)
+					{
+						state.ops_by_type[op]++;
+						state.latency[op].record(static_cast<uint64_t>((now - last) * tick_ns));
+					}
+					last = now;
+				}
+				if (p == phase_measure)
+					state.ops += kBatch;
+			}
+			if (counting)
+			{
+				perf.stop();
+				state.counters = perf.read();
+			}
+			states[i] = state;
+		}));
+	}
+
+	while (ready.load() < threads)
+		std::this_thread::yield();
+	phase.store(phase_warmup, std::memory_order_release);
+	std::this_thread::sleep_for(std::chrono::milliseconds(opt.warmup_ms));
+
+	clock_type::time_point start = clock_type::now();
+	phase.store(phase_measure, std::memory_order_release);
+	std::this_thread::sleep_for(std::chrono::milliseconds(opt.duration_ms));
+	phase.store(phase_stop, std::memory_order_release);
+	clock_type::time_point end = clock_type::now();
+
+	for (std::thread& w : workers)
+		w.join();
+
+	run_result result;
+	result.container = container;
+	result.workload = workload;
+	result.threads = threads;
+	result.seconds = std::chrono::duration<double>(end - start).count();
+	for (size_t i = 0; i < states.size(); i++)
+	{
+		const thread_state& s = states[i];
+		result.thread_ops.push_back(s.ops);
+		result.counters.merge(s.counters, i == 0);
+		for (int op = 0; op < op_type_count; op++)
+		{
+			result.ops_by_type[op] += s.ops_by_type[op];
+			result.latency[op].merge(s.latency[op]);
+		}
+	}
+	return result;
+}
+
+}
+
+#endif // BENCH_RUNNER_H_INCLUDED
@@ -0,0 +1,237 @@
+#ifndef BENCH_TARGETS_H_INCLUDED
+#define BENCH_TARGETS_H_INCLUDED
+
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "thread_safe_vector.h"
+#include "thread_safe_list.h"
+#include "thread_safe_map.h"
+#include "thread_safe_unordered_map.h"
+#include "thread_safe_set.h"
+#include "thread_safe_unordered_set.h"
+#include "thread_safe_queue.h"
+#include "thread_safe_deque.h"
+#include "thread_safe_stack.h"
+#include "thread_safe_flat_combining.h"
+
+namespace bench {
+
+// One shared container under test. The operations are called concurrently
+// from every benchmark thread.
+//
+// Associative containers: read = count(key), write = insert or assign,
+// insert = insert of a new key, erase = erase(key). Sequences: read = size(),
+// write and insert = push, erase = pop; the key only feeds the pushed value.
+// Associative containers run scans and read-modify-writes under one lock
+// acquisition with with_lock(): scans walk len records from the key (a range
+// for ordered containers, len point lookups for hashed ones) and a
+// read-modify-write is atomic. Elsewhere they default to len reads and a
+// read followed by a write, each a separate critical section. Reads never
+// hold a reference into the container after the call returns, which the
+// wrappers cannot make safe. Reads return what they saw so the work cannot
+// be optimized away. Targets hold cache line aligned containers, so they
+// allocate through the library's aligned operator new.
+class target : public thread_safe::detail::cache_aligned
+{
+public:
+	virtual ~target() { }
+	// Names the container's lock for thread_safe::dump_lock_stats()
+	virtual void set_name(const std::string& name) = 0;
+	// Inserts keys 0, step, 2 * step, ... below keys
+	virtual void preload(uint64_t keys, uint64_t step) = 0;
+	virtual size_t read(uint64_t key) = 0;
+	virtual void write(uint64_t key) = 0;
+	virtual void erase(uint64_t key) = 0;
+
+	virtual void insert(uint64_t key) { write(key); }
+	virtual size_t scan(uint64_t key, unsigned len)
+	{
+		size_t found = 0;
+		for (unsigned i = 0; i < len; i++)
+			found += read(key + i);
+		return found;
+	}
+	virtual size_t read_modify_write(uint64_t key)
+	{
+		size_t seen = read(key);
+		write(key);
+		return seen;
+	}
+};
+
+// Scans of len records: a real range scan for ordered containers, len point
+// lookups for hashed ones. Either way under the caller's single lock.
+template <class Map>
+size_t scan_records(const Map& m, uint64_t key, unsigned len)
+{
+	size_t found = 0;
+	for (unsigned i = 0; i < len; i++)
+		found += m.count(key + i);
+	return found;
+}
+
+template <class K, class V, class C, class A>
+size_t scan_records(const std::map<K, V, C, A>& m, uint64_t key, unsigned len)
+{
+	size_t found = 0;
+	for (typename std::map<K, V, C, A>::const_iterator it = m.lower_bound(key); it != m.end() && found < len; ++it)
+		found++;
+	return found;
+}
+
+template <class K, class C, class A>
+size_t scan_records(const std::set<K, C, A>& s, uint64_t key, unsigned len)
+{
+	size_t found = 0;
+	for (typename std::set<K, C, A>::const_iterator it = s.lower_bound(key); it != s.end() && found < len; ++it)
+		found++;
+	return found;
+}
+
+template <class Map>
+class map_target : public target
+{
+public:
+	void set_name(const std::string& name) override { m.set_name(name); }
+	void preload(uint64_t keys, uint64_t step) override
+	{
+		for (uint64_t k = 0; k < keys; k += step)
+			m.insert(std::make_pair(k, k));
+	}
+	size_t read(uint64_t key) override { return m.count(key); }
+	void write(uint64_t key) override { m[key] = key; }
+	void erase(uint64_t key) override { m.erase(key); }
+	void insert(uint64_t key) override { m.insert(std::make_pair(key, key)); }
+	size_t scan(uint64_t key, unsigned len) override
+	{
+		return m.with_lock([&](const typename Map::storage_type& raw) { return scan_records(raw, key, len); });
+	}
+	size_t read_modify_write(uint64_t key) override
+	{
+		return m.with_lock([&](typename Map::storage_type& raw) { return static_cast<size_t>(raw[key]++); });
+	}
+
+private:
+	Map m;
+};
+
+template <class Set>
+class set_target : public target
+{
+public:
+	void set_name(const std::string& name) override { s.set_name(name); }
+	void preload(uint64_t keys, uint64_t step) override
+	{
+		for (uint64_t k = 0; k < keys; k += step)
+			s.insert(k);
+	}
+	size_t read(uint64_t key) override { return s.count(key); }
+	void write(uint64_t key) override { s.insert(key); }
+	void erase(uint64_t key) override { s.erase(key); }
+	size_t scan(uint64_t key, unsigned len) override
+	{
+		return s.with_lock([&](const typename Set::storage_type& raw) { return scan_records(raw, key, len); });
+	}
+	size_t read_modify_write(uint64_t key) override
+	{
+		return s.with_lock([&](typename Set::storage_type& raw) { return raw.insert(key).second ? size_t(0) : size_t(1); });
+	}
+
+private:
+	Set s;
+};
+
+// vector, deque and list: push at the back, pop from the back
+template <class Sequence>
+class back_sequence_target : public target
+{
+public:
+	void set_name(const std::string& name) override { c.set_name(name); }
+	void preload(uint64_t keys, uint64_t step) override
+	{
+		for (uint64_t k = 0; k < keys; k += step)
+			c.push_back(k);
+	}
+	size_t read(uint64_t) override { return c.size(); }
+	size_t scan(uint64_t, unsigned) override { return c.size(); }
+	void write(uint64_t key) override { c.push_back(key); }
+	void erase(uint64_t) override
+	{
+		uint64_t v;
+		c.try_pop_back(v);
+	}
+
+private:
+	Sequence c;
+};
+
+// queue and stack: push / try_pop
+template <class Adaptor>
+class adaptor_target : public target
+{
+public:
+	void set_name(const std::string& name) override { c.set_name(name); }
+	void preload(uint64_t keys, uint64_t step) override
+	{
+		for (uint64_t k = 0; k < keys; k += step)
+			c.push(k);
+	}
+	size_t read(uint64_t) override { return c.size(); }
+	size_t scan(uint64_t, unsigned) override { return c.size(); }
+	void write(uint64_t key) override { c.push(key); }
+	void erase(uint64_t) override
+	{
+		uint64_t v;
+		c.try_pop(v);
+	}
+
+private:
+	Adaptor c;
+};
+
+struct target_factory
+{
+	std::string name;
+	bool keyed;                                   // key-value or key lookups, run by YCSB workloads
+	std::function<std::unique_ptr<target>()> make;
+};
+
+template <class Target>
+target_factory make_factory(const std::string& name, bool keyed)
+{
+	target_factory f;
+	f.name = name;
+	f.keyed = keyed;
+	f.make = [] { return std::unique_ptr<target>(new Target()); };
+	return f;
+}
+
+// Every container the suite knows, in report order
+inline std::vector<target_factory> all_targets()
+{
+	std::vector<target_factory> t;
+	t.push_back(make_factory<map_target<thread_safe::map<uint64_t, uint64_t>>>("map", true));
+	t.push_back(make_factory<map_target<thread_safe::unordered_map<uint64_t, uint64_t>>>("unordered_map", true));
+	t.push_back(make_factory<set_target<thread_safe::set<uint64_t>>>("set", true));
+	t.push_back(make_factory<set_target<thread_safe::unordered_set<uint64_t>>>("unordered_set", true));
+	t.push_back(make_factory<back_sequence_target<thread_safe::vector<uint64_t>>>("vector", false));
+	t.push_back(make_factory<back_sequence_target<thread_safe::deque<uint64_t>>>("deque", false));
+	t.push_back(make_factory<back_sequence_target<thread_safe::list<uint64_t>>>("list", false));
+	t.push_back(make_factory<adaptor_target<thread_safe::queue<uint64_t>>>("queue", false));
+	t.push_back(make_factory<adaptor_target<thread_safe::queue<uint64_t, thread_safe::chunk_deque<uint64_t>>>>("queue_chunk_deque", false));
+	t.push_back(make_factory<adaptor_target<thread_safe::stack<uint64_t>>>("stack", false));
+	t.push_back(make_factory<adaptor_target<thread_safe::priority_queue<uint64_t>>>("priority_queue", false));
+	t.push_back(make_factory<adaptor_target<thread_safe::combining_stack<uint64_t>>>("combining_stack", false));
+	t.push_back(make_factory<adaptor_target<thread_safe::combining_priority_queue<uint64_t>>>("combining_priority_queue", false));
+	return t;
+}
+
+}
+
+#endif // BENCH_TARGETS_H_INCLUDED
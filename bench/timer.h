@@ -0,0 +1,51 @@
+#ifndef BENCH_TIMER_H_INCLUDED
+#define BENCH_TIMER_H_INCLUDED
+
+#include <chrono>
+#include <cstdint>
+#include <thread>
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#define BENCH_HAVE_TSC 1
+#elif (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#include <x86intrin.h>
+#define BENCH_HAVE_TSC 1
+#endif
+
+namespace bench {
+
+// Per operation timestamps. On x86 this reads the time stamp counter, which
+// costs about half a steady_clock::now() call and is constant rate on every
+// CPU of the last decade; elsewhere it falls back to steady_clock.
+inline uint64_t read_ticks()
+{
+#ifdef BENCH_HAVE_TSC
+	return __rdtsc();
+#else
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+// Nanoseconds per tick, measured once against steady_clock
+inline double ns_per_tick()
+{
+#ifdef BENCH_HAVE_TSC
+	static const double ratio = []
+	{
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		uint64_t ticks = read_ticks();
+		std::this_thread::sleep_for(std::chrono::milliseconds(20));
+		uint64_t elapsed_ticks = read_ticks() - ticks;
+		double elapsed_ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+		return elapsed_ticks ? elapsed_ns / elapsed_ticks : 1.0;
+	}();
+	return ratio;
+#else
+	return 1.0;
+#endif
+}
+
+}
+
+#endif // BENCH_TIMER_H_INCLUDED
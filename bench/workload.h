@@ -0,0 +1,277 @@
+#ifndef BENCH_WORKLOAD_H_INCLUDED
+#define BENCH_WORKLOAD_H_INCLUDED
+
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#include "options.h"
+
+namespace bench {
+
+// Small fast per thread generator (xorshift64*), good enough to pick keys and ops
+class rng
+{
+public:
+	explicit rng(uint64_t seed) : state(seed * 0x9e3779b97f4a7c15ULL + 1) { }
+
+	uint64_t next()
+	{
+		state ^= state >> 12;
+		state ^= state << 25;
+		state ^= state >> 27;
+		return state * 0x2545f4914f6cdd1dULL;
+	}
+
+	// Uniform in [0, n), the modulo bias is negligible for benchmark sized n
+	uint64_t below(uint64_t n) { return next() % n; }
+
+	// Uniform in [0, 1)
+	double unit() { return (next() >> 11) * (1.0 / 9007199254740992.0); }
+
+private:
+	uint64_t state;
+};
+
+// YCSB operations: read, update an existing record, insert a new record,
+// scan a range, read-modify-write, and (outside YCSB) erase
+enum op_type { op_read, op_write, op_insert, op_scan, op_rmw, op_erase, op_type_count };
+
+inline const char* op_name(op_type op)
+{
+	switch (op)
+	{
+	case op_read: return "read";
+	case op_write: return "write";
+	case op_insert: return "insert";
+	case op_scan: return "scan";
+	case op_rmw: return "rmw";
+	default: return "erase";
+	}
+}
+
+// State shared by the threads of one run: keys [0, records) exist, inserts
+// claim the next key. Starts at the preloaded record count.
+struct key_space
+{
+	explicit key_space(uint64_t records) : records(records) { }
+	std::atomic<uint64_t> records;
+};
+
+// Picks keys for reads, updates, scans and erases; one instance per thread
+class key_generator
+{
+public:
+	virtual ~key_generator() { }
+	virtual uint64_t next(rng& r) = 0;
+};
+
+class uniform_keys : public key_generator
+{
+public:
+	explicit uniform_keys(uint64_t keys) : keys(keys) { }
+	uint64_t next(rng& r) override { return r.below(keys); }
+
+private:
+	uint64_t keys;
+};
+
+// Each thread walks the key space in order from its own offset
+class sequential_keys : public key_generator
+{
+public:
+	sequential_keys(uint64_t keys, uint64_t start) : keys(keys), current(start % keys) { }
+	uint64_t next(rng&) override
+	{
+		uint64_t k = current;
+		if (++current == keys)
+			current = 0;
+		return k;
+	}
+
+private:
+	uint64_t keys;
+	uint64_t current;
+};
+
+// Zipf distributed ranks in [1, n], P(k) proportional to 1 / k^theta.
+// Rejection-inversion sampling (Hormann and Derflinger 1996): constant
+// setup and expected sampling time for any n, so 100M keys cost nothing
+// up front, unlike the zeta sum of the classic YCSB generator.
+class zipf_ranks
+{
+public:
+	zipf_ranks(uint64_t n, double theta) : n(n), theta(theta)
+	{
+		h_integral_x1 = h_integral(1.5) - 1.0;
+		h_integral_n = h_integral(n + 0.5);
+		s = 2.0 - h_integral_inverse(h_integral(2.5) - h(2.0));
+	}
+
+	uint64_t next(rng& r) const
+	{
+		for (;;)
+		{
+			double u = h_integral_n + r.unit() * (h_integral_x1 - h_integral_n);
+			double x = h_integral_inverse(u);
+			double k = std::floor(x + 0.5);
+			if (k < 1)
+				k = 1;
+			else if (k > static_cast<double>(n))
+				k = static_cast<double>(n);
+			if (k - x <= s || u >= h_integral(k + 0.5) - h(k))
+				return static_cast<uint64_t>(k);
+		}
+	}
+
+private:
+	double h(double x) const { return std::exp(-theta * std::log(x)); }
+
+	double h_integral(double x) const
+	{
+		double log_x = std::log(x);
+		return helper2((1.0 - theta) * log_x) * log_x;
+	}
+
+	double h_integral_inverse(double x) const
+	{
+		double t = x * (1.0 - theta);
+		if (t < -1.0)
+			t = -1.0;
+		return std::exp(helper1(t) * x);
+	}
+
+	// log1p(x) / x and expm1(x) / x, continuous at 0 so theta = 1 needs no special case
+	static double helper1(double x) { return std::fabs(x) > 1e-8 ? std::log1p(x) / x : 1.0 - x * (0.5 - x * (1.0 / 3.0 - 0.25 * x)); }
+	static double helper2(double x) { return std::fabs(x) > 1e-8 ? std::expm1(x) / x : 1.0 + x * 0.5 * (1.0 + x * (1.0 / 3.0) * (1.0 + 0.25 * x)); }
+
+	uint64_t n;
+	double theta;
+	double h_integral_x1;
+	double h_integral_n;
+	double s;
+};
+
+// 64 bit FNV-1a over the bytes of v, as YCSB uses to scramble ranks
+inline uint64_t fnv_hash64(uint64_t v)
+{
+	uint64_t hash = 0xcbf29ce484222325ULL;
+	for (int i = 0; i < 8; i++)
+	{
+		hash ^= v & 0xff;
+		hash *= 0x100000001b3ULL;
+		v >>= 8;
+	}
+	return hash;
+}
+
+// YCSB "zipfian": popular ranks hashed over the key space, so the hot keys
+// are not neighbours in an ordered container
+class zipfian_keys : public key_generator
+{
+public:
+	zipfian_keys(uint64_t keys, double theta) : keys(keys), ranks(keys, theta) { }
+	uint64_t next(rng& r) override { return fnv_hash64(ranks.next(r) - 1) % keys; }
+
+private:
+	uint64_t keys;
+	zipf_ranks ranks;
+};
+
+// YCSB "latest": the most recently inserted keys are the most popular
+class latest_keys : public key_generator
+{
+public:
+	latest_keys(const key_space& space, uint64_t keys, double theta) : space(space), ranks(keys, theta) { }
+	uint64_t next(rng& r) override
+	{
+		uint64_t records = space.records.load(std::memory_order_relaxed);
+		uint64_t back = ranks.next(r) - 1;
+		return back < records ? records - 1 - back : 0;
+	}
+
+private:
+	const key_space& space;
+	zipf_ranks ranks;
+};
+
+// YCSB "hotspot": hot_ops of the operations go to the first hot_data of the keys
+class hotspot_keys : public key_generator
+{
+public:
+	hotspot_keys(uint64_t keys, double hot_data, double hot_ops) : keys(keys), hot_ops(hot_ops)
+	{
+		hot_keys = static_cast<uint64_t>(keys * hot_data);
+		if (hot_keys == 0)
+			hot_keys = 1;
+		if (hot_keys > keys)
+			hot_keys = keys;
+	}
+
+	uint64_t next(rng& r) override
+	{
+		if (r.unit() < hot_ops || hot_keys == keys)
+			return r.below(hot_keys);
+		return hot_keys + r.below(keys - hot_keys);
+	}
+
+private:
+	uint64_t keys;
+	uint64_t hot_keys;
+	double hot_ops;
+};
+
+inline bool known_distribution(const std::string& name)
+{
+	return name == "uniform" || name == "sequential" || name == "zipfian" || name == "latest" || name == "hotspot";
+}
+
+inline std::unique_ptr<key_generator> make_key_generator(const options& opt, const key_space& space, unsigned thread_index, unsigned threads)
+{
+	key_generator* g;
+	if (opt.distribution == "sequential")
+		g = new sequential_keys(opt.keys, opt.keys / threads * thread_index);
+	else if (opt.distribution == "zipfian")
+		g = new zipfian_keys(opt.keys, opt.theta);
+	else if (opt.distribution == "latest")
+		g = new latest_keys(space, opt.keys, opt.theta);
+	else if (opt.distribution == "hotspot")
+		g = new hotspot_keys(opt.keys, opt.hot_data, opt.hot_ops);
+	else
+		g = new uniform_keys(opt.keys);
+	return std::unique_ptr<key_generator>(g);
+}
+
+// Operation split of a run
+class op_mix
+{
+public:
+	explicit op_mix(const options& opt)
+	{
+		const unsigned pct[op_type_count] = { opt.read_pct, opt.write_pct, opt.insert_pct, opt.scan_pct, opt.rmw_pct, opt.erase_pct };
+		unsigned sum = 0;
+		for (int op = 0; op < op_type_count; op++)
+		{
+			sum += pct[op];
+			cuts[op] = sum;
+		}
+	}
+
+	op_type next(rng& r) const
+	{
+		unsigned p = static_cast<unsigned>(r.below(100));
+		int op = 0;
+		while (op < op_type_count - 1 && p >= cuts[op])
+			op++;
+		return static_cast<op_type>(op);
+	}
+
+private:
+	unsigned cuts[op_type_count];
+};
+
+}
+
+#endif // BENCH_WORKLOAD_H_INCLUDED
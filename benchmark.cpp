@@ -1,346 +1,134 @@
+#include <fstream>
 #include <iostream>
+#include <memory>
 #include <string>
-#include <chrono>
-#include <thread>
-#include <utility>
-
-// original stl header
 #include <vector>
-#include <list>
-#include <map>
-#include <unordered_map>
-#include <set>
-#include <unordered_set>
-#include <bitset>
-#include <queue>
-#include <deque>
-#include <stack>
-
-// thread safe stl header
-#include "thread_safe_vector.h"
-#include "thread_safe_list.h"
-#include "thread_safe_map.h"
-#include "thread_safe_unordered_map.h"
-#include "thread_safe_set.h"
-#include "thread_safe_unordered_set.h"
-#include "thread_safe_bitset.h"
-#include "thread_safe_queue.h"
-#include "thread_safe_deque.h"
-#include "thread_safe_stack.h"
 
-static inline uint64_t NowNanoTimestamp()
+#include "bench/baselines.h"
+#include "bench/lock_bench.h"
+#include "bench/options.h"
+#include "bench/perf_counters.h"
+#include "bench/report.h"
+#include "bench/runner.h"
+#include "bench/targets.h"
+#include "bench/workload.h"
+
+// Throughput of every thread safe container under a shared, contended
+// workload, swept over thread counts, next to externally locked, sharded and
+// concurrent baselines. Run with --help for the options.
+
+// By default YCSB workloads only run the keyed containers, and the lock
+// primitives only run with --locks, which runs nothing else
+static bool selected(const bench::options& opt, const bench::target_factory& t)
 {
-	auto now = std::chrono::system_clock::now(); // system_clock can get the current timestamp, (accuracy is 100 ns win, 1 ns in linux)
-	long long timestamp = std::chrono::duration_cast<std::chrono::nanoseconds>(now.time_since_epoch()).count();
-
-	return timestamp;
-}
-
-// benchmark setting
-const int kNum = 30000;
-const int kCap = 10000;
-const int kMultiThreadCount = 7;
-
-void perf_test()
-{
-	int64_t t1 = 0;
-	int64_t t2 = 0;
-
-	// vector
-	std::cout << "--- vector ---" << std::endl;
-	t1 = NowNanoTimestamp();
-	std::vector<int> vec;
-	vec.reserve(kCap);
-	for (int i = 0; i < kNum; i++)
-	{
-		vec.emplace_back(i);
-		vec.push_back(i * 10);
-		int x = vec[i];
-		vec.pop_back();
-	}
-	t2 = NowNanoTimestamp();
-	std::cout << "vector perf task cost time: " << t2 - t1 << " ns" << " , current thread: " << std::this_thread::get_id() << std::endl;
-
-	t1 = NowNanoTimestamp();
-	thread_safe::vector<int> tvec;
-	tvec.reserve(kCap);
-	for (int i = 0; i < kNum; i++)
-	{
-		tvec.emplace_back(i);
-		tvec.push_back(i * 10);
-		int x = tvec[i];
-		tvec.pop_back();
-	}
-	t2 = NowNanoTimestamp();
-	std::cout << "thread safe vector perf task cost time: " << t2 - t1 << " ns" << " , current thread: " << std::this_thread::get_id() << std::endl;
-
-	// list
-	std::cout << "--- list ---" << std::endl;
-	t1 = NowNanoTimestamp();
-	std::list<int> lt;
-	for (int i = 0; i < kNum; i++)
-	{
-		lt.emplace_back(i);
-		lt.emplace_front(i * 10);
-		lt.push_back(i);
-		lt.push_front(i * 10);
-		int x = lt.back();
-		int y = lt.front();
-		lt.pop_back();
-		lt.pop_front();
-	}
-	t2 = NowNanoTimestamp();
-	std::cout << "list perf task cost time: " << t2 - t1 << " ns" << " , current thread: " << std::this_thread::get_id() << std::endl;
-
-	t1 = NowNanoTimestamp();
-	thread_safe::list<int> tlt;
-	for (int i = 0; i < kNum; i++)
+	if (opt.containers.empty() && !opt.lock_cs.empty())
+		return bench::is_lock_target(t);
+	if (opt.containers.empty())
+		return !bench::is_lock_target(t) && (t.keyed || !opt.ycsb());
+	for (const std::string& c : opt.containers)
 	{
-		tlt.emplace_back(i);
-		tlt.emplace_front(i * 10);
-		tlt.push_back(i);
-		tlt.push_front(i * 10);
-		int x = tlt.back();
-		int y = tlt.front();
-		tlt.pop_back();
-		tlt.pop_front();
+		if (c == t.name)
+			return true;
 	}
-	t2 = NowNanoTimestamp();
-	std::cout << "thread safe list perf task cost time: " << t2 - t1 << " ns" << " , current thread: " << std::this_thread::get_id() << std::endl;
-
-	// map
-	std::cout << "--- map ---" << std::endl;
-	t1 = NowNanoTimestamp();
-	std::map<int, std::string> mp;
-	for (int i = 0; i < kNum; i++)
-	{
-		mp.insert(std::make_pair(i, "value"));
-		mp[i] = "new value";
-		mp[i * 10] = "fresh value";
-		bool flag = (mp.find(i) != mp.end());
-		std::string value = mp[i];
-		mp.erase(i);
-	}
-	t2 = NowNanoTimestamp();
-	std::cout << "map perf task cost time: " << t2 - t1 << " ns" << " , current thread: " << std::this_thread::get_id() << std::endl;
-
-	t1 = NowNanoTimestamp();
-	thread_safe::map<int, std::string> tmp;
-	for (int i = 0; i < kNum; i++)
-	{
-		tmp.insert(std::make_pair(i, "value"));
-		tmp[i] = "new value";
-		mp[i * 10] = "fresh value";
-		bool flag = (tmp.find(i) != tmp.end());
-		std::string value = tmp[i];
-		tmp.erase(i);
-	}
-	t2 = NowNanoTimestamp();
-	std::cout << "thread safe map perf task cost time: " << t2 - t1 << " ns" << " , current thread: " << std::this_thread::get_id() << std::endl;
-
-	// unordered_map
-	std::cout << "--- unordered_map ---" << std::endl;
-	t1 = NowNanoTimestamp();
-	std::unordered_map<int, std::string> ump;
-	ump.reserve(kCap);
-	ump.rehash(kCap);
-	for (int i = 0; i < kNum; i++)
-	{
-		ump.insert(std::make_pair(i, "value"));
-		ump[i] = "new value";
-		ump[i * 10] = "fresh value";
-		bool flag = (ump.find(i) != ump.end());
-		std::string value = ump[i];
-		ump.erase(i);
-	}
-	t2 = NowNanoTimestamp();
-	std::cout << "unordered_map perf task cost time: " << t2 - t1 << " ns" << " , current thread: " << std::this_thread::get_id() << std::endl;
-
-	t1 = NowNanoTimestamp();
-	thread_safe::unordered_map<int, std::string> tump;
-	tump.reserve(kCap);
-	tump.rehash(kCap);
-	for (int i = 0; i < kNum; i++)
-	{
-		tump.insert(std::make_pair(i, "value"));
-		tump[i] = "new value";
-		tump[i * 10] = "fresh value";
-		bool flag = (tump.find(i) != tump.end());
-		std::string value = tump[i];
-		tump.erase(i);
-	}
-	t2 = NowNanoTimestamp();
-	std::cout << "thread safe unordered_map perf task cost time: " << t2 - t1 << " ns" << " , current thread: " << std::this_thread::get_id() << std::endl;
-
-	// set
-	std::cout << "--- set ---" << std::endl;
-	t1 = NowNanoTimestamp();
-	std::set<int> st;
-	for (int i = 0; i < kNum; i++)
-	{
-		st.insert(i);
-		st.insert(i);
-		st.insert(i * 10);
-		int x = *st.begin();
-		bool flag = (st.find(i) != st.end());
-		st.erase(i);
-	}
-	t2 = NowNanoTimestamp();
-	std::cout << "set perf task cost time: " << t2 - t1 << " ns" << " , current thread: " << std::this_thread::get_id() << std::endl;
-
-	t1 = NowNanoTimestamp();
-	thread_safe::set<int> tst;
-	for (int i = 0; i < kNum; i++)
-	{
-		tst.insert(i);
-		tst.insert(i);
-		tst.insert(i * 10);
-		int x = *tst.begin();
-		bool flag = (tst.find(i) != tst.end());
-		tst.erase(i);
-	}
-	t2 = NowNanoTimestamp();
-	std::cout << "thread safe set perf task cost time: " << t2 - t1 << " ns" << " , current thread: " << std::this_thread::get_id() << std::endl;
-
-	// unordered_set
-	std::cout << "--- unordered_set ---" << std::endl;
-	t1 = NowNanoTimestamp();
-	std::unordered_set<int> ust;
-	ust.reserve(kCap);
-	ust.rehash(kCap);
-	for (int i = 0; i < kNum; i++)
-	{
-		ust.insert(i);
-		ust.insert(i);
-		ust.insert(i * 10);
-		int x = *ust.begin();
-		bool flag = (ust.find(i) != ust.end());
-		ust.erase(i);
-	}
-	t2 = NowNanoTimestamp();
-	std::cout << "unordered_set perf task cost time: " << t2 - t1 << " ns" << " , current thread: " << std::this_thread::get_id() << std::endl;
-
-	t1 = NowNanoTimestamp();
-	thread_safe::unordered_set<int> tust;
-	tust.reserve(kCap);
-	tust.rehash(kCap);
-	for (int i = 0; i < kNum; i++)
-	{
-		tust.insert(i);
-		tust.insert(i);
-		tust.insert(i * 10);
-		int x = *tust.begin();
-		bool flag = (tust.find(i) != tust.end());
-		tust.erase(i);
-	}
-	t2 = NowNanoTimestamp();
-	std::cout << "thread safe unordered_set perf task cost time: " << t2 - t1 << " ns" << " , current thread: " << std::this_thread::get_id() << std::endl;
-
-	// stack
-	std::cout << "--- stack ---" << std::endl;
-	t1 = NowNanoTimestamp();
-	std::stack<int> stk;
-	for (int i = 0; i < kNum; i++)
-	{
-		stk.push(i);
-		stk.push(i * 10);
-		int x = stk.top();
-		stk.pop();
-	}
-	t2 = NowNanoTimestamp();
-	std::cout << "stack perf task cost time: " << t2 - t1 << " ns" << " , current thread: " << std::this_thread::get_id() << std::endl;
-
-	t1 = NowNanoTimestamp();
-	thread_safe::stack<int> tstk;
-	for (int i = 0; i < kNum; i++)
-	{
-		tstk.push(i);
-		tstk.push(i * 10);
-		int x = tstk.top();
-		tstk.pop();
-	}
-	t2 = NowNanoTimestamp();
-	std::cout << "thread safe stack perf task cost time: " << t2 - t1 << " ns" << " , current thread: " << std::this_thread::get_id() << std::endl;
-
-	// deque
-	std::cout << "--- deque ---" << std::endl;
-	t1 = NowNanoTimestamp();
-	std::deque<int> dq;
-	for (int i = 0; i < kNum; i++)
-	{
-		dq.emplace_back(i);
-		dq.emplace_front(i * 10);
-		dq.push_back(i);
-		dq.push_front(i * 10);
-		int x = dq.back();
-		int y = dq.front();
-		dq.pop_back();
-		dq.pop_front();
-	}
-	t2 = NowNanoTimestamp();
-	std::cout << "deque perf task cost time: " << t2 - t1 << " ns" << " , current thread: " << std::this_thread::get_id() << std::endl;
-
-	thread_safe::deque<int> tdq;
-	for (int i = 0; i < kNum; i++)
-	{
-		tdq.emplace_back(i);
-		tdq.emplace_front(i * 10);
-		tdq.push_back(i);
-		tdq.push_front(i * 10);
-		int x = tdq.back();
-		int y = tdq.front();
-		tdq.pop_back();
-		tdq.pop_front();
-	}
-	t2 = NowNanoTimestamp();
-	std::cout << "thread safe deque perf task cost time: " << t2 - t1 << " ns" << " , current thread: " << std::this_thread::get_id() << std::endl;
-
-	// priority_queue
-	std::cout << "--- priority_queue ---" << std::endl;
-	t1 = NowNanoTimestamp();
-	std::priority_queue<int, std::vector<int>, std::less<int>> pq;
-	for (int i = 0; i < kNum; i++)
-	{
-		pq.push(i);
-		pq.push(i * 10);
-		int x = pq.top();
-		pq.pop();
-	}
-	t2 = NowNanoTimestamp();
-	std::cout << "priority_queue perf task cost time: " << t2 - t1 << " ns" << " , current thread: " << std::this_thread::get_id() << std::endl;
-
-	t1 = NowNanoTimestamp();
-	thread_safe::priority_queue<int, std::vector<int>, std::less<int>> tpq; // FIXME: the template args should use std
-	for (int i = 0; i < kNum; i++)
-	{
-		tpq.push(i);
-		tpq.push(i * 10);
-		int x = tpq.top();
-		tpq.pop();
-	}
-	t2 = NowNanoTimestamp();
-	std::cout << "thread safe priority_queue perf task cost time: " << t2 - t1 << " ns" << " , current thread: " << std::this_thread::get_id() << std::endl;
+	return false;
 }
 
-#define TEST_MULTI_THREAD
+static std::string workload_name(const bench::options& opt)
+{
+	if (opt.ycsb())
+		return "ycsb-" + opt.workload + "-" + opt.distribution;
+	return opt.distribution + "-" + std::to_string(opt.read_pct) + ":" + std::to_string(opt.write_pct) + ":" + std::to_string(opt.erase_pct);
+}
 
-int main()
+int main(int argc, char** argv)
 {
-#ifndef TEST_MULTI_THREAD
-	std::cout << "==== single thread operation ====" << std::endl;
-	perf_test();
-#else
-	std::cout << "==== multi thread operation ====" << std::endl;
-	std::thread thread_array[kMultiThreadCount];
-	for (auto& t : thread_array)
-	{
-		t = std::thread(perf_test);
-		t.detach();
+	bench::options opt;
+	std::string error;
+	if (!bench::parse_options(argc, argv, opt, error))
+	{
+		std::cerr << error << std::endl;
+		bench::print_usage(argv[0]);
+		return 1;
+	}
+	if (!bench::known_distribution(opt.distribution))
+	{
+		std::cerr << "unknown distribution " << opt.distribution << std::endl;
+		return 1;
+	}
+
+	std::vector<bench::target_factory> targets = bench::all_targets();
+	std::vector<bench::target_factory> baselines = bench::baseline_targets();
+	targets.insert(targets.end(), baselines.begin(), baselines.end());
+	std::vector<bench::target_factory> locks = bench::lock_targets(opt.lock_cs.empty() ? std::vector<unsigned>(1, 16) : opt.lock_cs);
+	targets.insert(targets.end(), locks.begin(), locks.end());
+	if (opt.list)
+	{
+		for (const bench::target_factory& t : targets)
+			std::cout << t.name << std::endl;
+		return 0;
+	}
+	for (const std::string& c : opt.containers)
+	{
+		bool known = false;
+		for (const bench::target_factory& t : targets)
+			known = known || t.name == c;
+		if (!known)
+		{
+			std::cerr << "unknown container " << c << " (see --list)" << std::endl;
+			return 1;
+		}
+	}
+
+	if (opt.perf)
+	{
+		// say once which events this machine can count
+		bench::thread_counters probe(true);
+		for (int c = 0; c < bench::counter_count; c++)
+		{
+			std::string error = probe.error(c);
+			if (!error.empty())
+				std::cerr << "perf: " << bench::counter_name(c) << " unavailable (" << error << ")" << std::endl;
+		}
+		if (probe.uses_rusage_fallback())
+			std::cerr << "perf: context_switches counted with getrusage" << std::endl;
+	}
+
+	std::vector<bench::run_result> results;
+	std::string workload = workload_name(opt);
+	for (const bench::target_factory& t : targets)
+	{
+		if (!selected(opt, t))
+			continue;
+		for (unsigned threads : opt.threads)
+		{
+			for (unsigned rep = 0; rep < opt.repeat; rep++)
+			{
+				// fresh container per run so earlier runs do not skew its size
+				std::unique_ptr<bench::target> target = t.make();
+				target->set_name(t.name);
+				target->preload(opt.keys, opt.ycsb() ? 1 : 2);
+				results.push_back(bench::run_workload(*target, t.name, workload, threads, opt));
+				std::cerr << t.name << " threads=" << threads << " ops/sec=" << static_cast<uint64_t>(results.back().ops_per_sec()) << std::endl;
+				// prints nothing unless built with THREAD_SAFE_STL_ENABLE_STATS
+				thread_safe::dump_lock_stats(std::cerr);
+			}
+		}
+	}
+
+	if (opt.output.empty())
+	{
+		bench::write_results(std::cout, opt.format, results);
+	}
+	else
+	{
+		std::ofstream out(opt.output.c_str());
+		if (!out)
+		{
+			std::cerr << "cannot open " << opt.output << std::endl;
+			return 1;
+		}
+		bench::write_results(out, opt.format, results);
 	}
 
-	getchar(); // wait here
-
-#endif // !TEST_MULTI_THREAD
-
 	return 0;
-}
\ No newline at end of file
+}
@@ -0,0 +1,241 @@
+/*
+Thread Safe Version STL in C++11
+Copyright(c) 2021
+Author: tashaxing
+*/
+#ifndef THREAD_SAFE_ASYNC_QUEUE_H_INCLUDED
+#define THREAD_SAFE_ASYNC_QUEUE_H_INCLUDED
+
+// Needs C++20 coroutines; in older language modes this header declares nothing
+#if defined(__has_include)
+#if ( __cplusplus >= 202002L || ( defined(_MSVC_LANG) && _MSVC_LANG >= 202002L ) ) && __has_include(<coroutine>)
+#define THREAD_SAFE_STL_HAS_COROUTINES 1
+#endif
+#endif
+
+#ifdef THREAD_SAFE_STL_HAS_COROUTINES
+
+#include <coroutine>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <optional>
+#include <string>
+#include <utility>
+
+#include "thread_safe_cache_line.h"
+#include "thread_safe_lock_stats.h"
+
+namespace thread_safe {
+
+// Bounded FIFO for coroutines. co_await q.pop() suspends while the queue is
+// empty and co_await q.push( x ) while it is full, without blocking the
+// thread; a suspended coroutine is resumed on the executor given to the
+// constructor (anything with submit( std::function<void()> ), such as
+// thread_pool) once its operation completed. Thousands of waiting consumers
+// then cost a coroutine frame each instead of a thread.
+//
+//     thread_safe::async_queue<request> q( thread_safe::thread_pool::instance(), 1024 );
+//     while ( std::optional<request> r = co_await q.pop() ) handle( *r );
+//
+// Values are handed over directly between a pusher and a waiting popper.
+// Capacity 0 makes every push wait for a popper (a rendezvous channel).
+// Waiters are served in FIFO order. After close() pushes fail with false,
+// pops drain what is left and then return an empty optional. try_push and
+// try_pop never suspend, for callers outside coroutines. A coroutine must not
+// be destroyed while it waits on the queue. The queue keeps a reference to
+// the executor, which must outlive it.
+template <class T>
+class async_queue : public detail::cache_aligned {
+    struct waiter {
+        std::coroutine_handle<> handle;
+        waiter * next = nullptr;
+    };
+
+public:
+    class pop_awaiter : private waiter {
+    public:
+        bool await_ready( void ) const noexcept { return false; }
+        bool await_suspend( std::coroutine_handle<> h ) { this->handle = h; return queue.suspend_pop( *this ); }
+        std::optional<T> await_resume( void ) { return std::move( value ); }
+
+    private:
+        friend class async_queue;
+        explicit pop_awaiter( async_queue & q ) : queue( q ) { }
+
+        async_queue & queue;
+        std::optional<T> value;
+    };
+
+    class push_awaiter : private waiter {
+    public:
+        bool await_ready( void ) const noexcept { return false; }
+        bool await_suspend( std::coroutine_handle<> h ) { this->handle = h; return queue.suspend_push( *this ); }
+        bool await_resume( void ) const noexcept { return accepted; }
+
+    private:
+        friend class async_queue;
+        push_awaiter( async_queue & q, T && v ) : queue( q ), value( std::move( v ) ) { }
+
+        async_queue & queue;
+        T value;
+        bool accepted = false;
+    };
+
+    template <class Executor>
+    async_queue( Executor & executor, size_t capacity )
+        : resume_on( [&executor]( std::coroutine_handle<> h ) { executor.submit( [h]() { h.resume(); } ); } ), capacity( capacity ), closed( false ) { }
+
+    async_queue( const async_queue & ) = delete;
+    async_queue & operator=( const async_queue & ) = delete;
+
+    [[nodiscard]] pop_awaiter pop( void ) { return pop_awaiter( *this ); }
+    [[nodiscard]] push_awaiter push( T value ) { return push_awaiter( *this, std::move( value ) ); }
+
+    bool try_pop( T & value ) {
+        std::optional<T> taken;
+        waiter * ready = nullptr;
+        {
+            detail::container_guard lock( mutex, "try_pop" );
+            if ( !take( taken, ready ) ) return false;
+        }
+        resume( ready );
+        value = std::move( *taken );
+        return true;
+    }
+
+    // Fails when the queue is full or closed
+    bool try_push( T value ) {
+        waiter * ready = nullptr;
+        {
+            detail::container_guard lock( mutex, "try_push" );
+            if ( closed || !give( value, ready ) ) return false;
+        }
+        resume( ready );
+        return true;
+    }
+
+    // Wakes every waiter: pushers fail, poppers get what is left, then nothing
+    void close( void ) {
+        waiter * woken = nullptr;
+        {
+            detail::container_guard lock( mutex, "close" );
+            closed = true;
+            woken = pushers.take_all();
+            waiter * p = poppers.take_all();
+            if ( woken ) woken_tail( woken )->next = p;
+            else woken = p;
+        }
+        while ( woken ) {
+            waiter * next = woken->next;
+            resume_on( woken->handle );
+            woken = next;
+        }
+    }
+
+    bool is_closed( void ) const { detail::container_guard lock( mutex, "is_closed" ); return closed; }
+    size_t size( void ) const { detail::container_guard lock( mutex, "size" ); return items.size(); }
+    bool empty( void ) const { detail::container_guard lock( mutex, "empty" ); return items.empty(); }
+
+    // Lock statistics, empty unless built with THREAD_SAFE_STL_ENABLE_STATS
+    lock_stats stats( void ) const { return detail::stats_of( mutex ); }
+    void set_name( const std::string & name ) { detail::set_name_of( mutex, name ); }
+
+private:
+    // Intrusive FIFO of suspended awaiters, which live in their coroutine frames
+    struct waiter_list {
+        waiter * head = nullptr;
+        waiter * tail = nullptr;
+
+        bool empty( void ) const { return head == nullptr; }
+        void push( waiter * w ) { w->next = nullptr; if ( tail ) tail->next = w; else head = w; tail = w; }
+        waiter * pop( void ) { waiter * w = head; head = w->next; if ( !head ) tail = nullptr; w->next = nullptr; return w; }
+        waiter * take_all( void ) { waiter * w = head; head = tail = nullptr; return w; }
+    };
+
+    static waiter * woken_tail( waiter * w ) { while ( w->next ) w = w->next; return w; }
+
+    // The helpers below are called with the mutex held. A waiter they
+    // complete comes back in ready and is resumed after the lock is released.
+
+    // Next value for a popper: the oldest item, refilled from the first
+    // waiting pusher, or straight from that pusher when nothing is buffered
+    bool take( std::optional<T> & value, waiter *& ready ) {
+        if ( !items.empty() ) {
+            value.emplace( std::move( items.front() ) );
+            items.pop_front();
+            if ( !pushers.empty() ) {
+                push_awaiter * p = static_cast<push_awaiter *>( pushers.pop() );
+                items.push_back( std::move( p->value ) );
+                p->accepted = true;
+                ready = p;
+            }
+            return true;
+        }
+        if ( pushers.empty() ) return false;
+        push_awaiter * p = static_cast<push_awaiter *>( pushers.pop() );
+        value.emplace( std::move( p->value ) );
+        p->accepted = true;
+        ready = p;
+        return true;
+    }
+
+    // Hand value to the first waiting popper, or buffer it if there is room
+    bool give( T & value, waiter *& ready ) {
+        if ( !poppers.empty() ) {
+            pop_awaiter * p = static_cast<pop_awaiter *>( poppers.pop() );
+            p->value.emplace( std::move( value ) );
+            ready = p;
+            return true;
+        }
+        if ( items.size() >= capacity ) return false;
+        items.push_back( std::move( value ) );
+        return true;
+    }
+
+    // Returns true to stay suspended; false resumes the caller at once
+    bool suspend_pop( pop_awaiter & a ) {
+        waiter * ready = nullptr;
+        {
+            detail::container_guard lock( mutex, "pop" );
+            if ( !take( a.value, ready ) ) {
+                if ( closed ) return false;
+                poppers.push( &a );
+                return true;
+            }
+        }
+        resume( ready );
+        return false;
+    }
+
+    bool suspend_push( push_awaiter & a ) {
+        waiter * ready = nullptr;
+        {
+            detail::container_guard lock( mutex, "push" );
+            if ( closed ) return false;
+            if ( !give( a.value, ready ) ) {
+                pushers.push( &a );
+                return true;
+            }
+            a.accepted = true;
+        }
+        resume( ready );
+        return false;
+    }
+
+    void resume( waiter * w ) { if ( w ) resume_on( w->handle ); }
+
+    std::function<void( std::coroutine_handle<> )> resume_on;
+    alignas( hardware_destructive_interference_size ) std::deque<T> items;
+    const size_t capacity;
+    bool closed;
+    waiter_list poppers;
+    waiter_list pushers;
+    alignas( hardware_destructive_interference_size ) mutable detail::container_mutex mutex;
+};
+
+}
+
+#endif // THREAD_SAFE_STL_HAS_COROUTINES
+
+#endif // THREAD_SAFE_ASYNC_QUEUE_H_INCLUDED
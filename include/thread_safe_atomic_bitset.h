@@ -0,0 +1,216 @@
+/*
+Thread Safe Version STL in C++11
+Copyright(c) 2021
+Author: tashaxing
+*/
+#ifndef THREAD_SAFE_ATOMIC_BITSET_H_INCLUDED
+#define THREAD_SAFE_ATOMIC_BITSET_H_INCLUDED
+
+#include <atomic>
+#include <bitset>
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+
+#include "thread_safe_bit_util.h"
+
+namespace thread_safe {
+
+// Bitset stored as atomic 64-bit words. Single bit and single word operations
+// are lock-free; whole-set operations (set(), reset(), count(), ...) visit the
+// words one at a time and are not atomic as a whole.
+//
+// A second level of summary words, one bit per word marking it full, lets
+// acquire_free_slot() skip full words, so the bitset doubles as a lock-free
+// slot allocator. The summary is only a hint: bits set through set() may leave
+// a full word unmarked, clearing bits always unmarks it.
+template <size_t N>
+class atomic_bitset {
+public:
+    static const size_t kWordBits = 64;
+    static const size_t kWords = N ? ( N + kWordBits - 1 ) / kWordBits : 1;
+    static const size_t kSummaryWords = ( kWords + kWordBits - 1 ) / kWordBits;
+
+    // Constructors
+    atomic_bitset( void ) { reset(); }
+    atomic_bitset( unsigned long long val ) {
+        reset();
+        words[0].store( static_cast<uint64_t>( val ) & word_mask( 0 ), std::memory_order_relaxed );
+        rebuild_summary();
+    }
+
+    // Bit access
+    bool operator[]( size_t pos ) const { return ( words[pos / kWordBits].load( std::memory_order_acquire ) >> ( pos % kWordBits ) ) & 1; }
+
+    bool test( size_t pos ) const { check( pos, "atomic_bitset::test" ); return ( *this )[pos]; }
+
+    // Bit operations
+    thread_safe::atomic_bitset<N> & set( size_t pos, bool val = true ) { if ( val ) test_and_set( pos ); else test_and_reset( pos ); return *this; }
+    thread_safe::atomic_bitset<N> & reset( size_t pos ) { test_and_reset( pos ); return *this; }
+    thread_safe::atomic_bitset<N> & flip( size_t pos ) {
+        check( pos, "atomic_bitset::flip" );
+        // flipping a set bit clears it, which must unmark its word
+        if ( words[pos / kWordBits].fetch_xor( bit( pos ), std::memory_order_acq_rel ) & bit( pos ) ) unmark_full( pos / kWordBits );
+        return *this;
+    }
+
+    // Set / clear the bit and return its previous value
+    bool test_and_set( size_t pos ) {
+        check( pos, "atomic_bitset::test_and_set" );
+        std::atomic<uint64_t> & word = words[pos / kWordBits];
+        // a plain load first avoids dirtying the cache line when the bit is already set
+        if ( word.load( std::memory_order_relaxed ) & bit( pos ) ) return true;
+        return ( word.fetch_or( bit( pos ), std::memory_order_acq_rel ) & bit( pos ) ) != 0;
+    }
+
+    bool test_and_reset( size_t pos ) {
+        check( pos, "atomic_bitset::test_and_reset" );
+        std::atomic<uint64_t> & word = words[pos / kWordBits];
+        if ( !( word.load( std::memory_order_relaxed ) & bit( pos ) ) ) return false;
+        bool previous = ( word.fetch_and( ~bit( pos ), std::memory_order_acq_rel ) & bit( pos ) ) != 0;
+        unmark_full( pos / kWordBits );
+        return previous;
+    }
+
+    thread_safe::atomic_bitset<N> & set( void ) { for ( size_t i = 0; i < kWords; ++i ) words[i].store( word_mask( i ), std::memory_order_release ); rebuild_summary(); return *this; }
+    thread_safe::atomic_bitset<N> & reset( void ) { for ( size_t i = 0; i < kWords; ++i ) words[i].store( 0, std::memory_order_release ); rebuild_summary(); return *this; }
+    thread_safe::atomic_bitset<N> & flip( void ) { for ( size_t i = 0; i < kWords; ++i ) words[i].fetch_xor( word_mask( i ), std::memory_order_acq_rel ); rebuild_summary(); return *this; }
+
+    // Word operations, bits past N are masked off; each returns the previous word
+    uint64_t load_word( size_t index, std::memory_order order = std::memory_order_acquire ) const { return words[index].load( order ); }
+    uint64_t fetch_or_word( size_t index, uint64_t mask, std::memory_order order = std::memory_order_acq_rel ) { return words[index].fetch_or( mask & word_mask( index ), order ); }
+    uint64_t fetch_and_word( size_t index, uint64_t mask, std::memory_order order = std::memory_order_acq_rel ) { uint64_t previous = words[index].fetch_and( mask | ~word_mask( index ), order ); unmark_full( index ); return previous; }
+    uint64_t fetch_xor_word( size_t index, uint64_t mask, std::memory_order order = std::memory_order_acq_rel ) { uint64_t previous = words[index].fetch_xor( mask & word_mask( index ), order ); unmark_full( index ); return previous; }
+
+    // Set bit iteration, returns size() when there is no further set bit.
+    // Each word is read atomically, the walk as a whole is not a snapshot.
+    size_t find_first( void ) const { return scan( 0 ); }
+    size_t find_next( size_t pos ) const { return pos + 1 >= N ? N : scan( pos + 1 ); }
+
+    template <class Function> void for_each_set_bit( Function fn ) const {
+        for ( size_t i = 0; i < kWords; ++i )
+            for ( uint64_t w = words[i].load( std::memory_order_acquire ); w; w &= w - 1 ) fn( i * kWordBits + detail::ctz64( w ) );
+    }
+
+    // Slot allocation
+    // Claim a clear bit and return its index, or size() when every bit is set.
+    size_t acquire_free_slot( void ) {
+        size_t start = hint.load( std::memory_order_relaxed ) / kWordBits;
+        for ( size_t s = 0; s < kSummaryWords; ++s ) {
+            size_t si = ( start + s ) % kSummaryWords;
+            uint64_t candidates = ~full[si].load( std::memory_order_acquire ) & summary_mask( si );
+            for ( ; candidates; candidates &= candidates - 1 ) {
+                size_t wi = si * kWordBits + detail::ctz64( candidates );
+                uint64_t w = words[wi].load( std::memory_order_relaxed );
+                for ( ;; ) {
+                    uint64_t clear = ~w & word_mask( wi );
+                    if ( !clear ) { mark_full( wi ); break; }
+                    uint64_t claimed = w | ( clear & ( ~clear + 1 ) );
+                    if ( words[wi].compare_exchange_weak( w, claimed, std::memory_order_acq_rel, std::memory_order_relaxed ) ) {
+                        if ( claimed == word_mask( wi ) ) mark_full( wi );
+                        if ( hint.load( std::memory_order_relaxed ) != wi ) hint.store( wi, std::memory_order_relaxed );
+                        return wi * kWordBits + detail::ctz64( clear );
+                    }
+                }
+            }
+        }
+        return N;
+    }
+
+    void release_slot( size_t pos ) { reset( pos ); }
+
+    // Bitset operations, relaxed snapshots
+    size_t count( void ) const {
+        size_t n = 0;
+        for ( size_t i = 0; i < kWords; ++i ) n += detail::popcount64( words[i].load( std::memory_order_relaxed ) );
+        return n;
+    }
+
+    size_t size( void ) const { return N; }
+
+    size_t word_count( void ) const { return kWords; }
+
+    bool any( void ) const {
+        for ( size_t i = 0; i < kWords; ++i ) if ( words[i].load( std::memory_order_relaxed ) ) return true;
+        return false;
+    }
+
+    bool none( void ) const { return !any(); }
+
+    bool all( void ) const {
+        for ( size_t i = 0; i < kWords; ++i ) if ( words[i].load( std::memory_order_relaxed ) != word_mask( i ) ) return false;
+        return true;
+    }
+
+    std::bitset<N> to_bitset( void ) const {
+        std::bitset<N> result;
+        for ( size_t i = 0; i < kWords; ++i ) {
+            uint64_t w = words[i].load( std::memory_order_acquire );
+            while ( w ) {
+                size_t b = detail::ctz64( w );
+                result.set( i * kWordBits + b );
+                w &= w - 1;
+            }
+        }
+        return result;
+    }
+
+    // Copying would not be atomic
+    atomic_bitset( const thread_safe::atomic_bitset<N> & ) = delete;
+    thread_safe::atomic_bitset<N> & operator=( const thread_safe::atomic_bitset<N> & ) = delete;
+
+private:
+    static uint64_t bit( size_t pos ) { return uint64_t( 1 ) << ( pos % kWordBits ); }
+
+    // valid bits of a word, only the last one can be partial
+    static uint64_t word_mask( size_t index ) {
+        if ( index + 1 < kWords || N % kWordBits == 0 ) return N ? ~uint64_t( 0 ) : 0;
+        return ( uint64_t( 1 ) << ( N % kWordBits ) ) - 1;
+    }
+
+    static void check( size_t pos, const char * what ) { if ( pos >= N ) throw std::out_of_range( what ); }
+
+    // valid bits of a summary word
+    static uint64_t summary_mask( size_t index ) {
+        if ( index + 1 < kSummaryWords || kWords % kWordBits == 0 ) return ~uint64_t( 0 );
+        return ( uint64_t( 1 ) << ( kWords % kWordBits ) ) - 1;
+    }
+
+    size_t scan( size_t from ) const {
+        size_t i = from / kWordBits;
+        uint64_t w = words[i].load( std::memory_order_acquire ) & ( ~uint64_t( 0 ) << ( from % kWordBits ) );
+        for ( ;; ) {
+            if ( w ) return i * kWordBits + detail::ctz64( w );
+            if ( ++i == kWords ) return N;
+            w = words[i].load( std::memory_order_acquire );
+        }
+    }
+
+    // Mark then re-check, while clearing unmarks after the bit is gone. The
+    // fences order the two sides so a word never stays marked with a clear bit.
+    void mark_full( size_t index ) {
+        full[index / kWordBits].fetch_or( bit( index ), std::memory_order_relaxed );
+        std::atomic_thread_fence( std::memory_order_seq_cst );
+        if ( words[index].load( std::memory_order_relaxed ) != word_mask( index ) ) unmark_full( index );
+    }
+
+    void unmark_full( size_t index ) {
+        std::atomic_thread_fence( std::memory_order_seq_cst );
+        std::atomic<uint64_t> & summary = full[index / kWordBits];
+        if ( summary.load( std::memory_order_relaxed ) & bit( index ) ) summary.fetch_and( ~bit( index ), std::memory_order_relaxed );
+    }
+
+    void rebuild_summary( void ) {
+        for ( size_t i = 0; i < kSummaryWords; ++i ) full[i].store( 0, std::memory_order_relaxed );
+        for ( size_t i = 0; i < kWords; ++i ) if ( words[i].load( std::memory_order_relaxed ) == word_mask( i ) ) full[i / kWordBits].fetch_or( bit( i ), std::memory_order_relaxed );
+        hint.store( 0, std::memory_order_relaxed );
+    }
+
+    std::atomic<uint64_t> words[kWords];
+    std::atomic<uint64_t> full[kSummaryWords];
+    std::atomic<size_t> hint;
+};
+
+}
+
+#endif // THREAD_SAFE_ATOMIC_BITSET_H_INCLUDED
@@ -0,0 +1,52 @@
+/*
+Thread Safe Version STL in C++11
+Copyright(c) 2021
+Author: tashaxing
+*/
+#ifndef THREAD_SAFE_BIT_UTIL_H_INCLUDED
+#define THREAD_SAFE_BIT_UTIL_H_INCLUDED
+
+#include <cstddef>
+#include <cstdint>
+
+namespace thread_safe {
+
+namespace detail {
+
+inline size_t popcount64( uint64_t x ) {
+#if defined(__GNUC__) || defined(__clang__)
+    return static_cast<size_t>( __builtin_popcountll( x ) );
+#else
+    x = x - ( ( x >> 1 ) & 0x5555555555555555ULL );
+    x = ( x & 0x3333333333333333ULL ) + ( ( x >> 2 ) & 0x3333333333333333ULL );
+    x = ( x + ( x >> 4 ) ) & 0x0f0f0f0f0f0f0f0fULL;
+    return static_cast<size_t>( ( x * 0x0101010101010101ULL ) >> 56 );
+#endif
+}
+
+// Index of the lowest set bit, x must not be zero
+inline size_t ctz64( uint64_t x ) {
+#if defined(__GNUC__) || defined(__clang__)
+    return static_cast<size_t>( __builtin_ctzll( x ) );
+#else
+    size_t n = 0;
+    while ( !( x & 1 ) ) { x >>= 1; ++n; }
+    return n;
+#endif
+}
+
+// Finalizer from MurmurHash3, spreads weak hashes (std::hash<int> is the identity)
+inline uint64_t mix64( uint64_t h ) {
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return h;
+}
+
+}
+
+}
+
+#endif // THREAD_SAFE_BIT_UTIL_H_INCLUDED
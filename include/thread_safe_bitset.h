@@ -8,12 +8,21 @@ Author: tashaxing
 #define THREAD_SAFE_BITSET_H_INCLUDED
 
 #include <bitset>
+#include <cstdint>
+#include <cstring>
 #include <mutex>
+#include <stdexcept>
+#include <string>
+
+#include "thread_safe_lock_stats.h"
+#include "thread_safe_simd.h"
 
 namespace thread_safe {
 
+// The bits live in a plain 64-bit word array (bits past N always zero) instead
+// of a std::bitset, so the bulk operations can run the SIMD kernels directly.
 template <size_t N>
-class bitset {
+class bitset : public detail::cache_aligned {
     template <size_t U> friend thread_safe::bitset<U> operator& (const thread_safe::bitset<U>& lhs, const thread_safe::bitset<U>& rhs);
     template <size_t U> friend thread_safe::bitset<U> operator| (const thread_safe::bitset<U>& lhs, const thread_safe::bitset<U>& rhs);
     template <size_t U> friend thread_safe::bitset<U> operator^ (const thread_safe::bitset<U>& lhs, const thread_safe::bitset<U>& rhs);
@@ -21,95 +30,187 @@ class bitset {
     template <class charT, class traits, size_t U> friend std::basic_istream<charT, traits> & operator>> ( std::basic_istream<charT,traits>& is, thread_safe::bitset<U>& rhs);
     template <class charT, class traits, size_t U> friend std::basic_ostream<charT, traits> & operator<< ( std::basic_ostream<charT,traits>& os, const thread_safe::bitset<U>& rhs);
 public:
+    static const size_t kWordBits = 64;
+    static const size_t kWords = N ? ( N + kWordBits - 1 ) / kWordBits : 1;
+
     // Constructors
-    bitset( void ) { }
-    bitset( unsigned long val ) : storage( val ) { }
+    bitset( void ) { std::memset( storage, 0, sizeof( storage ) ); }
+    bitset( unsigned long val ) { assign( std::bitset<N>( val ) ); }
     template< class charT, class traits, class Allocator>
     explicit bitset( const std::basic_string<charT, traits,Allocator>& str,
             typename std::basic_string<charT,traits,Allocator>::size_type pos = 0,
-            typename std::basic_string<charT,traits,Allocator>::size_type n = std::basic_string<charT,traits,Allocator>::npos ) : storage( str, pos, n ) { }
+            typename std::basic_string<charT,traits,Allocator>::size_type n = std::basic_string<charT,traits,Allocator>::npos ) { assign( std::bitset<N>( str, pos, n ) ); }
+    bitset( const thread_safe::bitset<N> & x ) { detail::container_guard lock( x.mutex, "copy" ); std::memcpy( storage, x.storage, sizeof( storage ) ); }
+
+    // Copy
+    thread_safe::bitset<N> & operator=( const thread_safe::bitset<N> & x ) { if ( this == &x ) return *this; detail::container_pair_guard lock( mutex, x.mutex, "operator=" ); std::memcpy( storage, x.storage, sizeof( storage ) ); return *this; }
 
     // Bit Access
-    bool operator[]( size_t pos ) const { std::lock_guard<std::mutex> lock( mutex ); return storage[pos]; }
-    bool & operator[]( size_t pos ) { std::lock_guard<std::mutex> lock( mutex ); return storage[pos]; }
+    // Returns a copy, a reference into the storage would outlive the lock
+    bool operator[]( size_t pos ) const { detail::container_guard lock( mutex, "operator[]" ); return get( pos ); }
 
     // Bitset operators
-    thread_safe::bitset<N> & operator&=( const thread_safe::bitset<N> & rhs ) { std::lock_guard<std::mutex> lock( mutex ); std::lock_guard<std::mutex> lock2( rhs.mutex ); storage &= rhs.storage; return *this; }
-    thread_safe::bitset<N> & operator|=( const thread_safe::bitset<N> & rhs ) { std::lock_guard<std::mutex> lock( mutex ); std::lock_guard<std::mutex> lock2( rhs.mutex ); storage |= rhs.storage; return *this; }
-    thread_safe::bitset<N> & operator^=( const thread_safe::bitset<N> & rhs ) { std::lock_guard<std::mutex> lock( mutex ); std::lock_guard<std::mutex> lock2( rhs.mutex ); storage ^= rhs.storage; return *this; }
-    thread_safe::bitset<N> & operator<<=( const thread_safe::bitset<N> & rhs ) { std::lock_guard<std::mutex> lock( mutex ); std::lock_guard<std::mutex> lock2( rhs.mutex ); storage <<= rhs.storage; return *this; }
-    thread_safe::bitset<N> & operator>>=( const thread_safe::bitset<N> & rhs ) { std::lock_guard<std::mutex> lock( mutex ); std::lock_guard<std::mutex> lock2( rhs.mutex ); storage >>= rhs.storage; return *this; }
-    thread_safe::bitset<N> operator~( void ) const { std::lock_guard<std::mutex> lock( mutex ); bitset<N> temp( *this ); temp.storage = ~temp.storage; return temp; }
-    thread_safe::bitset<N> operator<<( size_t pos ) const { std::lock_guard<std::mutex> lock( mutex ); bitset<N> temp( *this ); temp.storage << pos; return temp; }
-    thread_safe::bitset<N> operator>>( size_t pos ) const { std::lock_guard<std::mutex> lock( mutex ); bitset<N> temp( *this ); temp.storage >> pos; return temp; }
-    bool operator==( const thread_safe::bitset<N>& rhs ) const { std::lock_guard<std::mutex> lock( mutex ); std::lock_guard<std::mutex> lock2( rhs.mutex ); return storage == rhs.storage; }
-    bool operator!=( const thread_safe::bitset<N>& rhs ) const { std::lock_guard<std::mutex> lock( mutex ); std::lock_guard<std::mutex> lock2( rhs.mutex ); return storage != rhs.storage; }
+    thread_safe::bitset<N> & operator&=( const thread_safe::bitset<N> & rhs ) { detail::container_pair_guard lock( mutex, rhs.mutex, "operator&=" ); simd::and_words( storage, rhs.storage, kWords ); return *this; }
+    thread_safe::bitset<N> & operator|=( const thread_safe::bitset<N> & rhs ) { detail::container_pair_guard lock( mutex, rhs.mutex, "operator|=" ); simd::or_words( storage, rhs.storage, kWords ); return *this; }
+    thread_safe::bitset<N> & operator^=( const thread_safe::bitset<N> & rhs ) { detail::container_pair_guard lock( mutex, rhs.mutex, "operator^=" ); simd::xor_words( storage, rhs.storage, kWords ); return *this; }
+    thread_safe::bitset<N> & operator<<=( size_t pos ) { detail::container_guard lock( mutex, "operator<<=" ); shift_left( storage, pos ); return *this; }
+    thread_safe::bitset<N> & operator>>=( size_t pos ) { detail::container_guard lock( mutex, "operator>>=" ); shift_right( storage, pos ); return *this; }
+    thread_safe::bitset<N> operator~( void ) const { bitset<N> temp; detail::container_guard lock( mutex, "operator~" ); for ( size_t i = 0; i < kWords; ++i ) temp.storage[i] = ~storage[i] & word_mask( i ); return temp; }
+    thread_safe::bitset<N> operator<<( size_t pos ) const { bitset<N> temp; detail::container_guard lock( mutex, "operator<<" ); std::memcpy( temp.storage, storage, sizeof( storage ) ); shift_left( temp.storage, pos ); return temp; }
+    thread_safe::bitset<N> operator>>( size_t pos ) const { bitset<N> temp; detail::container_guard lock( mutex, "operator>>" ); std::memcpy( temp.storage, storage, sizeof( storage ) ); shift_right( temp.storage, pos ); return temp; }
+    bool operator==( const thread_safe::bitset<N>& rhs ) const { if ( this == &rhs ) return true; detail::container_pair_guard lock( mutex, rhs.mutex, "operator==" ); return std::memcmp( storage, rhs.storage, sizeof( storage ) ) == 0; }
+    bool operator!=( const thread_safe::bitset<N>& rhs ) const { return !( *this == rhs ); }
+
+    // Fused operations, no temporary bitset is materialized
+    thread_safe::bitset<N> & and_not( const thread_safe::bitset<N> & rhs ) { detail::container_pair_guard lock( mutex, rhs.mutex, "and_not" ); simd::andnot_words( storage, rhs.storage, kWords ); return *this; }
+    size_t and_count( const thread_safe::bitset<N> & rhs ) const { if ( this == &rhs ) return count(); detail::container_pair_guard lock( mutex, rhs.mutex, "and_count" ); return simd::and_popcount_words( storage, rhs.storage, kWords ); }
+    bool intersects( const thread_safe::bitset<N> & rhs ) const { if ( this == &rhs ) return any(); detail::container_pair_guard lock( mutex, rhs.mutex, "intersects" ); return simd::and_any_words( storage, rhs.storage, kWords ); }
 
     // Bit operations
-    thread_safe::bitset<N> & set( void ) { std::lock_guard<std::mutex> lock( mutex ); return storage.set(); }
-    thread_safe::bitset<N> & set( size_t pos, bool val = true ) { std::lock_guard<std::mutex> lock( mutex ); return storage.set( pos, true ); }
+    thread_safe::bitset<N> & set( void ) { detail::container_guard lock( mutex, "set" ); for ( size_t i = 0; i < kWords; ++i ) storage[i] = word_mask( i ); return *this; }
+    thread_safe::bitset<N> & set( size_t pos, bool val = true ) { check( pos, "bitset::set" ); detail::container_guard lock( mutex, "set" ); if ( val ) storage[pos / kWordBits] |= bit( pos ); else storage[pos / kWordBits] &= ~bit( pos ); return *this; }
+
+    thread_safe::bitset<N> & reset( void ) { detail::container_guard lock( mutex, "reset" ); std::memset( storage, 0, sizeof( storage ) ); return *this; }
+    thread_safe::bitset<N> & reset( size_t pos ) { check( pos, "bitset::reset" ); detail::container_guard lock( mutex, "reset" ); storage[pos / kWordBits] &= ~bit( pos ); return *this; }
 
-    thread_safe::bitset<N> & flip( void ) { std::lock_guard<std::mutex> lock( mutex ); return storage.flip(); }
-    thread_safe::bitset<N> & flip( size_t pos ) { std::lock_guard<std::mutex> lock( mutex ); return storage.flip( pos ); }
+    thread_safe::bitset<N> & flip( void ) { detail::container_guard lock( mutex, "flip" ); for ( size_t i = 0; i < kWords; ++i ) storage[i] = ~storage[i] & word_mask( i ); return *this; }
+    thread_safe::bitset<N> & flip( size_t pos ) { check( pos, "bitset::flip" ); detail::container_guard lock( mutex, "flip" ); storage[pos / kWordBits] ^= bit( pos ); return *this; }
 
     // Bitset operations
-    unsigned long to_ulong( void ) const { std::lock_guard<std::mutex> lock( mutex ); return storage.to_ulong(); }
+    unsigned long to_ulong( void ) const { return to_bitset().to_ulong(); }
 
     template < class charT, class traits, class Allocator>
-        std::basic_string<charT, traits, Allocator> to_string( void ) const { std::lock_guard<std::mutex> lock( mutex ); return storage.to_string(); }
+        std::basic_string<charT, traits, Allocator> to_string( void ) const { return to_bitset().template to_string<charT, traits, Allocator>(); }
+
+    std::bitset<N> to_bitset( void ) const { detail::container_guard lock( mutex, "to_bitset" ); return snapshot(); }
+
+    size_t count( void ) const { detail::container_guard lock( mutex, "count" ); return simd::popcount_words( storage, kWords ); }
+
+    size_t size( void ) const { return N; }
+
+    bool test( size_t pos ) const { check( pos, "bitset::test" ); detail::container_guard lock( mutex, "test" ); return get( pos ); }
 
-    size_t count( void ) const { std::lock_guard<std::mutex> lock( mutex ); return storage.count(); }
+    bool any( void ) const { detail::container_guard lock( mutex, "any" ); return simd::any_words( storage, kWords ); }
 
-    size_t size( void ) const { std::lock_guard<std::mutex> lock( mutex ); return storage.size(); }
+    bool none( void ) const { return !any(); }
 
-    bool test( size_t pos ) const { std::lock_guard<std::mutex> lock( mutex ); return storage.test( pos ); }
+    // Set bit iteration, returns size() when there is no further set bit
+    size_t find_first( void ) const { detail::container_guard lock( mutex, "find_first" ); return scan( 0 ); }
+    size_t find_next( size_t pos ) const { detail::container_guard lock( mutex, "find_next" ); return pos + 1 >= N ? N : scan( pos + 1 ); }
 
-    bool any( void ) const { std::lock_guard<std::mutex> lock( mutex ); return storage.any(); }
+    // Calls fn( pos ) for every set bit in one critical section, fn must not use this bitset
+    template <class Function> void for_each_set_bit( Function fn ) const {
+        detail::container_guard lock( mutex, "for_each_set_bit" );
+        for ( size_t i = 0; i < kWords; ++i )
+            for ( uint64_t w = storage[i]; w; w &= w - 1 ) fn( i * kWordBits + detail::ctz64( w ) );
+    }
 
-    bool none( void ) const { std::lock_guard<std::mutex> lock( mutex ); return storage.none(); }
+    // Lock statistics, empty unless built with THREAD_SAFE_STL_ENABLE_STATS
+    lock_stats stats( void ) const { return detail::stats_of( mutex ); }
+    void set_name( const std::string & name ) { detail::set_name_of( mutex, name ); }
 
 private:
-    std::bitset<N> storage;
-    mutable std::mutex mutex;
+    static uint64_t bit( size_t pos ) { return uint64_t( 1 ) << ( pos % kWordBits ); }
+
+    // valid bits of a word, only the last one can be partial
+    static uint64_t word_mask( size_t index ) {
+        if ( index + 1 < kWords || N % kWordBits == 0 ) return N ? ~uint64_t( 0 ) : 0;
+        return ( uint64_t( 1 ) << ( N % kWordBits ) ) - 1;
+    }
+
+    static void check( size_t pos, const char * what ) { if ( pos >= N ) throw std::out_of_range( what ); }
+
+    static void shift_left( uint64_t * words, size_t pos ) {
+        if ( pos >= N ) { std::memset( words, 0, kWords * sizeof( uint64_t ) ); return; }
+        size_t word_shift = pos / kWordBits, bit_shift = pos % kWordBits;
+        for ( size_t i = kWords; i-- > 0; ) {
+            uint64_t w = i >= word_shift ? words[i - word_shift] << bit_shift : 0;
+            if ( bit_shift && i > word_shift ) w |= words[i - word_shift - 1] >> ( kWordBits - bit_shift );
+            words[i] = w;
+        }
+        words[kWords - 1] &= word_mask( kWords - 1 );
+    }
+
+    static void shift_right( uint64_t * words, size_t pos ) {
+        if ( pos >= N ) { std::memset( words, 0, kWords * sizeof( uint64_t ) ); return; }
+        size_t word_shift = pos / kWordBits, bit_shift = pos % kWordBits;
+        for ( size_t i = 0; i < kWords; ++i ) {
+            uint64_t w = i + word_shift < kWords ? words[i + word_shift] >> bit_shift : 0;
+            if ( bit_shift && i + word_shift + 1 < kWords ) w |= words[i + word_shift + 1] << ( kWordBits - bit_shift );
+            words[i] = w;
+        }
+    }
+
+    // first set bit at or after from, called with the mutex held
+    size_t scan( size_t from ) const {
+        size_t i = from / kWordBits;
+        uint64_t w = storage[i] & ( ~uint64_t( 0 ) << ( from % kWordBits ) );
+        for ( ;; ) {
+            if ( w ) return i * kWordBits + detail::ctz64( w );
+            if ( ++i == kWords ) return N;
+            w = storage[i];
+        }
+    }
+
+    bool get( size_t pos ) const { return ( storage[pos / kWordBits] & bit( pos ) ) != 0; }
+
+    // called with the mutex held (or before the object is shared)
+    std::bitset<N> snapshot( void ) const {
+        std::bitset<N> result;
+        for ( size_t i = 0; i < kWords; ++i )
+            for ( uint64_t w = storage[i]; w; w &= w - 1 ) result.set( i * kWordBits + detail::ctz64( w ) );
+        return result;
+    }
+
+    void assign( const std::bitset<N> & x ) {
+        std::memset( storage, 0, sizeof( storage ) );
+        for ( size_t i = 0; i < N; ++i ) if ( x[i] ) storage[i / kWordBits] |= bit( i );
+    }
+
+    alignas( hardware_destructive_interference_size ) uint64_t storage[kWords];
+    alignas( hardware_destructive_interference_size ) mutable detail::container_mutex mutex;
 };
 
+// Both operands are read under their locks at once, so the result is one snapshot of the pair
 template<size_t N>
 thread_safe::bitset<N> operator& (const thread_safe::bitset<N>& lhs, const thread_safe::bitset<N>& rhs) {
-    std::lock_guard<std::mutex> lock( lhs.mutex );
-    std::lock_guard<std::mutex> lock2( rhs.mutex );
     bitset<N> temp;
-    temp.storage = lhs.storage & rhs.storage;
+    detail::container_pair_guard lock( lhs.mutex, rhs.mutex, "operator&" );
+    std::memcpy( temp.storage, lhs.storage, sizeof( temp.storage ) );
+    simd::and_words( temp.storage, rhs.storage, bitset<N>::kWords );
     return temp;
 }
 
 template<size_t N>
 thread_safe::bitset<N> operator| (const thread_safe::bitset<N>& lhs, const thread_safe::bitset<N>& rhs) {
-    std::lock_guard<std::mutex> lock( lhs.mutex );
-    std::lock_guard<std::mutex> lock2( rhs.mutex );
     bitset<N> temp;
-    temp.storage = lhs.storage | rhs.storage;
+    detail::container_pair_guard lock( lhs.mutex, rhs.mutex, "operator|" );
+    std::memcpy( temp.storage, lhs.storage, sizeof( temp.storage ) );
+    simd::or_words( temp.storage, rhs.storage, bitset<N>::kWords );
     return temp;
 }
 
 template<size_t N>
 thread_safe::bitset<N> operator^ (const thread_safe::bitset<N>& lhs, const thread_safe::bitset<N>& rhs) {
-    std::lock_guard<std::mutex> lock( lhs.mutex );
-    std::lock_guard<std::mutex> lock2( rhs.mutex );
     bitset<N> temp;
-    temp.storage = lhs.storage ^ rhs.storage;
+    detail::container_pair_guard lock( lhs.mutex, rhs.mutex, "operator^" );
+    std::memcpy( temp.storage, lhs.storage, sizeof( temp.storage ) );
+    simd::xor_words( temp.storage, rhs.storage, bitset<N>::kWords );
     return temp;
 }
 
 template <class charT, class traits, size_t N>
 std::basic_istream<charT, traits> & operator>> ( std::basic_istream<charT,traits>& is, thread_safe::bitset<N>& rhs) {
-    std::lock_guard<std::mutex> lock2( rhs.mutex );
-    return is >> rhs.storage;
+    std::bitset<N> temp;
+    is >> temp;
+    detail::container_guard lock( rhs.mutex, "operator>>" );
+    if ( is ) rhs.assign( temp );
+    return is;
 }
 
 template <class charT, class traits, size_t N>
 std::basic_ostream<charT, traits> & operator<< ( std::basic_ostream<charT,traits>& os, const thread_safe::bitset<N>& rhs) {
-    std::lock_guard<std::mutex> lock2( rhs.mutex );
-    return os << rhs.storage;
+    return os << rhs.to_bitset();
 }
 
 }
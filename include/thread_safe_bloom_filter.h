@@ -0,0 +1,176 @@
+/*
+Thread Safe Version STL in C++11
+Copyright(c) 2021
+Author: tashaxing
+*/
+#ifndef THREAD_SAFE_BLOOM_FILTER_H_INCLUDED
+#define THREAD_SAFE_BLOOM_FILTER_H_INCLUDED
+
+#include <atomic>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <thread>
+#include <vector>
+
+#include "thread_safe_bit_util.h"
+#include "thread_safe_cache_line.h"
+
+namespace thread_safe {
+
+struct bloom_filter_stats {
+    size_t bits;            // filter size in bits
+    size_t hashes;          // bits probed per key
+    size_t inserted;        // keys added since the last clear
+    size_t negatives;       // lookups answered "definitely absent" without the lock
+    size_t positives;       // lookups passed on to the container
+    size_t false_positives; // positives the container did not hold
+    double fill_ratio;      // fraction of bits set
+    double estimated_fpr;   // probability that an absent key passes the filter
+};
+
+namespace detail {
+
+// Relaxed counter spread over several cache lines, so lock-free readers
+// bumping it do not all fight over one line.
+class striped_counter {
+public:
+    striped_counter( void ) { reset(); }
+
+    void add( void ) { stripes[ stripe_index() ]->fetch_add( 1, std::memory_order_relaxed ); }
+
+    size_t load( void ) const {
+        size_t sum = 0;
+        for ( size_t i = 0; i < kStripes; ++i ) sum += stripes[i]->load( std::memory_order_relaxed );
+        return sum;
+    }
+
+    void reset( void ) { for ( size_t i = 0; i < kStripes; ++i ) stripes[i]->store( 0, std::memory_order_relaxed ); }
+
+private:
+    static const size_t kStripes = 16;
+
+    static size_t stripe_index( void ) {
+        static thread_local size_t index = std::hash<std::thread::id>()( std::this_thread::get_id() ) % kStripes;
+        return index;
+    }
+
+    cache_padded< std::atomic<size_t> > stripes[kStripes];
+};
+
+}
+
+// Cache-blocked Bloom filter over precomputed hash values. Every key maps to a
+// single 64 byte block, so a lookup touches one cache line. Lookups and
+// insertions are lock-free; bits are never cleared except by clear().
+class bloom_filter : public detail::cache_aligned {
+public:
+    bloom_filter( size_t expected_keys, double false_positive_rate ) : inserted( 0 ), false_positives( 0 ) {
+        if ( expected_keys == 0 ) expected_keys = 1;
+        if ( false_positive_rate < 1e-6 ) false_positive_rate = 1e-6;
+        if ( false_positive_rate > 0.5 ) false_positive_rate = 0.5;
+
+        const double ln2 = 0.6931471805599453;
+        // blocking costs some accuracy, buy it back with ~10% more bits
+        double bits = -1.1 * static_cast<double>( expected_keys ) * std::log( false_positive_rate ) / ( ln2 * ln2 );
+        block_count = static_cast<size_t>( std::ceil( bits / kBlockBits ) );
+        if ( block_count == 0 ) block_count = 1;
+
+        double bits_per_key = static_cast<double>( block_count * kBlockBits ) / static_cast<double>( expected_keys );
+        hash_count = static_cast<size_t>( bits_per_key * ln2 + 0.5 );
+        if ( hash_count < 1 ) hash_count = 1;
+        if ( hash_count > 16 ) hash_count = 16;
+
+        // over-allocate by one block and start at a cache line boundary
+        storage = std::vector< std::atomic<uint64_t> >( block_count * kBlockWords + kBlockWords );
+        uintptr_t address = reinterpret_cast<uintptr_t>( storage.data() );
+        offset = ( ( 64 - address % 64 ) % 64 ) / sizeof( uint64_t );
+        clear();
+    }
+
+    void add_hash( size_t hash ) {
+        uint64_t masks[kBlockWords];
+        std::atomic<uint64_t> * block = probe( hash, masks );
+        for ( size_t i = 0; i < kBlockWords; ++i ) {
+            // skip the write when the bits are already there, keeping the line shared
+            if ( masks[i] && ( block[i].load( std::memory_order_relaxed ) & masks[i] ) != masks[i] )
+                block[i].fetch_or( masks[i], std::memory_order_release );
+        }
+        inserted.fetch_add( 1, std::memory_order_relaxed );
+    }
+
+    bool may_contain_hash( size_t hash ) const {
+        uint64_t masks[kBlockWords];
+        const std::atomic<uint64_t> * block = probe( hash, masks );
+        for ( size_t i = 0; i < kBlockWords; ++i ) {
+            if ( ( block[i].load( std::memory_order_acquire ) & masks[i] ) != masks[i] ) {
+                negatives.add();
+                return false;
+            }
+        }
+        positives.add();
+        return true;
+    }
+
+    // Called by the owner when a key passed the filter but was not found
+    void record_false_positive( void ) { false_positives.fetch_add( 1, std::memory_order_relaxed ); }
+
+    // Not atomic with respect to concurrent add_hash(), the owner serializes the two
+    void clear( void ) {
+        for ( size_t i = 0; i < storage.size(); ++i ) storage[i].store( 0, std::memory_order_relaxed );
+        inserted.store( 0, std::memory_order_relaxed );
+        false_positives.store( 0, std::memory_order_relaxed );
+        negatives.reset();
+        positives.reset();
+    }
+
+    bloom_filter_stats stats( void ) const {
+        bloom_filter_stats s;
+        s.bits = block_count * kBlockBits;
+        s.hashes = hash_count;
+        s.inserted = inserted.load( std::memory_order_relaxed );
+        s.negatives = negatives.load();
+        s.positives = positives.load();
+        s.false_positives = false_positives.load( std::memory_order_relaxed );
+
+        size_t set_bits = 0;
+        for ( size_t i = 0; i < block_count * kBlockWords; ++i )
+            set_bits += detail::popcount64( storage[offset + i].load( std::memory_order_relaxed ) );
+        s.fill_ratio = static_cast<double>( set_bits ) / static_cast<double>( s.bits );
+        s.estimated_fpr = std::pow( s.fill_ratio, static_cast<double>( hash_count ) );
+        return s;
+    }
+
+private:
+    static const size_t kBlockWords = 8;
+    static const size_t kBlockBits = kBlockWords * 64;
+
+    // Pick the block from the high half of the mixed hash and derive the probed
+    // bits from the low half by double hashing.
+    std::atomic<uint64_t> * probe( size_t hash, uint64_t * masks ) const {
+        uint64_t h = detail::mix64( static_cast<uint64_t>( hash ) );
+        size_t block = static_cast<size_t>( ( ( h >> 32 ) * static_cast<uint64_t>( block_count ) ) >> 32 );
+        uint32_t h1 = static_cast<uint32_t>( h );
+        uint32_t h2 = static_cast<uint32_t>( detail::mix64( h ) ) | 1;
+        for ( size_t i = 0; i < kBlockWords; ++i ) masks[i] = 0;
+        for ( size_t i = 0; i < hash_count; ++i ) {
+            uint32_t bit = ( h1 + static_cast<uint32_t>( i ) * h2 ) % kBlockBits;
+            masks[bit / 64] |= uint64_t( 1 ) << ( bit % 64 );
+        }
+        return const_cast<std::atomic<uint64_t> *>( &storage[offset + block * kBlockWords] );
+    }
+
+    std::vector< std::atomic<uint64_t> > storage;
+    size_t offset;
+    size_t block_count;
+    size_t hash_count;
+    std::atomic<size_t> inserted;
+    std::atomic<size_t> false_positives;
+    mutable detail::striped_counter negatives;
+    mutable detail::striped_counter positives;
+};
+
+}
+
+#endif // THREAD_SAFE_BLOOM_FILTER_H_INCLUDED
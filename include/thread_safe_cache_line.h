@@ -0,0 +1,96 @@
+/*
+Thread Safe Version STL in C++11
+Copyright(c) 2021
+Author: tashaxing
+*/
+#ifndef THREAD_SAFE_CACHE_LINE_H_INCLUDED
+#define THREAD_SAFE_CACHE_LINE_H_INCLUDED
+
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <utility>
+
+// Data written by different threads must not share a cache line, or every
+// write invalidates the line for all the others (false sharing). Locks,
+// per-thread and per-shard state and every container's lock and storage are
+// laid out on lines of their own with the constant below.
+//
+// C++17's std::hardware_destructive_interference_size is not available in
+// C++11 and GCC warns that its value may change between compiler versions,
+// so the library keeps its own. Define THREAD_SAFE_STL_CACHE_LINE_SIZE to
+// override it, e.g. to 16 to drop the padding where memory matters more than
+// contention. Before C++17 the global operator new ignores over-alignment, so
+// the aligned classes derive from detail::cache_aligned, which aligns new and
+// new[] itself. std::allocator still ignores it before C++17: elements of a
+// std::vector of containers may start mid-line, but stay a line apart.
+
+#ifndef THREAD_SAFE_STL_CACHE_LINE_SIZE
+#if defined(__powerpc64__) || defined(__s390x__) || ( defined(__aarch64__) && defined(__APPLE__) )
+#define THREAD_SAFE_STL_CACHE_LINE_SIZE 128
+#else
+#define THREAD_SAFE_STL_CACHE_LINE_SIZE 64
+#endif
+#endif
+
+namespace thread_safe {
+
+const size_t hardware_destructive_interference_size = THREAD_SAFE_STL_CACHE_LINE_SIZE;
+
+namespace detail {
+
+// Class operator new and delete that return cache line aligned memory. The
+// line before each block holds the pointer the global operator new returned.
+// The class overloads hide the global ones, so the nothrow forms are here too.
+struct cache_aligned {
+    static void * operator new( size_t size ) { return allocate( size ); }
+    static void * operator new[]( size_t size ) { return allocate( size ); }
+    static void * operator new( size_t size, const std::nothrow_t & ) noexcept { return allocate( size, std::nothrow ); }
+    static void * operator new[]( size_t size, const std::nothrow_t & ) noexcept { return allocate( size, std::nothrow ); }
+    static void * operator new( size_t, void * p ) { return p; }
+    static void * operator new[]( size_t, void * p ) { return p; }
+    static void operator delete( void * p ) { release( p ); }
+    static void operator delete[]( void * p ) { release( p ); }
+    static void operator delete( void * p, const std::nothrow_t & ) noexcept { release( p ); }
+    static void operator delete[]( void * p, const std::nothrow_t & ) noexcept { release( p ); }
+    static void operator delete( void *, void * ) { }
+    static void operator delete[]( void *, void * ) { }
+
+private:
+    static void * allocate( size_t size ) { return align( ::operator new( size + hardware_destructive_interference_size ) ); }
+    static void * allocate( size_t size, const std::nothrow_t & ) noexcept {
+        void * raw = ::operator new( size + hardware_destructive_interference_size, std::nothrow );
+        return raw ? align( raw ) : nullptr;
+    }
+
+    static void * align( void * raw ) {
+        const uintptr_t line = hardware_destructive_interference_size;
+        uintptr_t aligned = ( reinterpret_cast<uintptr_t>( raw ) + line ) & ~( line - 1 );
+        reinterpret_cast<void **>( aligned )[-1] = raw;
+        return reinterpret_cast<void *>( aligned );
+    }
+
+    static void release( void * p ) { if ( p ) ::operator delete( static_cast<void **>( p )[-1] ); }
+};
+
+}
+
+// A value alone on its cache line(s), for arrays of per-thread or per-shard
+// state that different threads write
+template <class T>
+struct alignas( hardware_destructive_interference_size ) cache_padded : detail::cache_aligned {
+    cache_padded( void ) : value() { }
+    template <class... Args>
+    explicit cache_padded( Args &&... args ) : value( std::forward<Args>( args )... ) { }
+
+    T & operator*( void ) { return value; }
+    const T & operator*( void ) const { return value; }
+    T * operator->( void ) { return &value; }
+    const T * operator->( void ) const { return &value; }
+
+    T value;
+};
+
+}
+
+#endif // THREAD_SAFE_CACHE_LINE_H_INCLUDED
@@ -0,0 +1,239 @@
+/*
+Thread Safe Version STL in C++11
+Copyright(c) 2021
+Author: tashaxing
+*/
+#ifndef THREAD_SAFE_CHUNK_DEQUE_H_INCLUDED
+#define THREAD_SAFE_CHUNK_DEQUE_H_INCLUDED
+
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+namespace thread_safe {
+
+// Unsynchronized double ended sequence that recycles its storage, meant as
+// the Container of thread_safe::queue< T, chunk_deque<T> >. Elements live in a linked chain of
+// fixed size chunks; a chunk emptied by a pop goes to a cache instead of the
+// heap and is reused by the next push that needs one, so a queue whose length
+// stays within the cached capacity does no allocation at all. The cache is
+// bounded by cache_limit() bytes and can be trimmed with shrink_to().
+template <class T>
+class chunk_deque {
+public:
+    typedef T value_type;
+    typedef size_t size_type;
+    typedef T & reference;
+    typedef const T & const_reference;
+
+    static const size_t kChunkBytes = 512;
+    static const size_t kChunkSize = sizeof( T ) * 8 > kChunkBytes ? 8 : kChunkBytes / sizeof( T );
+    static const size_t kDefaultCacheLimit = 64 * 1024;
+
+    // Constructors
+    chunk_deque( void ) { init(); }
+    chunk_deque( const thread_safe::chunk_deque<T> & x ) { init(); limit = x.limit; x.for_each( [this]( const T & u ) { push_back( u ); } ); }
+    chunk_deque( thread_safe::chunk_deque<T> && x ) { init(); swap( x ); }
+
+    // Copy
+    thread_safe::chunk_deque<T> & operator=( const thread_safe::chunk_deque<T> & x ) {
+        if ( this != &x ) {
+            clear();
+            x.for_each( [this]( const T & u ) { push_back( u ); } );
+        }
+        return *this;
+    }
+    thread_safe::chunk_deque<T> & operator=( thread_safe::chunk_deque<T> && x ) { if ( this != &x ) { clear(); swap( x ); } return *this; }
+
+    // Destructor
+    ~chunk_deque( void ) {
+        clear();
+        delete head;
+        shrink_to( 0 );
+    }
+
+    // Capacity
+    size_type size( void ) const { return count; }
+    bool empty( void ) const { return count == 0; }
+
+    // Element access
+    T & front( void ) { return *head->at( first ); }
+    const T & front( void ) const { return *head->at( first ); }
+
+    T & back( void ) { return *tail->at( last - 1 ); }
+    const T & back( void ) const { return *tail->at( last - 1 ); }
+
+    // Modifiers
+    void push_back( const T & u ) { emplace_back( u ); }
+    void push_back( T && u ) { emplace_back( std::move( u ) ); }
+
+    void push_front( const T & u ) { emplace_front( u ); }
+    void push_front( T && u ) { emplace_front( std::move( u ) ); }
+
+    template <class... Args> void emplace_back( Args&&... args ) {
+        if ( last == kChunkSize ) {
+            chunk * c = take_chunk();
+            try {
+                ::new ( static_cast<void *>( c->at( 0 ) ) ) T( std::forward<Args>( args )... );
+            } catch ( ... ) {
+                give_chunk( c );
+                throw;
+            }
+            c->prev = tail;
+            tail->next = c;
+            tail = c;
+            last = 0;
+        } else {
+            ::new ( static_cast<void *>( tail->at( last ) ) ) T( std::forward<Args>( args )... );
+        }
+        ++last;
+        ++count;
+    }
+
+    template <class... Args> void emplace_front( Args&&... args ) {
+        if ( count == 0 ) {
+            // empty means first == last == 0; start at the end of the chunk
+            // instead, so back() and pop_back() find the element in tail
+            ::new ( static_cast<void *>( head->at( kChunkSize - 1 ) ) ) T( std::forward<Args>( args )... );
+            first = kChunkSize - 1;
+            last = kChunkSize;
+            ++count;
+            return;
+        }
+        if ( first == 0 ) {
+            chunk * c = take_chunk();
+            try {
+                ::new ( static_cast<void *>( c->at( kChunkSize - 1 ) ) ) T( std::forward<Args>( args )... );
+            } catch ( ... ) {
+                give_chunk( c );
+                throw;
+            }
+            c->next = head;
+            head->prev = c;
+            head = c;
+            first = kChunkSize;
+        } else {
+            ::new ( static_cast<void *>( head->at( first - 1 ) ) ) T( std::forward<Args>( args )... );
+        }
+        --first;
+        ++count;
+    }
+
+    void pop_front( void ) {
+        head->at( first++ )->~T();
+        --count;
+        if ( first == kChunkSize && head != tail ) {
+            chunk * c = head;
+            head = c->next;
+            head->prev = nullptr;
+            first = 0;
+            give_chunk( c );
+        }
+        if ( count == 0 ) rewind();
+    }
+
+    void pop_back( void ) {
+        tail->at( --last )->~T();
+        --count;
+        if ( last == 0 && head != tail ) {
+            chunk * c = tail;
+            tail = c->prev;
+            tail->next = nullptr;
+            last = kChunkSize;
+            give_chunk( c );
+        }
+        if ( count == 0 ) rewind();
+    }
+
+    void clear( void ) { while ( count ) pop_back(); }
+
+    void swap( thread_safe::chunk_deque<T> & x ) {
+        std::swap( head, x.head );
+        std::swap( tail, x.tail );
+        std::swap( first, x.first );
+        std::swap( last, x.last );
+        std::swap( count, x.count );
+        std::swap( cache, x.cache );
+        std::swap( cached, x.cached );
+        std::swap( limit, x.limit );
+    }
+
+    // Chunk cache
+    size_type cached_bytes( void ) const { return cached * sizeof( chunk ); }
+    size_type cache_limit( void ) const { return limit; }
+    void set_cache_limit( size_type bytes ) { limit = bytes; shrink_to( bytes ); }
+
+    // Free cached chunks until at most bytes remain cached
+    void shrink_to( size_type bytes ) {
+        while ( cache && cached_bytes() > bytes ) {
+            chunk * c = cache;
+            cache = c->next;
+            delete c;
+            --cached;
+        }
+    }
+
+    // Visit elements front to back
+    template <class Function> void for_each( Function fn ) const {
+        const chunk * c = head;
+        size_t i = first;
+        for ( size_type n = count; n; --n ) {
+            if ( i == kChunkSize ) { c = c->next; i = 0; }
+            fn( *c->at( i++ ) );
+        }
+    }
+
+private:
+    struct chunk {
+        chunk( void ) : prev( nullptr ), next( nullptr ) { }
+        T * at( size_t i ) { return reinterpret_cast<T *>( &slots[i] ); }
+        const T * at( size_t i ) const { return reinterpret_cast<const T *>( &slots[i] ); }
+
+        chunk * prev;
+        chunk * next;
+        typename std::aligned_storage<sizeof( T ), std::alignment_of<T>::value>::type slots[kChunkSize];
+    };
+
+    void init( void ) {
+        head = tail = new chunk();
+        first = last = 0;
+        count = 0;
+        cache = nullptr;
+        cached = 0;
+        limit = kDefaultCacheLimit;
+    }
+
+    // Empty again: start over at the front of the one remaining chunk, so a
+    // queue that keeps draining to empty never leaves its first chunk
+    void rewind( void ) { first = last = 0; }
+
+    chunk * take_chunk( void ) {
+        if ( !cache ) return new chunk();
+        chunk * c = cache;
+        cache = c->next;
+        --cached;
+        c->prev = c->next = nullptr;
+        return c;
+    }
+
+    void give_chunk( chunk * c ) {
+        if ( ( cached + 1 ) * sizeof( chunk ) > limit ) { delete c; return; }
+        c->next = cache;
+        cache = c;
+        ++cached;
+    }
+
+    chunk * head;
+    chunk * tail;
+    size_t first; // index of the front element in head
+    size_t last; // one past the back element in tail
+    size_type count;
+    chunk * cache;
+    size_t cached;
+    size_type limit;
+};
+
+}
+
+#endif // THREAD_SAFE_CHUNK_DEQUE_H_INCLUDED
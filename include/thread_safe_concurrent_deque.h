@@ -0,0 +1,240 @@
+/*
+Thread Safe Version STL in C++11
+Copyright(c) 2021
+Author: tashaxing
+*/
+#ifndef THREAD_SAFE_CONCURRENT_DEQUE_H_INCLUDED
+#define THREAD_SAFE_CONCURRENT_DEQUE_H_INCLUDED
+
+#include <atomic>
+#include <cstddef>
+#include <mutex>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "thread_safe_cache_line.h"
+
+namespace thread_safe {
+
+// Deque with separately locked ends for double ended producers / consumers.
+//
+// Elements live in a doubly linked chain of fixed size blocks. push_front and
+// pop_front take only the front lock, push_back and pop_back only the back
+// lock. A pop first reserves an element by decrementing the published count,
+// which it may only do while the count is above kSlowThreshold; the two ends
+// are then at least that far apart and cannot touch the same element or
+// block. Below the threshold a pop takes both locks, front then back, and
+// runs alone. Emptied blocks are kept in a small spare pool for reuse.
+//
+// There is no iteration or random access.
+template <class T>
+class concurrent_deque : public detail::cache_aligned {
+public:
+    typedef T value_type;
+    typedef size_t size_type;
+
+    static const size_t kBlockBytes = 512;
+    static const size_t kBlockSize = sizeof( T ) * 8 > kBlockBytes ? 8 : kBlockBytes / sizeof( T );
+    static const size_t kSlowThreshold = 4 * kBlockSize;
+    static const size_t kMaxSpareBlocks = 8;
+
+    // Constructors
+    concurrent_deque( void ) : count( 0 ) {
+        block * b = new block();
+        front.blk = back.blk = b;
+        front.index = back.index = kBlockSize / 2;
+    }
+
+    concurrent_deque( const thread_safe::concurrent_deque<T> & ) = delete;
+    thread_safe::concurrent_deque<T> & operator=( const thread_safe::concurrent_deque<T> & ) = delete;
+
+    // Destructor
+    ~concurrent_deque( void ) {
+        block * b = front.blk;
+        size_t i = front.index;
+        for ( size_type n = count.load( std::memory_order_relaxed ); n; --n ) {
+            if ( i == kBlockSize ) { b = b->next; i = 0; }
+            b->at( i++ )->~T();
+        }
+        for ( b = front.blk; b; ) {
+            block * next = b->next;
+            delete b;
+            b = next;
+        }
+        for ( size_t k = 0; k < spares.size(); ++k ) delete spares[k];
+    }
+
+    // Capacity
+    size_type size( void ) const { return count.load( std::memory_order_acquire ); }
+
+    bool empty( void ) const { return size() == 0; }
+
+    // Free spare blocks until at most bytes of them remain
+    void shrink_to( size_type bytes ) {
+        std::lock_guard<std::mutex> lock( spare_mutex );
+        while ( !spares.empty() && spares.size() * sizeof( block ) > bytes ) {
+            delete spares.back();
+            spares.pop_back();
+        }
+    }
+
+    // Modifiers
+    void push_back( const T & u ) { emplace_back( u ); }
+    void push_back( T && u ) { emplace_back( std::move( u ) ); }
+
+    void push_front( const T & u ) { emplace_front( u ); }
+    void push_front( T && u ) { emplace_front( std::move( u ) ); }
+
+    template <class... Args> void emplace_back( Args&&... args ) {
+        std::lock_guard<std::mutex> lock( back.mutex );
+        if ( back.index == kBlockSize ) {
+            block * b = acquire_block();
+            b->prev = back.blk;
+            back.blk->next = b;
+            back.blk = b;
+            back.index = 0;
+        }
+        ::new ( static_cast<void *>( back.blk->at( back.index ) ) ) T( std::forward<Args>( args )... );
+        ++back.index;
+        count.fetch_add( 1, std::memory_order_release );
+    }
+
+    template <class... Args> void emplace_front( Args&&... args ) {
+        std::lock_guard<std::mutex> lock( front.mutex );
+        if ( front.index == 0 ) {
+            block * b = acquire_block();
+            b->next = front.blk;
+            front.blk->prev = b;
+            front.blk = b;
+            front.index = kBlockSize;
+        }
+        ::new ( static_cast<void *>( front.blk->at( front.index - 1 ) ) ) T( std::forward<Args>( args )... );
+        --front.index;
+        count.fetch_add( 1, std::memory_order_release );
+    }
+
+    // Move the end element into value, false when the deque is empty
+    bool try_pop_front( T & value ) {
+        {
+            std::lock_guard<std::mutex> lock( front.mutex );
+            if ( reserve() ) { take_front( value ); return true; }
+        }
+        std::lock_guard<std::mutex> lock( front.mutex );
+        std::lock_guard<std::mutex> lock2( back.mutex );
+        if ( count.load( std::memory_order_relaxed ) == 0 ) return false;
+        count.fetch_sub( 1, std::memory_order_relaxed );
+        take_front( value );
+        return true;
+    }
+
+    bool try_pop_back( T & value ) {
+        {
+            std::lock_guard<std::mutex> lock( back.mutex );
+            if ( reserve() ) { take_back( value ); return true; }
+        }
+        std::lock_guard<std::mutex> lock( front.mutex );
+        std::lock_guard<std::mutex> lock2( back.mutex );
+        if ( count.load( std::memory_order_relaxed ) == 0 ) return false;
+        count.fetch_sub( 1, std::memory_order_relaxed );
+        take_back( value );
+        return true;
+    }
+
+private:
+    struct block {
+        block( void ) : prev( nullptr ), next( nullptr ) { }
+        T * at( size_t i ) { return reinterpret_cast<T *>( &slots[i] ); }
+
+        block * prev;
+        block * next;
+        typename std::aligned_storage<sizeof( T ), std::alignment_of<T>::value>::type slots[kBlockSize];
+    };
+
+    // One end of the deque, on its own cache line. index is the first element
+    // for the front and one past the last element for the back.
+    struct alignas( hardware_destructive_interference_size ) end {
+        std::mutex mutex;
+        block * blk;
+        size_t index;
+    };
+
+    // Fast path claim of one element, fails once the ends get close
+    bool reserve( void ) {
+        size_type c = count.load( std::memory_order_relaxed );
+        while ( c > kSlowThreshold )
+            if ( count.compare_exchange_weak( c, c - 1, std::memory_order_acquire, std::memory_order_relaxed ) ) return true;
+        return false;
+    }
+
+    // Called with the front lock held and one element reserved. The end only
+    // moves past the element once it was moved out; if that throws, the
+    // element stays in place and the reservation is given back.
+    void take_front( T & value ) {
+        if ( front.index == kBlockSize ) {
+            block * old = front.blk;
+            front.blk = old->next;
+            front.blk->prev = nullptr;
+            front.index = 0;
+            release_block( old );
+        }
+        T * p = front.blk->at( front.index );
+        move_out( p, value );
+        ++front.index;
+    }
+
+    void take_back( T & value ) {
+        if ( back.index == 0 ) {
+            block * old = back.blk;
+            back.blk = old->prev;
+            back.blk->next = nullptr;
+            back.index = kBlockSize;
+            release_block( old );
+        }
+        T * p = back.blk->at( back.index - 1 );
+        move_out( p, value );
+        --back.index;
+    }
+
+    void move_out( T * p, T & value ) {
+        try {
+            value = std::move( *p );
+        } catch ( ... ) {
+            count.fetch_add( 1, std::memory_order_release );
+            throw;
+        }
+        p->~T();
+    }
+
+    block * acquire_block( void ) {
+        {
+            std::lock_guard<std::mutex> lock( spare_mutex );
+            if ( !spares.empty() ) {
+                block * b = spares.back();
+                spares.pop_back();
+                b->prev = b->next = nullptr;
+                return b;
+            }
+        }
+        return new block();
+    }
+
+    void release_block( block * b ) {
+        {
+            std::lock_guard<std::mutex> lock( spare_mutex );
+            if ( spares.size() < kMaxSpareBlocks ) { spares.push_back( b ); return; }
+        }
+        delete b;
+    }
+
+    end front;
+    end back;
+    alignas( hardware_destructive_interference_size ) std::atomic<size_type> count;
+    alignas( hardware_destructive_interference_size ) std::mutex spare_mutex;
+    std::vector<block *> spares;
+};
+
+}
+
+#endif // THREAD_SAFE_CONCURRENT_DEQUE_H_INCLUDED
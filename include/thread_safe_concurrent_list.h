@@ -0,0 +1,195 @@
+/*
+Thread Safe Version STL in C++11
+Copyright(c) 2021
+Author: tashaxing
+*/
+#ifndef THREAD_SAFE_CONCURRENT_LIST_H_INCLUDED
+#define THREAD_SAFE_CONCURRENT_LIST_H_INCLUDED
+
+#include <atomic>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <utility>
+
+namespace thread_safe {
+
+// Sorted singly linked list with one mutex per node. Walks use lock coupling
+// (hand-over-hand): the next node is locked before the current one is
+// released, so threads working on different parts of the list run in
+// parallel and never pass each other. Equal elements keep insertion order.
+//
+// Every walk starts at the head, so the head lock is taken briefly by all
+// operations; the win is in not holding it for the rest of the walk.
+template < class T, class Compare = std::less<T> >
+class concurrent_list {
+public:
+    typedef T value_type;
+    typedef size_t size_type;
+
+    // Constructors
+    explicit concurrent_list( const Compare & comp = Compare() ) : comp( comp ), count( 0 ) { head.next = nullptr; }
+
+    concurrent_list( const thread_safe::concurrent_list<T, Compare> & ) = delete;
+    thread_safe::concurrent_list<T, Compare> & operator=( const thread_safe::concurrent_list<T, Compare> & ) = delete;
+
+    // Destructor
+    ~concurrent_list( void ) {
+        for ( node * n = head.next; n; ) {
+            node * next = n->next;
+            delete n;
+            n = next;
+        }
+    }
+
+    // Capacity
+    size_type size( void ) const { return count.load( std::memory_order_relaxed ); }
+
+    bool empty( void ) const { return size() == 0; }
+
+    // Modifiers
+    void insert( const T & u ) { link( std::unique_ptr<node>( new node( u ) ) ); }
+    void insert( T && u ) { link( std::unique_ptr<node>( new node( std::move( u ) ) ) ); }
+    template <class... Args> void emplace( Args&&... args ) { link( std::unique_ptr<node>( new node( std::forward<Args>( args )... ) ) ); }
+
+    // Remove every element equal to u (neither compares less), return how many
+    size_type remove( const T & u ) {
+        size_type removed = 0;
+        std::unique_lock<std::mutex> prev_lock( head.mutex );
+        node_base * prev = &head;
+        while ( node * cur = prev->next ) {
+            std::unique_lock<std::mutex> cur_lock( cur->mutex );
+            if ( comp( u, cur->value ) ) break; // past the equal range
+            if ( !comp( cur->value, u ) ) {
+                unlink( prev, cur, cur_lock );
+                ++removed;
+                continue;
+            }
+            prev_lock.swap( cur_lock );
+            prev = cur;
+        }
+        return removed;
+    }
+
+    // Remove every element matching pred, visiting the whole list
+    template <class Predicate> size_type remove_if( Predicate pred ) {
+        size_type removed = 0;
+        std::unique_lock<std::mutex> prev_lock( head.mutex );
+        node_base * prev = &head;
+        while ( node * cur = prev->next ) {
+            std::unique_lock<std::mutex> cur_lock( cur->mutex );
+            if ( pred( static_cast<const T &>( cur->value ) ) ) {
+                unlink( prev, cur, cur_lock );
+                ++removed;
+                continue;
+            }
+            prev_lock.swap( cur_lock );
+            prev = cur;
+        }
+        return removed;
+    }
+
+    // Move the smallest element into value, false when the list is empty
+    bool pop_front( T & value ) {
+        std::lock_guard<std::mutex> head_lock( head.mutex );
+        node * first = head.next;
+        if ( !first ) return false;
+        std::unique_lock<std::mutex> first_lock( first->mutex );
+        value = std::move( first->value );
+        unlink( &head, first, first_lock );
+        return true;
+    }
+
+    void clear( void ) {
+        node * n;
+        {
+            std::lock_guard<std::mutex> head_lock( head.mutex );
+            n = head.next;
+            head.next = nullptr;
+        }
+        // walkers still inside the detached chain hold a lock on it, wait for each
+        while ( n ) {
+            node * next;
+            {
+                std::lock_guard<std::mutex> lock( n->mutex );
+                next = n->next;
+            }
+            delete n;
+            count.fetch_sub( 1, std::memory_order_relaxed );
+            n = next;
+        }
+    }
+
+    // Operations
+    bool contains( const T & u ) const {
+        bool found = false;
+        walk( [&]( const T & v ) -> bool {
+            if ( comp( v, u ) ) return true;
+            found = !comp( u, v );
+            return false;
+        } );
+        return found;
+    }
+
+    // Visit elements in order; fn must not call back into the list
+    template <class Function> void for_each( Function fn ) const { walk( [&]( const T & v ) -> bool { fn( v ); return true; } ); }
+
+private:
+    struct node;
+
+    struct node_base {
+        node * next;
+        mutable std::mutex mutex;
+    };
+
+    struct node : node_base {
+        template <class... Args> explicit node( Args&&... args ) : value( std::forward<Args>( args )... ) { }
+        T value;
+    };
+
+    // Find the first element greater than n's value and link n in front of it
+    void link( std::unique_ptr<node> n ) {
+        std::unique_lock<std::mutex> prev_lock( head.mutex );
+        node_base * prev = &head;
+        while ( node * cur = prev->next ) {
+            std::unique_lock<std::mutex> cur_lock( cur->mutex );
+            if ( comp( n->value, cur->value ) ) break;
+            prev_lock.swap( cur_lock );
+            prev = cur;
+        }
+        n->next = prev->next;
+        prev->next = n.release();
+        count.fetch_add( 1, std::memory_order_relaxed );
+    }
+
+    // Called with prev and cur locked. Any other thread reaching cur has to
+    // lock prev first, so cur can be freed once its own lock is dropped.
+    void unlink( node_base * prev, node * cur, std::unique_lock<std::mutex> & cur_lock ) {
+        prev->next = cur->next;
+        cur_lock.unlock();
+        delete cur;
+        count.fetch_sub( 1, std::memory_order_relaxed );
+    }
+
+    // Hand-over-hand read walk, stops when visit returns false
+    template <class Visit> void walk( Visit visit ) const {
+        std::unique_lock<std::mutex> prev_lock( head.mutex );
+        const node_base * prev = &head;
+        while ( const node * cur = prev->next ) {
+            std::unique_lock<std::mutex> cur_lock( cur->mutex );
+            prev_lock.swap( cur_lock );
+            cur_lock.unlock();
+            if ( !visit( cur->value ) ) return;
+            prev = cur;
+        }
+    }
+
+    node_base head;
+    Compare comp;
+    std::atomic<size_type> count;
+};
+
+}
+
+#endif // THREAD_SAFE_CONCURRENT_LIST_H_INCLUDED
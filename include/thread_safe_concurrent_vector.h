@@ -0,0 +1,221 @@
+/*
+Thread Safe Version STL in C++11
+Copyright(c) 2021
+Author: tashaxing
+*/
+#ifndef THREAD_SAFE_CONCURRENT_VECTOR_H_INCLUDED
+#define THREAD_SAFE_CONCURRENT_VECTOR_H_INCLUDED
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+
+namespace thread_safe {
+
+// Grow-only vector for concurrent appenders and readers.
+//
+// Elements live in a table of segments whose sizes double (32, 32, 64, 128,
+// ...), so growing never moves an element and references stay valid for the
+// lifetime of the container. push_back / emplace_back claim an index with one
+// fetch_add; size() only counts the leading run of fully constructed elements,
+// so any index below size() can be read without a lock.
+//
+// There is no erase, pop_back or clear; element access must not race with
+// destruction of the container.
+template < class T, class Allocator = std::allocator<T> >
+class concurrent_vector {
+public:
+    typedef T value_type;
+    typedef Allocator allocator_type;
+    typedef size_t size_type;
+    typedef ptrdiff_t difference_type;
+    typedef T & reference;
+    typedef const T & const_reference;
+
+    // Constructors
+    explicit concurrent_vector( const Allocator & alloc = Allocator() ) : allocator( alloc ), claimed( 0 ), published( 0 ) {
+        for ( size_t k = 0; k < kMaxSegments; ++k ) {
+            segments[k].store( nullptr, std::memory_order_relaxed );
+            states[k].store( nullptr, std::memory_order_relaxed );
+        }
+    }
+
+    concurrent_vector( const thread_safe::concurrent_vector<T, Allocator> & ) = delete;
+    thread_safe::concurrent_vector<T, Allocator> & operator=( const thread_safe::concurrent_vector<T, Allocator> & ) = delete;
+
+    // Destructor
+    ~concurrent_vector( void ) {
+        size_type n = claimed.load( std::memory_order_acquire );
+        for ( size_type i = 0; i < n; ++i )
+            if ( states[segment_of( i )].load( std::memory_order_relaxed ) && state( i ).load( std::memory_order_relaxed ) == kReady )
+                std::allocator_traits<Allocator>::destroy( allocator, element( i ) );
+        for ( size_t k = 0; k < kMaxSegments; ++k ) release_segment( k, segments[k].load( std::memory_order_relaxed ), states[k].load( std::memory_order_relaxed ) );
+    }
+
+    // Capacity
+    size_type size( void ) const { return published.load( std::memory_order_acquire ); }
+
+    bool empty( void ) const { return size() == 0; }
+
+    size_type capacity( void ) const {
+        size_type total = 0;
+        for ( size_t k = 0; k < kMaxSegments && segments[k].load( std::memory_order_acquire ); ++k ) total += segment_size( k );
+        return total;
+    }
+
+    // Allocate segments up front so the first n push_backs do not allocate
+    void reserve( size_type n ) { for ( size_type i = 0; i < n; i = segment_base( segment_of( i ) + 1 ) ) ensure_segment( segment_of( i ) ); }
+
+    // Element access, valid for n < size(). An index whose constructor threw
+    // also lies below size() but holds no element: operator[], front() and
+    // back() do not check for it, so when constructors can throw use at(),
+    // which throws out_of_range there, or for_each(), which skips it.
+    T & operator[]( size_type n ) { return *element( n ); }
+    const T & operator[]( size_type n ) const { return *element( n ); }
+
+    T & at( size_type n ) { check( n ); return *element( n ); }
+    const T & at( size_type n ) const { check( n ); return *element( n ); }
+
+    T & front( void ) { return *element( 0 ); }
+    const T & front( void ) const { return *element( 0 ); }
+
+    T & back( void ) { return *element( size() - 1 ); }
+    const T & back( void ) const { return *element( size() - 1 ); }
+
+    // Modifiers, return the index of the new element
+    size_type push_back( const T & u ) { return emplace_back( u ); }
+    size_type push_back( T && u ) { return emplace_back( std::move( u ) ); }
+
+    template <class... Args>
+    size_type emplace_back( Args&&... args ) {
+        size_type index = claimed.fetch_add( 1, std::memory_order_relaxed );
+        size_t k = segment_of( index );
+        // The state array comes first so a failure below can still be
+        // recorded. If it cannot be allocated either, size() stops short of
+        // this index for good.
+        ensure_states( k );
+        try {
+            ensure_slots( k );
+            std::allocator_traits<Allocator>::construct( allocator, element( index ), std::forward<Args>( args )... );
+        } catch ( ... ) {
+            // the index is gone for good, mark it so publication can move past it
+            finish( index, kBroken );
+            throw;
+        }
+        finish( index, kReady );
+        return index;
+    }
+
+    // Visit elements [0, size()) in order
+    template <class Function> void for_each( Function fn ) {
+        size_type n = size();
+        for ( size_type i = 0; i < n; ++i ) if ( state( i ).load( std::memory_order_relaxed ) == kReady ) fn( *element( i ) );
+    }
+
+    template <class Function> void for_each( Function fn ) const {
+        size_type n = size();
+        for ( size_type i = 0; i < n; ++i ) if ( state( i ).load( std::memory_order_relaxed ) == kReady ) fn( *element( i ) );
+    }
+
+    // Allocator
+    allocator_type get_allocator( void ) const { return allocator; }
+
+private:
+    typedef typename std::aligned_storage<sizeof( T ), std::alignment_of<T>::value>::type slot_type;
+    typedef std::atomic<unsigned char> state_type;
+    typedef typename std::allocator_traits<Allocator>::template rebind_alloc<slot_type> slot_allocator;
+    typedef typename std::allocator_traits<Allocator>::template rebind_alloc<state_type> state_allocator;
+
+    static const size_t kFirstSegmentBits = 5;
+    static const size_t kFirstSegment = size_t( 1 ) << kFirstSegmentBits;
+    static const size_t kMaxSegments = sizeof( size_t ) * 8 - kFirstSegmentBits;
+    static const unsigned char kEmpty = 0, kReady = 1, kBroken = 2;
+
+    // segment 0 holds [0, 32), segment k >= 1 holds [32 << (k - 1), 32 << k)
+    static size_t segment_of( size_type index ) {
+        size_type x = ( index >> kFirstSegmentBits ) | 1;
+        size_t k = 0;
+        while ( x >>= 1 ) ++k;
+        return index < kFirstSegment ? 0 : k + 1;
+    }
+    static size_type segment_base( size_t k ) { return k == 0 ? 0 : kFirstSegment << ( k - 1 ); }
+    static size_type segment_size( size_t k ) { return k == 0 ? kFirstSegment : kFirstSegment << ( k - 1 ); }
+
+    T * element( size_type index ) const {
+        size_t k = segment_of( index );
+        return reinterpret_cast<T *>( segments[k].load( std::memory_order_acquire ) + ( index - segment_base( k ) ) );
+    }
+
+    state_type & state( size_type index ) const {
+        size_t k = segment_of( index );
+        return states[k].load( std::memory_order_acquire )[index - segment_base( k )];
+    }
+
+    void check( size_type n ) const {
+        if ( n >= size() ) throw std::out_of_range( "concurrent_vector::at" );
+        if ( state( n ).load( std::memory_order_relaxed ) != kReady ) throw std::out_of_range( "concurrent_vector::at: element construction failed" );
+    }
+
+    // Racing threads may both allocate a segment, the CAS loser frees its
+    // copy. States always go in first, so a reader that sees the segment also
+    // sees its states.
+    void ensure_segment( size_t k ) {
+        ensure_states( k );
+        ensure_slots( k );
+    }
+
+    void ensure_states( size_t k ) {
+        if ( states[k].load( std::memory_order_acquire ) ) return;
+        state_allocator flags( allocator );
+        size_type n = segment_size( k );
+        state_type * st = std::allocator_traits<state_allocator>::allocate( flags, n );
+        for ( size_type i = 0; i < n; ++i ) ::new ( static_cast<void *>( st + i ) ) state_type( kEmpty );
+        state_type * no_states = nullptr;
+        if ( !states[k].compare_exchange_strong( no_states, st, std::memory_order_acq_rel ) ) release_segment( k, nullptr, st );
+    }
+
+    void ensure_slots( size_t k ) {
+        if ( segments[k].load( std::memory_order_acquire ) ) return;
+        slot_allocator slots( allocator );
+        slot_type * seg = std::allocator_traits<slot_allocator>::allocate( slots, segment_size( k ) );
+        slot_type * no_slots = nullptr;
+        if ( !segments[k].compare_exchange_strong( no_slots, seg, std::memory_order_acq_rel ) ) release_segment( k, seg, nullptr );
+    }
+
+    void release_segment( size_t k, slot_type * seg, state_type * st ) {
+        size_type n = segment_size( k );
+        if ( seg ) {
+            slot_allocator slots( allocator );
+            std::allocator_traits<slot_allocator>::deallocate( slots, seg, n );
+        }
+        if ( st ) {
+            state_allocator flags( allocator );
+            for ( size_type i = 0; i < n; ++i ) st[i].~state_type();
+            std::allocator_traits<state_allocator>::deallocate( flags, st, n );
+        }
+    }
+
+    // Mark the slot and push size() forward over every finished slot. Whoever
+    // finishes last in a run sees all earlier marks (seq_cst), so no finished
+    // element is left unpublished. A broken slot may have no element storage.
+    void finish( size_type index, unsigned char how ) {
+        state( index ).store( how, std::memory_order_seq_cst );
+        size_type p = published.load( std::memory_order_seq_cst );
+        while ( p < claimed.load( std::memory_order_acquire ) && states[segment_of( p )].load( std::memory_order_acquire ) && state( p ).load( std::memory_order_seq_cst ) != kEmpty ) {
+            if ( published.compare_exchange_weak( p, p + 1, std::memory_order_seq_cst ) ) ++p;
+        }
+    }
+
+    Allocator allocator;
+    mutable std::atomic<slot_type *> segments[kMaxSegments];
+    mutable std::atomic<state_type *> states[kMaxSegments];
+    std::atomic<size_type> claimed;
+    std::atomic<size_type> published;
+};
+
+}
+
+#endif // THREAD_SAFE_CONCURRENT_VECTOR_H_INCLUDED
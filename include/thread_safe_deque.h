@@ -8,11 +8,20 @@ Author: tashaxing
 
 #include <deque>
 #include <mutex>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <functional>
+
+#include "thread_safe_lock_stats.h"
+#include "thread_safe_locked.h"
+#include "thread_safe_parallel_algorithm.h"
 
 namespace thread_safe {
 
 template < class T, class Allocator = std::allocator<T> >
-class deque {
+class deque : public detail::cache_aligned {
+    friend struct detail::container_access;
 public:
     typedef typename std::deque<T, Allocator>::iterator iterator;
     typedef typename std::deque<T, Allocator>::const_iterator const_iterator;
@@ -27,85 +36,121 @@ public:
     explicit deque( const Allocator & alloc = Allocator() ) : storage( alloc ) { }
     explicit deque( size_type n, const T & value = T(), const Allocator & alloc = Allocator() ) : storage( n, value, alloc ) { }
     template <class InputIterator> deque( InputIterator first, InputIterator last, const Allocator & alloc = Allocator() ) : storage( first, last, alloc ) { }
-    deque( const thread_safe::deque<T, Allocator> & x ) { std::lock_guard<std::mutex> lock( x.mutex ); storage = x.storage; }
+    deque( const thread_safe::deque<T, Allocator> & x ) { detail::container_guard lock( x.mutex, "copy" ); storage = x.storage; }
 
     // Copy
-    thread_safe::deque<T,Allocator>& operator=( const thread_safe::deque<T,Allocator>& x ) { std::lock_guard<std::mutex> lock( mutex ); std::lock_guard<std::mutex> lock2( x.mutex ); storage = x.storage; return *this;}
+    thread_safe::deque<T,Allocator>& operator=( const thread_safe::deque<T,Allocator>& x ) { detail::container_pair_guard lock( mutex, x.mutex, "operator=" ); storage = x.storage; return *this;}
 
     // Destructor
-    ~deque<T,Allocator>( void ) { }
+    ~deque( void ) { }
 
     // Iterators
-    iterator begin( void ) { std::lock_guard<std::mutex> lock( mutex ); return storage.begin(); }
-    const_iterator begin( void ) const { std::lock_guard<std::mutex> lock( mutex ); return storage.begin(); }
+    iterator begin( void ) { detail::container_guard lock( mutex, "begin" ); return storage.begin(); }
+    const_iterator begin( void ) const { detail::container_guard lock( mutex, "begin" ); return storage.begin(); }
 
-    iterator end( void ) { std::lock_guard<std::mutex> lock( mutex ); return storage.end(); }
-    const_iterator end( void ) const { std::lock_guard<std::mutex> lock( mutex ); return storage.end(); }
+    iterator end( void ) { detail::container_guard lock( mutex, "end" ); return storage.end(); }
+    const_iterator end( void ) const { detail::container_guard lock( mutex, "end" ); return storage.end(); }
 
-    const_iterator cbegin() const { std::lock_guard<std::mutex> lock(mutex); return storage.cbegin(); }
-    const_iterator cend() const { std::lock_guard<std::mutex> lock(mutex); return storage.cend(); }
+    const_iterator cbegin() const { detail::container_guard lock(mutex, "cbegin"); return storage.cbegin(); }
+    const_iterator cend() const { detail::container_guard lock(mutex, "cend"); return storage.cend(); }
 
-    reverse_iterator rbegin( void ) { std::lock_guard<std::mutex> lock( mutex ); return storage.rbegin(); }
-    const_reverse_iterator rbegin( void ) const { std::lock_guard<std::mutex> lock( mutex ); return storage.rbegin(); }
+    reverse_iterator rbegin( void ) { detail::container_guard lock( mutex, "rbegin" ); return storage.rbegin(); }
+    const_reverse_iterator rbegin( void ) const { detail::container_guard lock( mutex, "rbegin" ); return storage.rbegin(); }
 
-    reverse_iterator rend( void ) { std::lock_guard<std::mutex> lock( mutex ); return storage.rend(); }
-    const_reverse_iterator rend( void ) const { std::lock_guard<std::mutex> lock( mutex ); return storage.rend(); }
+    reverse_iterator rend( void ) { detail::container_guard lock( mutex, "rend" ); return storage.rend(); }
+    const_reverse_iterator rend( void ) const { detail::container_guard lock( mutex, "rend" ); return storage.rend(); }
 
     // Capacity
-    size_type size( void ) const { std::lock_guard<std::mutex> lock( mutex ); return storage.size(); }
+    size_type size( void ) const { detail::container_guard lock( mutex, "size" ); return storage.size(); }
 
-    size_type max_size( void ) const { std::lock_guard<std::mutex> lock( mutex ); return storage.max_size(); }
+    size_type max_size( void ) const { detail::container_guard lock( mutex, "max_size" ); return storage.max_size(); }
 
-    void resize( size_type n, T c = T() ) { std::lock_guard<std::mutex> lock( mutex ); storage.resize( n, c ); }
+    void resize( size_type n, T c = T() ) { detail::container_guard lock( mutex, "resize" ); storage.resize( n, c ); }
 
-    bool empty( void ) const { std::lock_guard<std::mutex> lock( mutex ); return storage.empty(); }
+    bool empty( void ) const { detail::container_guard lock( mutex, "empty" ); return storage.empty(); }
 
     // Element access
-    T & operator[]( size_type n ) { std::lock_guard<std::mutex> lock( mutex ); return storage[n]; }
-    const T & operator[]( size_type n ) const { std::lock_guard<std::mutex> lock( mutex ); return storage[n]; }
+    T & operator[]( size_type n ) { detail::container_guard lock( mutex, "operator[]" ); return storage[n]; }
+    const T & operator[]( size_type n ) const { detail::container_guard lock( mutex, "operator[]" ); return storage[n]; }
 
-    T & at( size_type n ) { std::lock_guard<std::mutex> lock( mutex ); return storage.at( n ); }
-    const T & at( size_type n ) const { std::lock_guard<std::mutex> lock( mutex ); return storage.at( n ); }
+    T & at( size_type n ) { detail::container_guard lock( mutex, "at" ); return storage.at( n ); }
+    const T & at( size_type n ) const { detail::container_guard lock( mutex, "at" ); return storage.at( n ); }
 
-    T & front( void ) { std::lock_guard<std::mutex> lock( mutex ); return storage.front(); }
-    const T & front( void ) const { std::lock_guard<std::mutex> lock( mutex ); return storage.back(); }
+    T & front( void ) { detail::container_guard lock( mutex, "front" ); return storage.front(); }
+    const T & front( void ) const { detail::container_guard lock( mutex, "front" ); return storage.front(); }
 
-    T & back( void ) { std::lock_guard<std::mutex> lock( mutex ); return storage.back(); }
-    const T & back( void ) const { std::lock_guard<std::mutex> lock( mutex ); return storage.back(); }
+    T & back( void ) { detail::container_guard lock( mutex, "back" ); return storage.back(); }
+    const T & back( void ) const { detail::container_guard lock( mutex, "back" ); return storage.back(); }
 
     // Modifiers
-    void assign( size_type n, T & u ) { std::lock_guard<std::mutex> lock( mutex ); storage.assign( n, u ); }
-    template <class InputIterator> void assign( InputIterator begin, InputIterator end ) { std::lock_guard<std::mutex> lock( mutex ); storage.assign( begin, end ); }
+    void assign( size_type n, T & u ) { detail::container_guard lock( mutex, "assign" ); storage.assign( n, u ); }
+    template <class InputIterator> void assign( InputIterator begin, InputIterator end ) { detail::container_guard lock( mutex, "assign" ); storage.assign( begin, end ); }
+
+    template <class... Args> void emplace_back( Args&&... args ) { detail::container_guard lock( mutex, "emplace_back" ); storage.emplace_back( std::forward<Args>( args )... ); }
+
+    void push_back( const T & u ) { detail::container_guard lock( mutex, "push_back" ); storage.push_back( u ); }
+    void push_back( T && u ) { detail::container_guard lock( mutex, "push_back" ); storage.push_back( std::move( u ) ); }
 
-    void emplace_back(const T& u) { std::lock_guard<std::mutex> lock(mutex); storage.emplace_back(u); }
+    void pop_back( void ) { detail::container_guard lock( mutex, "pop_back" ); storage.pop_back(); }
 
-    void push_back( const T & u ) { std::lock_guard<std::mutex> lock( mutex ); storage.push_back( u ); }
+    // Move the last element out and remove it; throws out_of_range when empty
+    T pop_back_value( void ) { detail::container_guard lock( mutex, "pop_back_value" ); if ( storage.empty() ) throw std::out_of_range( "deque::pop_back_value" ); T value( std::move( storage.back() ) ); storage.pop_back(); return value; }
+    bool try_pop_back( T & value ) { detail::container_guard lock( mutex, "try_pop_back" ); if ( storage.empty() ) return false; value = std::move( storage.back() ); storage.pop_back(); return true; }
 
-    void pop_back( void ) { std::lock_guard<std::mutex> lock( mutex ); storage.pop_back(); }
+    template <class... Args> void emplace_front( Args&&... args ) { detail::container_guard lock( mutex, "emplace_front" ); storage.emplace_front( std::forward<Args>( args )... ); }
 
-    void emplace_front(const T& u) { std::lock_guard<std::mutex> lock(mutex); storage.emplace_front(u); }
+    void push_front( const T & u ) { detail::container_guard lock( mutex, "push_front" ); storage.push_front( u ); }
+    void push_front( T && u ) { detail::container_guard lock( mutex, "push_front" ); storage.push_front( std::move( u ) ); }
 
-    void push_front( const T & u ) { std::lock_guard<std::mutex> lock( mutex ); storage.push_front( u ); }
+    void pop_front( void ) { detail::container_guard lock( mutex, "pop_front" ); storage.pop_front(); }
 
-    void pop_front( void ) { std::lock_guard<std::mutex> lock( mutex ); storage.pop_front(); }
+    // Move the first element out and remove it; throws out_of_range when empty
+    T pop_front_value( void ) { detail::container_guard lock( mutex, "pop_front_value" ); if ( storage.empty() ) throw std::out_of_range( "deque::pop_front_value" ); T value( std::move( storage.front() ) ); storage.pop_front(); return value; }
+    bool try_pop_front( T & value ) { detail::container_guard lock( mutex, "try_pop_front" ); if ( storage.empty() ) return false; value = std::move( storage.front() ); storage.pop_front(); return true; }
 
-    iterator insert( iterator pos, const T & u ) { std::lock_guard<std::mutex> lock( mutex ); return storage.insert( pos, u ); }
-    void insert( iterator pos, size_type n, const T & u ) { std::lock_guard<std::mutex> lock( mutex ); storage.insert( pos, n, u ); }
-    template <class InputIterator> void insert( iterator pos, InputIterator begin, InputIterator end ) { std::lock_guard<std::mutex> lock( mutex ); storage.insert( pos, begin, end ); }
+    iterator insert( iterator pos, const T & u ) { detail::container_guard lock( mutex, "insert" ); return storage.insert( pos, u ); }
+    iterator insert( iterator pos, T && u ) { detail::container_guard lock( mutex, "insert" ); return storage.insert( pos, std::move( u ) ); }
+    template <class... Args> iterator emplace( iterator pos, Args&&... args ) { detail::container_guard lock( mutex, "emplace" ); return storage.emplace( pos, std::forward<Args>( args )... ); }
+    void insert( iterator pos, size_type n, const T & u ) { detail::container_guard lock( mutex, "insert" ); storage.insert( pos, n, u ); }
+    template <class InputIterator> void insert( iterator pos, InputIterator begin, InputIterator end ) { detail::container_guard lock( mutex, "insert" ); storage.insert( pos, begin, end ); }
 
-    void erase( iterator pos ) { std::lock_guard<std::mutex> lock( mutex ); storage.erase( pos ); }
-    void erase( iterator begin, iterator end ) { std::lock_guard<std::mutex> lock( mutex ); storage.erase( begin, end ); }
+    void erase( iterator pos ) { detail::container_guard lock( mutex, "erase" ); storage.erase( pos ); }
+    void erase( iterator begin, iterator end ) { detail::container_guard lock( mutex, "erase" ); storage.erase( begin, end ); }
 
-    void swap( thread_safe::deque<T, Allocator> & x ) { std::lock_guard<std::mutex> lock( mutex ); std::lock_guard<std::mutex> lock2( x.mutex ); storage.swap( x.storage ); }
+    void swap( thread_safe::deque<T, Allocator> & x ) { detail::container_pair_guard lock( mutex, x.mutex, "swap" ); storage.swap( x.storage ); }
 
-    void clear( void ) { std::lock_guard<std::mutex> lock( mutex ); storage.clear(); }
+    void clear( void ) { detail::container_guard lock( mutex, "clear" ); storage.clear(); }
 
     // Allocator
-    allocator_type get_allocator( void ) const { std::lock_guard<std::mutex> lock( mutex ); return storage.get_allocator(); }
+    allocator_type get_allocator( void ) const { detail::container_guard lock( mutex, "get_allocator" ); return storage.get_allocator(); }
+
+    // Parallel algorithms
+    // Each takes the lock once and splits the work over the shared thread pool;
+    // the callbacks run on worker threads and must not use this container.
+    void parallel_sort( void ) { parallel_sort( std::less<T>() ); }
+    template <class Compare> void parallel_sort( Compare comp ) { detail::container_guard lock( mutex, "parallel_sort" ); parallel::sort( storage.begin(), storage.end(), comp ); }
+
+    template <class Function> void parallel_for_each( Function fn ) { detail::container_guard lock( mutex, "parallel_for_each" ); parallel::for_each( storage.begin(), storage.end(), fn ); }
+
+    // Replaces every element x by op( x )
+    template <class UnaryOperation> void parallel_transform( UnaryOperation op ) { detail::container_guard lock( mutex, "parallel_transform" ); parallel::transform( storage.begin(), storage.end(), storage.begin(), op ); }
+
+    template <class U, class BinaryOperation> U parallel_reduce( U init, BinaryOperation op ) const { detail::container_guard lock( mutex, "parallel_reduce" ); return parallel::reduce( storage.begin(), storage.end(), init, op ); }
+
+    // Locked access to the underlying std container for multi-step operations, see thread_safe_locked.h
+    typedef std::deque<T, Allocator> storage_type;
+    locked<storage_type> lock( void ) { return locked<storage_type>( storage, mutex, "lock" ); }
+    locked<const storage_type> lock( void ) const { return locked<const storage_type>( storage, mutex, "lock" ); }
+    template <class Function> typename std::result_of<Function( storage_type & )>::type with_lock( Function fn ) { detail::container_guard lock( mutex, "with_lock" ); return fn( storage ); }
+    template <class Function> typename std::result_of<Function( const storage_type & )>::type with_lock( Function fn ) const { detail::container_guard lock( mutex, "with_lock" ); return fn( storage ); }
+
+    // Lock statistics, empty unless built with THREAD_SAFE_STL_ENABLE_STATS
+    lock_stats stats( void ) const { return detail::stats_of( mutex ); }
+    void set_name( const std::string & name ) { detail::set_name_of( mutex, name ); }
 
 private:
-    std::deque<T, Allocator> storage;
-    mutable std::mutex mutex;
+    alignas( hardware_destructive_interference_size ) std::deque<T, Allocator> storage;
+    alignas( hardware_destructive_interference_size ) mutable detail::container_mutex mutex;
 };
 
 }
@@ -0,0 +1,330 @@
+/*
+Thread Safe Version STL in C++11
+Copyright(c) 2021
+Author: tashaxing
+*/
+#ifndef THREAD_SAFE_FLAT_COMBINING_H_INCLUDED
+#define THREAD_SAFE_FLAT_COMBINING_H_INCLUDED
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <new>
+#include <queue>
+#include <stack>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "thread_safe_cache_line.h"
+#include "thread_safe_lock_stats.h"
+#include "thread_safe_locked.h"
+#include "thread_safe_locks.h"
+
+namespace thread_safe {
+
+namespace detail {
+
+// One published operation. The owner claims a free slot, fills it in and
+// marks it pending; the combiner runs it and marks it done; the owner reads
+// the result and frees the slot. Each slot has a cache line of its own, so a
+// waiting owner spins in its own cache until the combiner writes the result.
+template <class T>
+struct alignas( hardware_destructive_interference_size ) combining_slot {
+    enum { kFree, kClaimed, kPending, kDone };
+    enum { kPush, kPop };
+
+    combining_slot( void ) : state( kFree ), op( kPush ), ok( false ) { }
+
+    T & value( void ) { return *reinterpret_cast<T *>( &buffer ); }
+
+    // Results, for the combiner
+    template <class U> void popped( U && u ) { new ( &buffer ) T( std::forward<U>( u ) ); ok = true; }
+    void failed( void ) { error = std::current_exception(); }
+
+    std::atomic<unsigned> state;
+    unsigned op;
+    bool ok;
+    std::exception_ptr error;
+    // Constructed by the owner for a push and by the combiner for a successful pop
+    typename std::aligned_storage<sizeof( T ), alignof( T )>::type buffer;
+};
+
+// Flat combining (Hendler et al.): rather than every thread taking the lock
+// in turn, threads publish their operations in slots and whichever of them
+// gets the lock runs every pending operation in one pass while the others
+// wait on their own slot. The lock and the container stay in one core's
+// cache for the whole batch instead of moving once per operation, and the
+// batch can cancel pushes against pops without touching the container.
+// Apply( pushes, push_count, pops, pop_count ) runs a batch under the lock.
+template <class T>
+class flat_combiner {
+public:
+    typedef combining_slot<T> slot;
+
+    static const size_t kSlots = 64;
+    static const unsigned kPasses = 3; // scans per turn while new operations keep arriving
+
+    flat_combiner( void ) : pending( 0 ) { }
+
+    template <class Apply>
+    void push( container_mutex & mutex, Apply apply, T && value ) {
+        bool locked = mutex.try_lock();
+        slot * s = locked ? nullptr : claim();
+        slot local;
+        if ( s == nullptr ) s = &local;
+        new ( &s->buffer ) T( std::move( value ) );
+        s->op = slot::kPush;
+        s->ok = false;
+        execute( mutex, apply, *s, locked, s == &local );
+        s->value().~T();
+        finish( *s, s == &local );
+    }
+
+    template <class Apply>
+    bool pop( container_mutex & mutex, Apply apply, T & value ) {
+        bool locked = mutex.try_lock();
+        slot * s = locked ? nullptr : claim();
+        slot local;
+        if ( s == nullptr ) s = &local;
+        s->op = slot::kPop;
+        s->ok = false;
+        execute( mutex, apply, *s, locked, s == &local );
+        bool ok = s->ok;
+        if ( ok ) {
+            try {
+                value = std::move( s->value() );
+            } catch ( ... ) {
+                s->value().~T();
+                finish( *s, s == &local );
+                throw;
+            }
+            s->value().~T();
+        }
+        finish( *s, s == &local );
+        return ok;
+    }
+
+private:
+    // Start at the thread's own slot so it normally stays in this core's
+    // cache; null when all slots are busy
+    slot * claim( void ) {
+        static thread_local size_t home = std::hash<std::thread::id>()( std::this_thread::get_id() ) % kSlots;
+        for ( size_t i = 0; i < kSlots; ++i ) {
+            slot & s = slots[( home + i ) % kSlots];
+            unsigned expected = slot::kFree;
+            if ( s.state.load( std::memory_order_relaxed ) == slot::kFree
+                && s.state.compare_exchange_strong( expected, slot::kClaimed, std::memory_order_acquire, std::memory_order_relaxed ) ) return &s;
+        }
+        return nullptr;
+    }
+
+    // Wait until a combiner ran s, or become the combiner. An operation that
+    // found the lock free, or no free slot, runs on its own under the lock and
+    // then serves whatever was published meanwhile; a lone thread finds the
+    // pending count at zero and skips the scan.
+    template <class Apply>
+    void execute( container_mutex & mutex, Apply & apply, slot & s, bool locked, bool unpublished ) {
+        if ( unpublished ) {
+            if ( !locked ) lock_op( mutex, s.op == slot::kPush ? "push" : "pop" );
+            slot * one = &s;
+            if ( s.op == slot::kPush ) apply( &one, 1, static_cast<slot **>( nullptr ), 0 );
+            else apply( static_cast<slot **>( nullptr ), 0, &one, 1 );
+            if ( pending.load( std::memory_order_acquire ) ) combine( apply );
+            mutex.unlock();
+            return;
+        }
+        // counted before it is visible, so the count never drops below zero
+        pending.fetch_add( 1, std::memory_order_relaxed );
+        s.state.store( slot::kPending, std::memory_order_release );
+        backoff wait;
+        while ( s.state.load( std::memory_order_acquire ) != slot::kDone ) {
+            if ( mutex.try_lock() ) {
+                // s is pending or already done, the first scan serves it either way
+                combine( apply );
+                mutex.unlock();
+                return;
+            }
+            wait.wait();
+        }
+    }
+
+    template <class Apply>
+    void combine( Apply & apply ) {
+        slot * pushes[kSlots];
+        slot * pops[kSlots];
+        for ( unsigned pass = 0; pass < kPasses; ++pass ) {
+            size_t push_count = 0, pop_count = 0;
+            for ( size_t i = 0; i < kSlots; ++i ) {
+                slot & s = slots[i];
+                if ( s.state.load( std::memory_order_acquire ) != slot::kPending ) continue;
+                if ( s.op == slot::kPush ) pushes[push_count++] = &s;
+                else pops[pop_count++] = &s;
+            }
+            if ( push_count + pop_count == 0 ) return;
+            pending.fetch_sub( push_count + pop_count, std::memory_order_relaxed );
+            apply( pushes, push_count, pops, pop_count );
+            for ( size_t i = 0; i < push_count; ++i ) pushes[i]->state.store( slot::kDone, std::memory_order_release );
+            for ( size_t i = 0; i < pop_count; ++i ) pops[i]->state.store( slot::kDone, std::memory_order_release );
+        }
+    }
+
+    void finish( slot & s, bool unpublished ) {
+        std::exception_ptr error = s.error;
+        s.error = nullptr;
+        if ( !unpublished ) s.state.store( slot::kFree, std::memory_order_release );
+        if ( error ) std::rethrow_exception( error );
+    }
+
+    slot slots[kSlots];
+    alignas( hardware_destructive_interference_size ) std::atomic<size_t> pending; // published, not yet taken by a combiner
+};
+
+// Batch for a stack: a push and a pop in the same batch cancel out, the pop
+// returning the pushed value as if it ran right after the push
+template <class Storage>
+struct stack_combine {
+    explicit stack_combine( Storage & s ) : storage( s ) { }
+
+    template <class Slot>
+    void operator()( Slot ** pushes, size_t push_count, Slot ** pops, size_t pop_count ) const {
+        size_t pairs = std::min( push_count, pop_count );
+        for ( size_t i = 0; i < pairs; ++i ) {
+            try { pops[i]->popped( std::move( pushes[i]->value() ) ); pushes[i]->ok = true; } catch ( ... ) { pushes[i]->failed(); pops[i]->failed(); }
+        }
+        for ( size_t i = pairs; i < push_count; ++i ) {
+            try { storage.push( std::move( pushes[i]->value() ) ); pushes[i]->ok = true; } catch ( ... ) { pushes[i]->failed(); }
+        }
+        for ( size_t i = pairs; i < pop_count && !storage.empty(); ++i ) {
+            try { pops[i]->popped( std::move( storage.top() ) ); storage.pop(); } catch ( ... ) { pops[i]->failed(); }
+        }
+    }
+
+    Storage & storage;
+};
+
+// Batch for a heap: a pushed value goes straight to a waiting pop when it is
+// not below the current top, so the pop would have returned it anyway
+template <class Storage, class Compare>
+struct heap_combine {
+    heap_combine( Storage & s, const Compare & c ) : storage( s ), compare( c ) { }
+
+    template <class Slot>
+    void operator()( Slot ** pushes, size_t push_count, Slot ** pops, size_t pop_count ) const {
+        size_t served = 0;
+        for ( size_t i = 0; i < push_count; ++i ) {
+            try {
+                if ( served < pop_count && ( storage.empty() || !compare( pushes[i]->value(), storage.top() ) ) ) {
+                    Slot * pop = pops[served++];
+                    try { pop->popped( std::move( pushes[i]->value() ) ); } catch ( ... ) { pop->failed(); throw; }
+                } else {
+                    storage.push( std::move( pushes[i]->value() ) );
+                }
+                pushes[i]->ok = true;
+            } catch ( ... ) {
+                pushes[i]->failed();
+            }
+        }
+        // top() is const only to protect the heap order, which pop() restores right after the move
+        for ( ; served < pop_count && !storage.empty(); ++served ) {
+            try { pops[served]->popped( std::move( const_cast<typename Storage::value_type &>( storage.top() ) ) ); storage.pop(); } catch ( ... ) { pops[served]->failed(); }
+        }
+    }
+
+    Storage & storage;
+    const Compare & compare;
+};
+
+}
+
+// Stack with flat combining for heavy contention: concurrent push and
+// try_pop calls are batched by whichever thread holds the lock, and pushes
+// and pops in the same batch hand values over directly. With a few threads,
+// or under a lock without handoffs to avoid, the plain stack is as fast or
+// faster. The slots take kSlots cache lines per container.
+template < class T, class Container = std::deque<T> >
+class combining_stack : public detail::cache_aligned {
+    friend struct detail::container_access;
+    typedef detail::stack_combine< std::stack<T, Container> > combine_type;
+public:
+    explicit combining_stack( const Container & ctnr ) : storage( ctnr ) { }
+    explicit combining_stack( Container && ctnr = Container() ) : storage( std::move( ctnr ) ) { }
+
+    combining_stack( const combining_stack & ) = delete;
+    combining_stack & operator=( const combining_stack & ) = delete;
+
+    bool empty( void ) const { detail::container_guard lock( mutex, "empty" ); return storage.empty(); }
+
+    size_t size( void ) const { detail::container_guard lock( mutex, "size" ); return storage.size(); }
+
+    void push( const T & u ) { push( T( u ) ); }
+    void push( T && u ) { combiner.push( mutex, combine_type( storage ), std::move( u ) ); }
+    template <class... Args> void emplace( Args&&... args ) { push( T( std::forward<Args>( args )... ) ); }
+
+    bool try_pop( T & value ) { return combiner.pop( mutex, combine_type( storage ), value ); }
+
+    // Locked access to the underlying std container for multi-step operations, see thread_safe_locked.h
+    typedef std::stack<T, Container> storage_type;
+    locked<storage_type> lock( void ) { return locked<storage_type>( storage, mutex, "lock" ); }
+    locked<const storage_type> lock( void ) const { return locked<const storage_type>( storage, mutex, "lock" ); }
+    template <class Function> typename std::result_of<Function( storage_type & )>::type with_lock( Function fn ) { detail::container_guard lock( mutex, "with_lock" ); return fn( storage ); }
+    template <class Function> typename std::result_of<Function( const storage_type & )>::type with_lock( Function fn ) const { detail::container_guard lock( mutex, "with_lock" ); return fn( storage ); }
+
+    // Lock statistics, empty unless built with THREAD_SAFE_STL_ENABLE_STATS.
+    // Batches and uncontended operations show up as try_lock.
+    lock_stats stats( void ) const { return detail::stats_of( mutex ); }
+    void set_name( const std::string & name ) { detail::set_name_of( mutex, name ); }
+private:
+    alignas( hardware_destructive_interference_size ) std::stack<T, Container> storage;
+    alignas( hardware_destructive_interference_size ) mutable detail::container_mutex mutex;
+    detail::flat_combiner<T> combiner;
+};
+
+// priority_queue with flat combining, see combining_stack
+template < class T, class Container = std::vector<T>, class Compare = std::less<typename Container::value_type> >
+class combining_priority_queue : public detail::cache_aligned {
+    friend struct detail::container_access;
+    typedef detail::heap_combine< std::priority_queue< T, Container, Compare >, Compare > combine_type;
+public:
+    explicit combining_priority_queue ( const Compare& x = Compare(), Container&& y = Container() ) : storage( x, std::move( y ) ), compare( x ) { }
+    template <class InputIterator> combining_priority_queue ( InputIterator first, InputIterator last, const Compare& x = Compare(), const Container& y = Container() ) : storage( first, last, x, y ), compare( x ) { }
+
+    combining_priority_queue( const combining_priority_queue & ) = delete;
+    combining_priority_queue & operator=( const combining_priority_queue & ) = delete;
+
+    bool empty( void ) const { detail::container_guard lock( mutex, "empty" ); return storage.empty(); }
+
+    size_t size( void ) const { detail::container_guard lock( mutex, "size" ); return storage.size(); }
+
+    void push( const T & u ) { push( T( u ) ); }
+    void push( T && u ) { combiner.push( mutex, combine_type( storage, compare ), std::move( u ) ); }
+    template <class... Args> void emplace( Args&&... args ) { push( T( std::forward<Args>( args )... ) ); }
+
+    bool try_pop( T & value ) { return combiner.pop( mutex, combine_type( storage, compare ), value ); }
+
+    // Locked access to the underlying std container for multi-step operations, see thread_safe_locked.h
+    typedef std::priority_queue< T, Container, Compare > storage_type;
+    locked<storage_type> lock( void ) { return locked<storage_type>( storage, mutex, "lock" ); }
+    locked<const storage_type> lock( void ) const { return locked<const storage_type>( storage, mutex, "lock" ); }
+    template <class Function> typename std::result_of<Function( storage_type & )>::type with_lock( Function fn ) { detail::container_guard lock( mutex, "with_lock" ); return fn( storage ); }
+    template <class Function> typename std::result_of<Function( const storage_type & )>::type with_lock( Function fn ) const { detail::container_guard lock( mutex, "with_lock" ); return fn( storage ); }
+
+    // Lock statistics, empty unless built with THREAD_SAFE_STL_ENABLE_STATS.
+    // Batches and uncontended operations show up as try_lock.
+    lock_stats stats( void ) const { return detail::stats_of( mutex ); }
+    void set_name( const std::string & name ) { detail::set_name_of( mutex, name ); }
+private:
+    alignas( hardware_destructive_interference_size ) std::priority_queue< T, Container, Compare > storage;
+    alignas( hardware_destructive_interference_size ) mutable detail::container_mutex mutex;
+    const Compare compare; // a copy of the heap's, which std::priority_queue keeps protected
+    detail::flat_combiner<T> combiner;
+};
+
+}
+
+#endif // THREAD_SAFE_FLAT_COMBINING_H_INCLUDED
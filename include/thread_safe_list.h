@@ -8,11 +8,18 @@ Author: tashaxing
 
 #include <list>
 #include <mutex>
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+#include "thread_safe_lock_stats.h"
+#include "thread_safe_locked.h"
 
 namespace thread_safe {
 
 template < class T, class Allocator = std::allocator<T> >
-class list {
+class list : public detail::cache_aligned {
+    friend struct detail::container_access;
 public:
     typedef typename std::list<T, Allocator>::iterator iterator;
     typedef typename std::list<T, Allocator>::const_iterator const_iterator;
@@ -27,99 +34,122 @@ public:
     explicit list( const Allocator & alloc = Allocator() ) : storage( alloc ) { }
     explicit list( size_type n, const T & value = T(), const Allocator & alloc = Allocator() ) : storage( n, value, alloc ) { }
     template <class InputIterator> list( InputIterator first, InputIterator last, const Allocator & alloc = Allocator() ) : storage( first, last, alloc ) { }
-    list( const thread_safe::list<T, Allocator> & x ) { std::lock_guard<std::mutex> lock( x.mutex ); storage = x.storage; }
+    list( const thread_safe::list<T, Allocator> & x ) { detail::container_guard lock( x.mutex, "copy" ); storage = x.storage; }
 
     // Copy
-    thread_safe::list<T,Allocator>& operator=( const thread_safe::list<T,Allocator>& x ) { std::lock_guard<std::mutex> lock( mutex ); std::lock_guard<std::mutex> lock2( x.mutex ); storage = x.storage; return *this;}
+    thread_safe::list<T,Allocator>& operator=( const thread_safe::list<T,Allocator>& x ) { detail::container_pair_guard lock( mutex, x.mutex, "operator=" ); storage = x.storage; return *this;}
 
     // Destructor
-    ~list<T,Allocator>( void ) { }
+    ~list( void ) { }
 
     // Iterators
-    iterator begin( void ) { std::lock_guard<std::mutex> lock( mutex ); return storage.begin(); }
-    const_iterator begin( void ) const { std::lock_guard<std::mutex> lock( mutex ); return storage.begin(); }
+    iterator begin( void ) { detail::container_guard lock( mutex, "begin" ); return storage.begin(); }
+    const_iterator begin( void ) const { detail::container_guard lock( mutex, "begin" ); return storage.begin(); }
 
-    iterator end( void ) { std::lock_guard<std::mutex> lock( mutex ); return storage.end(); }
-    const_iterator end( void ) const { std::lock_guard<std::mutex> lock( mutex ); return storage.end(); }
+    iterator end( void ) { detail::container_guard lock( mutex, "end" ); return storage.end(); }
+    const_iterator end( void ) const { detail::container_guard lock( mutex, "end" ); return storage.end(); }
 
-    const_iterator cbegin() const { std::lock_guard<std::mutex> lock(mutex); return storage.cbegin(); }
-    const_iterator cend() const { std::lock_guard<std::mutex> lock(mutex); return storage.cend(); }
+    const_iterator cbegin() const { detail::container_guard lock(mutex, "cbegin"); return storage.cbegin(); }
+    const_iterator cend() const { detail::container_guard lock(mutex, "cend"); return storage.cend(); }
 
-    reverse_iterator rbegin( void ) { std::lock_guard<std::mutex> lock( mutex ); return storage.rbegin(); }
-    const_reverse_iterator rbegin( void ) const { std::lock_guard<std::mutex> lock( mutex ); return storage.rbegin(); }
+    reverse_iterator rbegin( void ) { detail::container_guard lock( mutex, "rbegin" ); return storage.rbegin(); }
+    const_reverse_iterator rbegin( void ) const { detail::container_guard lock( mutex, "rbegin" ); return storage.rbegin(); }
 
-    reverse_iterator rend( void ) { std::lock_guard<std::mutex> lock( mutex ); return storage.rend(); }
-    const_reverse_iterator rend( void ) const { std::lock_guard<std::mutex> lock( mutex ); return storage.rend(); }
+    reverse_iterator rend( void ) { detail::container_guard lock( mutex, "rend" ); return storage.rend(); }
+    const_reverse_iterator rend( void ) const { detail::container_guard lock( mutex, "rend" ); return storage.rend(); }
 
     // Capacity
-    size_type size( void ) const { std::lock_guard<std::mutex> lock( mutex ); return storage.size(); }
+    size_type size( void ) const { detail::container_guard lock( mutex, "size" ); return storage.size(); }
 
-    size_type max_size( void ) const { std::lock_guard<std::mutex> lock( mutex ); return storage.max_size(); }
+    size_type max_size( void ) const { detail::container_guard lock( mutex, "max_size" ); return storage.max_size(); }
 
-    void resize( size_type n, T c = T() ) { std::lock_guard<std::mutex> lock( mutex ); storage.resize( n, c ); }
+    void resize( size_type n, T c = T() ) { detail::container_guard lock( mutex, "resize" ); storage.resize( n, c ); }
 
-    bool empty( void ) const { std::lock_guard<std::mutex> lock( mutex ); return storage.empty(); }
+    bool empty( void ) const { detail::container_guard lock( mutex, "empty" ); return storage.empty(); }
 
     // Element access
-    T & front( void ) { std::lock_guard<std::mutex> lock( mutex ); return storage.front(); }
-    const T & front( void ) const { std::lock_guard<std::mutex> lock( mutex ); return storage.back(); }
+    T & front( void ) { detail::container_guard lock( mutex, "front" ); return storage.front(); }
+    const T & front( void ) const { detail::container_guard lock( mutex, "front" ); return storage.front(); }
 
-    T & back( void ) { std::lock_guard<std::mutex> lock( mutex ); return storage.back(); }
-    const T & back( void ) const { std::lock_guard<std::mutex> lock( mutex ); return storage.back(); }
+    T & back( void ) { detail::container_guard lock( mutex, "back" ); return storage.back(); }
+    const T & back( void ) const { detail::container_guard lock( mutex, "back" ); return storage.back(); }
 
     // Modifiers
-    void assign( size_type n, T & u ) { std::lock_guard<std::mutex> lock( mutex ); storage.assign( n, u ); }
-    template <class InputIterator> void assign( InputIterator begin, InputIterator end ) { std::lock_guard<std::mutex> lock( mutex ); storage.assign( begin, end ); }
+    void assign( size_type n, T & u ) { detail::container_guard lock( mutex, "assign" ); storage.assign( n, u ); }
+    template <class InputIterator> void assign( InputIterator begin, InputIterator end ) { detail::container_guard lock( mutex, "assign" ); storage.assign( begin, end ); }
+
+    template <class... Args> void emplace_back( Args&&... args ) { detail::container_guard lock( mutex, "emplace_back" ); storage.emplace_back( std::forward<Args>( args )... ); }
+
+    void push_back( const T & u ) { detail::container_guard lock( mutex, "push_back" ); storage.push_back( u ); }
+    void push_back( T && u ) { detail::container_guard lock( mutex, "push_back" ); storage.push_back( std::move( u ) ); }
 
-    void emplace_back( const T& u ) { std::lock_guard<std::mutex> lock(mutex); storage.emplace_back(u); }
+    void pop_back( void ) { detail::container_guard lock( mutex, "pop_back" ); storage.pop_back(); }
 
-    void push_back( const T & u ) { std::lock_guard<std::mutex> lock( mutex ); storage.push_back( u ); }
+    // Move the last element out and remove it; throws out_of_range when empty
+    T pop_back_value( void ) { detail::container_guard lock( mutex, "pop_back_value" ); if ( storage.empty() ) throw std::out_of_range( "list::pop_back_value" ); T value( std::move( storage.back() ) ); storage.pop_back(); return value; }
+    bool try_pop_back( T & value ) { detail::container_guard lock( mutex, "try_pop_back" ); if ( storage.empty() ) return false; value = std::move( storage.back() ); storage.pop_back(); return true; }
 
-    void pop_back( void ) { std::lock_guard<std::mutex> lock( mutex ); storage.pop_back(); }
+    template <class... Args> void emplace_front( Args&&... args ) { detail::container_guard lock( mutex, "emplace_front" ); storage.emplace_front( std::forward<Args>( args )... ); }
 
-    void emplace_front(const T& u) { std::lock_guard<std::mutex> lock(mutex); storage.emplace_front(u); }
+    void push_front( const T & u ) { detail::container_guard lock( mutex, "push_front" ); storage.push_front( u ); }
+    void push_front( T && u ) { detail::container_guard lock( mutex, "push_front" ); storage.push_front( std::move( u ) ); }
 
-    void push_front( const T & u ) { std::lock_guard<std::mutex> lock( mutex ); storage.push_front( u ); }
+    void pop_front( void ) { detail::container_guard lock( mutex, "pop_front" ); storage.pop_front(); }
 
-    void pop_front( void ) { std::lock_guard<std::mutex> lock( mutex ); storage.pop_front(); }
+    // Move the first element out and remove it; throws out_of_range when empty
+    T pop_front_value( void ) { detail::container_guard lock( mutex, "pop_front_value" ); if ( storage.empty() ) throw std::out_of_range( "list::pop_front_value" ); T value( std::move( storage.front() ) ); storage.pop_front(); return value; }
+    bool try_pop_front( T & value ) { detail::container_guard lock( mutex, "try_pop_front" ); if ( storage.empty() ) return false; value = std::move( storage.front() ); storage.pop_front(); return true; }
 
-    iterator insert( iterator pos, const T & u ) { std::lock_guard<std::mutex> lock( mutex ); return storage.insert( pos, u ); }
-    void insert( iterator pos, size_type n, const T & u ) { std::lock_guard<std::mutex> lock( mutex ); storage.insert( pos, n, u ); }
-    template <class InputIterator> void insert( iterator pos, InputIterator begin, InputIterator end ) { std::lock_guard<std::mutex> lock( mutex ); storage.insert( pos, begin, end ); }
+    iterator insert( iterator pos, const T & u ) { detail::container_guard lock( mutex, "insert" ); return storage.insert( pos, u ); }
+    iterator insert( iterator pos, T && u ) { detail::container_guard lock( mutex, "insert" ); return storage.insert( pos, std::move( u ) ); }
+    template <class... Args> iterator emplace( iterator pos, Args&&... args ) { detail::container_guard lock( mutex, "emplace" ); return storage.emplace( pos, std::forward<Args>( args )... ); }
+    void insert( iterator pos, size_type n, const T & u ) { detail::container_guard lock( mutex, "insert" ); storage.insert( pos, n, u ); }
+    template <class InputIterator> void insert( iterator pos, InputIterator begin, InputIterator end ) { detail::container_guard lock( mutex, "insert" ); storage.insert( pos, begin, end ); }
 
-    void erase( iterator pos ) { std::lock_guard<std::mutex> lock( mutex ); storage.erase( pos ); }
-    void erase( iterator begin, iterator end ) { std::lock_guard<std::mutex> lock( mutex ); storage.erase( begin, end ); }
+    void erase( iterator pos ) { detail::container_guard lock( mutex, "erase" ); storage.erase( pos ); }
+    void erase( iterator begin, iterator end ) { detail::container_guard lock( mutex, "erase" ); storage.erase( begin, end ); }
 
-    void swap( thread_safe::list<T, Allocator> & x ) { std::lock_guard<std::mutex> lock( mutex ); std::lock_guard<std::mutex> lock2( x.mutex ); storage.swap( x.storage ); }
+    void swap( thread_safe::list<T, Allocator> & x ) { detail::container_pair_guard lock( mutex, x.mutex, "swap" ); storage.swap( x.storage ); }
 
-    void clear( void ) { std::lock_guard<std::mutex> lock( mutex ); storage.clear(); }
+    void clear( void ) { detail::container_guard lock( mutex, "clear" ); storage.clear(); }
 
     // Operations
-    void splice ( iterator position, thread_safe::list<T,Allocator>& x ) { std::lock_guard<std::mutex> lock( mutex ); std::lock_guard<std::mutex> lock2( x.mutex ); storage.splice( position, x.storage ); }
-    void splice ( iterator position, thread_safe::list<T,Allocator>& x, iterator i ) { std::lock_guard<std::mutex> lock( mutex ); std::lock_guard<std::mutex> lock2( x.mutex ); storage.splice( position, x.storage, i ); }
-    void splice ( iterator position, thread_safe::list<T,Allocator>& x, iterator first, iterator last ) { std::lock_guard<std::mutex> lock( mutex ); std::lock_guard<std::mutex> lock2( x.mutex ); storage.splice( position, x.storage, first, last ); }
+    void splice ( iterator position, thread_safe::list<T,Allocator>& x ) { detail::container_pair_guard lock( mutex, x.mutex, "splice" ); storage.splice( position, x.storage ); }
+    void splice ( iterator position, thread_safe::list<T,Allocator>& x, iterator i ) { detail::container_pair_guard lock( mutex, x.mutex, "splice" ); storage.splice( position, x.storage, i ); }
+    void splice ( iterator position, thread_safe::list<T,Allocator>& x, iterator first, iterator last ) { detail::container_pair_guard lock( mutex, x.mutex, "splice" ); storage.splice( position, x.storage, first, last ); }
 
-    void remove ( const T& value ) { std::lock_guard<std::mutex> lock( mutex ); storage.remove( value ); }
+    void remove ( const T& value ) { detail::container_guard lock( mutex, "remove" ); storage.remove( value ); }
 
-    template <class Predicate> void remove_if ( Predicate pred ) { std::lock_guard<std::mutex> lock( mutex ); storage.remove_if( pred ); }
+    template <class Predicate> void remove_if ( Predicate pred ) { detail::container_guard lock( mutex, "remove_if" ); storage.remove_if( pred ); }
 
-    void unique ( void ) { std::lock_guard<std::mutex> lock( mutex ); storage.unique(); }
-    template <class BinaryPredicate> void unique ( BinaryPredicate binary_pred ) { std::lock_guard<std::mutex> lock( mutex ); storage.unique( binary_pred ); }
+    void unique ( void ) { detail::container_guard lock( mutex, "unique" ); storage.unique(); }
+    template <class BinaryPredicate> void unique ( BinaryPredicate binary_pred ) { detail::container_guard lock( mutex, "unique" ); storage.unique( binary_pred ); }
 
-    void merge ( thread_safe::list<T,Allocator>& x ) { std::lock_guard<std::mutex> lock( mutex ); std::lock_guard<std::mutex> lock2( x.mutex ); storage.merge( x.storage() ); }
-    template <class Compare> void merge ( thread_safe::list<T,Allocator>& x, Compare comp ) { std::lock_guard<std::mutex> lock( mutex ); std::lock_guard<std::mutex> lock2( x.mutex ); storage.merge( x.storage, comp ); }
+    void merge ( thread_safe::list<T,Allocator>& x ) { detail::container_pair_guard lock( mutex, x.mutex, "merge" ); storage.merge( x.storage ); }
+    template <class Compare> void merge ( thread_safe::list<T,Allocator>& x, Compare comp ) { detail::container_pair_guard lock( mutex, x.mutex, "merge" ); storage.merge( x.storage, comp ); }
 
-    void sort ( void ) { std::lock_guard<std::mutex> lock( mutex ); storage.sort(); }
-    template <class Compare> void sort ( Compare comp ) { std::lock_guard<std::mutex> lock( mutex ); storage.sort( comp ); }
+    void sort ( void ) { detail::container_guard lock( mutex, "sort" ); storage.sort(); }
+    template <class Compare> void sort ( Compare comp ) { detail::container_guard lock( mutex, "sort" ); storage.sort( comp ); }
 
-    void reverse( void ) { std::lock_guard<std::mutex> lock( mutex ); }
+    void reverse( void ) { detail::container_guard lock( mutex, "reverse" ); storage.reverse(); }
 
     // Allocator
-    allocator_type get_allocator( void ) const { std::lock_guard<std::mutex> lock( mutex ); return storage.get_allocator(); }
+    allocator_type get_allocator( void ) const { detail::container_guard lock( mutex, "get_allocator" ); return storage.get_allocator(); }
+
+    // Locked access to the underlying std container for multi-step operations, see thread_safe_locked.h
+    typedef std::list<T, Allocator> storage_type;
+    locked<storage_type> lock( void ) { return locked<storage_type>( storage, mutex, "lock" ); }
+    locked<const storage_type> lock( void ) const { return locked<const storage_type>( storage, mutex, "lock" ); }
+    template <class Function> typename std::result_of<Function( storage_type & )>::type with_lock( Function fn ) { detail::container_guard lock( mutex, "with_lock" ); return fn( storage ); }
+    template <class Function> typename std::result_of<Function( const storage_type & )>::type with_lock( Function fn ) const { detail::container_guard lock( mutex, "with_lock" ); return fn( storage ); }
+
+    // Lock statistics, empty unless built with THREAD_SAFE_STL_ENABLE_STATS
+    lock_stats stats( void ) const { return detail::stats_of( mutex ); }
+    void set_name( const std::string & name ) { detail::set_name_of( mutex, name ); }
 
 private:
-    std::list<T, Allocator> storage;
-    mutable std::mutex mutex;
+    alignas( hardware_destructive_interference_size ) std::list<T, Allocator> storage;
+    alignas( hardware_destructive_interference_size ) mutable detail::container_mutex mutex;
 };
 
 }
@@ -0,0 +1,306 @@
+/*
+Thread Safe Version STL in C++11
+Copyright(c) 2021
+Author: tashaxing
+*/
+#ifndef THREAD_SAFE_LOCK_STATS_H_INCLUDED
+#define THREAD_SAFE_LOCK_STATS_H_INCLUDED
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "thread_safe_locks.h"
+
+// Define THREAD_SAFE_STL_ENABLE_STATS before including any container header
+// (or pass -DTHREAD_SAFE_STL_ENABLE_STATS) to record lock statistics. Without
+// it every container locks a plain container_lock and stats() returns zeros.
+
+namespace thread_safe {
+
+// Counters of one container operation
+struct lock_op_stats {
+    const char * op;
+    uint64_t calls;
+    uint64_t contended;
+    uint64_t wait_ns;
+};
+
+// Snapshot of the lock of one container, times in nanoseconds
+struct lock_stats {
+    lock_stats( void ) : acquisitions( 0 ), contended( 0 ), wait_ns( 0 ), hold_ns( 0 ), max_hold_ns( 0 ) { }
+
+    std::string name;
+    uint64_t acquisitions;
+    uint64_t contended;             // acquisitions that found the lock taken
+    uint64_t wait_ns;               // total time spent blocked in contended acquisitions
+    uint64_t hold_ns;               // total time the lock was held
+    uint64_t max_hold_ns;
+    std::vector<lock_op_stats> ops; // per operation, in first-use order
+};
+
+namespace detail {
+
+inline uint64_t stats_clock_ns( void ) {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>( std::chrono::steady_clock::now().time_since_epoch() ).count();
+}
+
+class lock_stats_source {
+public:
+    virtual lock_stats counters( void ) const = 0;
+protected:
+    ~lock_stats_source( void ) { }
+};
+
+// Named instrumented locks, so that all of them can be dumped at once.
+// Lock order is registry first, then the container lock.
+class lock_registry {
+public:
+    void add( const lock_stats_source * source, const std::string & name ) {
+        std::lock_guard<std::mutex> lock( mutex );
+        for ( size_t i = 0; i < entries.size(); ++i ) {
+            if ( entries[i].source == source ) {
+                entries[i].name = name;
+                return;
+            }
+        }
+        entry e = { source, name };
+        entries.push_back( e );
+    }
+
+    void remove( const lock_stats_source * source ) {
+        std::lock_guard<std::mutex> lock( mutex );
+        for ( size_t i = 0; i < entries.size(); ++i ) {
+            if ( entries[i].source == source ) {
+                entries.erase( entries.begin() + i );
+                return;
+            }
+        }
+    }
+
+    std::string name_of( const lock_stats_source * source ) {
+        std::lock_guard<std::mutex> lock( mutex );
+        for ( size_t i = 0; i < entries.size(); ++i ) if ( entries[i].source == source ) return entries[i].name;
+        return std::string();
+    }
+
+    std::vector<lock_stats> snapshot( void ) {
+        std::lock_guard<std::mutex> lock( mutex );
+        std::vector<lock_stats> all;
+        for ( size_t i = 0; i < entries.size(); ++i ) {
+            all.push_back( entries[i].source->counters() );
+            all.back().name = entries[i].name;
+        }
+        return all;
+    }
+
+private:
+    struct entry {
+        const lock_stats_source * source;
+        std::string name;
+    };
+
+    std::vector<entry> entries;
+    std::mutex mutex;
+};
+
+// Never destroyed, containers that die during static destruction can still unregister
+inline lock_registry & global_lock_registry( void ) {
+    static lock_registry * registry = new lock_registry();
+    return *registry;
+}
+
+// Wraps a lock and counts acquisitions, contention, wait and hold times, in
+// total and per operation. The counters are only written by the thread that
+// holds the lock, so they need no atomics; stats() reads them under the lock
+// without counting itself.
+template <class Mutex>
+class instrumented_mutex : public lock_stats_source {
+public:
+    static const size_t kMaxOps = 64;
+
+    instrumented_mutex( void ) : registered( false ), op_count( 0 ), hold_start( 0 ) { }
+    ~instrumented_mutex( void ) { if ( registered.load( std::memory_order_relaxed ) ) global_lock_registry().remove( this ); }
+
+    instrumented_mutex( const instrumented_mutex & ) = delete;
+    instrumented_mutex & operator=( const instrumented_mutex & ) = delete;
+
+    void lock( const char * op ) {
+        if ( inner.try_lock() ) {
+            acquired( op, false, 0 );
+            return;
+        }
+        uint64_t start = stats_clock_ns();
+        inner.lock();
+        acquired( op, true, stats_clock_ns() - start );
+    }
+
+    bool try_lock( void ) {
+        if ( !inner.try_lock() ) return false;
+        acquired( "try_lock", false, 0 );
+        return true;
+    }
+
+    void unlock( void ) {
+        uint64_t held = stats_clock_ns() - hold_start;
+        totals.hold_ns += held;
+        if ( held > totals.max_hold_ns ) totals.max_hold_ns = held;
+        inner.unlock();
+    }
+
+    // Lockable, for std::unique_lock and std::lock
+    void lock( void ) { lock( "lock" ); }
+
+    lock_stats counters( void ) const {
+        std::lock_guard<Mutex> lock( inner );
+        lock_stats s = totals;
+        s.ops.assign( ops, ops + op_count );
+        return s;
+    }
+
+    lock_stats stats( void ) const {
+        lock_stats s = counters();
+        if ( registered.load( std::memory_order_acquire ) ) s.name = global_lock_registry().name_of( this );
+        return s;
+    }
+
+    void set_name( const std::string & name ) { global_lock_registry().add( this, name ); registered.store( true, std::memory_order_release ); }
+
+private:
+    void acquired( const char * op, bool contended, uint64_t wait_ns ) {
+        totals.acquisitions++;
+        if ( contended ) {
+            totals.contended++;
+            totals.wait_ns += wait_ns;
+        }
+        lock_op_stats & o = find_op( op );
+        o.calls++;
+        if ( contended ) {
+            o.contended++;
+            o.wait_ns += wait_ns;
+        }
+        hold_start = stats_clock_ns();
+    }
+
+    // Operation names are string literals, almost always found by address;
+    // equal literals from different translation units are merged by content
+    lock_op_stats & find_op( const char * op ) {
+        for ( size_t i = 0; i < op_count; ++i ) if ( ops[i].op == op ) return ops[i];
+        for ( size_t i = 0; i < op_count; ++i ) if ( std::strcmp( ops[i].op, op ) == 0 ) return ops[i];
+        if ( op_count == kMaxOps ) return ops[kMaxOps - 1];
+        lock_op_stats o = { op_count == kMaxOps - 1 ? "other" : op, 0, 0, 0 };
+        ops[op_count] = o;
+        return ops[op_count++];
+    }
+
+    mutable Mutex inner;
+    std::atomic<bool> registered;
+    lock_stats totals;
+    lock_op_stats ops[kMaxOps];
+    size_t op_count;
+    uint64_t hold_start;
+};
+
+// The lock every container takes, see thread_safe_locks.h
+typedef THREAD_SAFE_STL_LOCK container_lock;
+
+#ifdef THREAD_SAFE_STL_ENABLE_STATS
+typedef instrumented_mutex<container_lock> container_mutex;
+#else
+typedef container_lock container_mutex;
+#endif
+
+// Scoped lock taken by every container operation; op names the operation
+// and is ignored unless statistics are enabled
+template <class Mutex>
+class op_guard {
+public:
+    op_guard( Mutex & m, const char * ) : mutex( m ) { mutex.lock(); }
+    ~op_guard( void ) { mutex.unlock(); }
+
+    op_guard( const op_guard & ) = delete;
+    op_guard & operator=( const op_guard & ) = delete;
+private:
+    Mutex & mutex;
+};
+
+template <class Mutex>
+class op_guard< instrumented_mutex<Mutex> > {
+public:
+    op_guard( instrumented_mutex<Mutex> & m, const char * op ) : mutex( m ) { mutex.lock( op ); }
+    ~op_guard( void ) { mutex.unlock(); }
+
+    op_guard( const op_guard & ) = delete;
+    op_guard & operator=( const op_guard & ) = delete;
+private:
+    instrumented_mutex<Mutex> & mutex;
+};
+
+typedef op_guard<container_mutex> container_guard;
+
+// The lock half of op_guard, for guards that can be moved or released early
+template <class Mutex> void lock_op( Mutex & m, const char * ) { m.lock(); }
+template <class Mutex> void lock_op( instrumented_mutex<Mutex> & m, const char * op ) { m.lock( op ); }
+
+// Scoped lock on two containers for swap, operator= and the like. The lower
+// address is locked first, so a.swap( b ) and b.swap( a ) running at the same
+// time cannot deadlock, and a container passed as both is locked once.
+template <class Mutex>
+class pair_op_guard {
+public:
+    pair_op_guard( Mutex & a, Mutex & b, const char * op ) : first( std::less<Mutex *>()( &b, &a ) ? &b : &a ), second( first == &a ? &b : &a ) {
+        lock_op( *first, op );
+        if ( second == first ) return;
+        try {
+            lock_op( *second, op );
+        } catch ( ... ) {
+            first->unlock();
+            throw;
+        }
+    }
+    ~pair_op_guard( void ) {
+        if ( second != first ) second->unlock();
+        first->unlock();
+    }
+
+    pair_op_guard( const pair_op_guard & ) = delete;
+    pair_op_guard & operator=( const pair_op_guard & ) = delete;
+private:
+    Mutex * first;
+    Mutex * second;
+};
+
+typedef pair_op_guard<container_mutex> container_pair_guard;
+
+template <class Mutex> lock_stats stats_of( const Mutex & ) { return lock_stats(); }
+template <class Mutex> lock_stats stats_of( const instrumented_mutex<Mutex> & m ) { return m.stats(); }
+
+template <class Mutex> void set_name_of( Mutex &, const std::string & ) { }
+template <class Mutex> void set_name_of( instrumented_mutex<Mutex> & m, const std::string & name ) { m.set_name( name ); }
+
+}
+
+// Statistics of every container that was given a name with set_name()
+inline std::vector<lock_stats> all_lock_stats( void ) { return detail::global_lock_registry().snapshot(); }
+
+// One line per named container followed by one line per operation
+inline void dump_lock_stats( std::ostream & os ) {
+    std::vector<lock_stats> all = all_lock_stats();
+    for ( size_t i = 0; i < all.size(); ++i ) {
+        const lock_stats & s = all[i];
+        os << s.name << ": acquisitions=" << s.acquisitions << " contended=" << s.contended
+           << " wait_ns=" << s.wait_ns << " hold_ns=" << s.hold_ns << " max_hold_ns=" << s.max_hold_ns << "\n";
+        for ( size_t j = 0; j < s.ops.size(); ++j )
+            os << "  " << s.ops[j].op << ": calls=" << s.ops[j].calls << " contended=" << s.ops[j].contended << " wait_ns=" << s.ops[j].wait_ns << "\n";
+    }
+}
+
+}
+
+#endif // THREAD_SAFE_LOCK_STATS_H_INCLUDED
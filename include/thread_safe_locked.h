@@ -0,0 +1,75 @@
+/*
+Thread Safe Version STL in C++11
+Copyright(c) 2021
+Author: tashaxing
+*/
+#ifndef THREAD_SAFE_LOCKED_H_INCLUDED
+#define THREAD_SAFE_LOCKED_H_INCLUDED
+
+#include <type_traits>
+
+#include "thread_safe_lock_stats.h"
+
+namespace thread_safe {
+
+namespace detail {
+
+// Reaches the lock and storage of any container, for thread_safe_transaction.h
+struct container_access;
+
+}
+
+// The std container inside a thread safe container, with its lock held from
+// construction until the accessor is destroyed or unlock() is called. Every
+// container hands one out from lock(), and with_lock( fn ) runs fn on the
+// std container under the same single acquisition:
+//
+//     thread_safe::map<int, int> m;
+//     m.with_lock( []( std::map<int, int> & raw ) { if ( !raw.count( 1 ) ) raw[1] = raw.size(); } );
+//
+//     auto raw = m.lock();
+//     raw->erase( raw->begin() );
+//
+// Several steps then take the lock once and are atomic as a whole, where the
+// same steps through the wrapper lock once each and let other threads in
+// between. Iterators and references obtained through the accessor must not
+// be used after it is released. lock() and with_lock() on a const container
+// give const access; the lock is still exclusive, as containers hold a plain
+// mutex. Do not call the container's own members while holding its lock.
+template <class Storage>
+class locked {
+public:
+    // Runs before the lock is released, for containers that keep side data in step with the storage
+    typedef void ( * release_hook )( void * );
+
+    locked( Storage & s, detail::container_mutex & m, const char * op, release_hook h = nullptr, void * o = nullptr ) : storage( &s ), mutex( &m ), hook( h ), owner( o ) { detail::lock_op( m, op ); }
+    locked( locked && x ) : storage( x.storage ), mutex( x.mutex ), hook( x.hook ), owner( x.owner ) { x.mutex = nullptr; }
+    ~locked( void ) { unlock(); }
+
+    locked( const locked & ) = delete;
+    locked & operator=( const locked & ) = delete;
+
+    Storage & operator*( void ) const { return *storage; }
+    Storage * operator->( void ) const { return storage; }
+    Storage & get( void ) const { return *storage; }
+
+    bool owns_lock( void ) const { return mutex != nullptr; }
+
+    // Release before the end of the scope, the accessor must not be used afterwards
+    void unlock( void ) {
+        if ( !mutex ) return;
+        if ( hook ) hook( owner );
+        mutex->unlock();
+        mutex = nullptr;
+    }
+
+private:
+    Storage * storage;
+    detail::container_mutex * mutex;
+    release_hook hook;
+    void * owner;
+};
+
+}
+
+#endif // THREAD_SAFE_LOCKED_H_INCLUDED
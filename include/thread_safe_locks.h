@@ -0,0 +1,202 @@
+/*
+Thread Safe Version STL in C++11
+Copyright(c) 2021
+Author: tashaxing
+*/
+#ifndef THREAD_SAFE_LOCKS_H_INCLUDED
+#define THREAD_SAFE_LOCKS_H_INCLUDED
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+
+#include "thread_safe_cache_line.h"
+
+#if defined(__linux__)
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#elif (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#endif
+
+// Locks for critical sections of a few dozen instructions, where std::mutex
+// pays for a kernel round trip that the work itself never needed. All of them
+// are Lockable, so they work with std::lock_guard, std::unique_lock and
+// std::lock, and each sits alone on a cache line so that spinning on it does
+// not slow down the data next to it.
+//
+// Containers lock THREAD_SAFE_STL_LOCK, std::mutex unless defined before the
+// first container header, e.g. -DTHREAD_SAFE_STL_LOCK=thread_safe::spin_lock.
+
+namespace thread_safe {
+
+namespace detail {
+
+// Tell the CPU we are spinning: frees pipeline resources for the sibling
+// hyperthread and avoids the memory order flush when the wait ends
+inline void cpu_relax( void ) {
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+    _mm_pause();
+#elif (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+    _mm_pause();
+#elif (defined(__GNUC__) || defined(__clang__)) && (defined(__aarch64__) || defined(__arm__))
+    __asm__ __volatile__( "yield" );
+#endif
+}
+
+// Exponential backoff for spin loops. After kYieldAfter rounds the waiter
+// also yields its time slice, so a preempted lock holder can run when there
+// are more threads than cores.
+class backoff {
+public:
+    static const unsigned kMaxPauses = 1024;
+    static const unsigned kYieldAfter = 16;
+
+    backoff( void ) : pauses( 1 ), rounds( 0 ) { }
+
+    void wait( void ) {
+        for ( unsigned i = 0; i < pauses; ++i ) cpu_relax();
+        if ( pauses < kMaxPauses ) pauses *= 2;
+        if ( ++rounds >= kYieldAfter ) std::this_thread::yield();
+    }
+
+private:
+    unsigned pauses;
+    unsigned rounds;
+};
+
+}
+
+// Test-and-test-and-set spin lock. Waiters spin on a plain load, which stays
+// in their own cache, and only try the atomic exchange once the lock looks
+// free, backing off exponentially after every failed attempt.
+class alignas( hardware_destructive_interference_size ) spin_lock : public detail::cache_aligned {
+public:
+    spin_lock( void ) : locked( false ) { }
+    spin_lock( const spin_lock & ) = delete;
+    spin_lock & operator=( const spin_lock & ) = delete;
+
+    void lock( void ) {
+        detail::backoff wait;
+        for ( ;; ) {
+            if ( !locked.exchange( true, std::memory_order_acquire ) ) return;
+            while ( locked.load( std::memory_order_relaxed ) ) wait.wait();
+        }
+    }
+
+    bool try_lock( void ) { return !locked.load( std::memory_order_relaxed ) && !locked.exchange( true, std::memory_order_acquire ); }
+
+    void unlock( void ) { locked.store( false, std::memory_order_release ); }
+
+private:
+    std::atomic<bool> locked;
+};
+
+// FIFO spin lock: threads take a ticket and are served in order, so no
+// waiter starves. Waiters back off in proportion to their place in line and
+// yield early: when threads outnumber cores, the next in line is often not
+// running and everyone behind it waits for the scheduler, so prefer
+// spin_lock or adaptive_mutex there.
+class alignas( hardware_destructive_interference_size ) ticket_lock : public detail::cache_aligned {
+public:
+    static const unsigned kPausesPerWaiter = 32;
+    static const unsigned kYieldAfter = 2;
+
+    ticket_lock( void ) : next( 0 ), serving( 0 ) { }
+    ticket_lock( const ticket_lock & ) = delete;
+    ticket_lock & operator=( const ticket_lock & ) = delete;
+
+    void lock( void ) {
+        uint32_t ticket = next.fetch_add( 1, std::memory_order_relaxed );
+        unsigned rounds = 0;
+        for ( ;; ) {
+            uint32_t now = serving.load( std::memory_order_acquire );
+            if ( now == ticket ) return;
+            for ( uint32_t i = ( ticket - now ) * kPausesPerWaiter; i; --i ) detail::cpu_relax();
+            if ( ++rounds >= kYieldAfter ) std::this_thread::yield();
+        }
+    }
+
+    bool try_lock( void ) {
+        uint32_t now = serving.load( std::memory_order_relaxed );
+        uint32_t expected = now;
+        return next.compare_exchange_strong( expected, now + 1, std::memory_order_acquire, std::memory_order_relaxed );
+    }
+
+    // Only the holder writes serving, a plain increment is enough
+    void unlock( void ) { serving.store( serving.load( std::memory_order_relaxed ) + 1, std::memory_order_release ); }
+
+private:
+    std::atomic<uint32_t> next;
+    std::atomic<uint32_t> serving;
+};
+
+// Spins briefly, then sleeps in the kernel. On Linux this is the three state
+// futex mutex (0 free, 1 locked, 2 locked with sleepers; Drepper, "Futexes
+// Are Tricky"), which makes unlock a single exchange unless someone sleeps.
+// Elsewhere it spins on try_lock of a std::mutex before blocking in lock().
+class alignas( hardware_destructive_interference_size ) adaptive_mutex : public detail::cache_aligned {
+public:
+    static const unsigned kSpinRounds = 64;
+
+    adaptive_mutex( const adaptive_mutex & ) = delete;
+    adaptive_mutex & operator=( const adaptive_mutex & ) = delete;
+
+#if defined(__linux__)
+    adaptive_mutex( void ) : state( 0 ) { }
+
+    void lock( void ) {
+        for ( unsigned i = 0; i < kSpinRounds; ++i ) {
+            int s = state.load( std::memory_order_relaxed );
+            if ( s == 0 && state.compare_exchange_weak( s, 1, std::memory_order_acquire, std::memory_order_relaxed ) ) return;
+            if ( s == 2 ) break;  // others already sleep, join them
+            detail::cpu_relax();
+        }
+        while ( state.exchange( 2, std::memory_order_acquire ) != 0 ) futex( FUTEX_WAIT_PRIVATE, 2 );
+    }
+
+    bool try_lock( void ) {
+        int expected = 0;
+        return state.compare_exchange_strong( expected, 1, std::memory_order_acquire, std::memory_order_relaxed );
+    }
+
+    void unlock( void ) { if ( state.exchange( 0, std::memory_order_release ) == 2 ) futex( FUTEX_WAKE_PRIVATE, 1 ); }
+
+private:
+    void futex( int op, int value ) { syscall( SYS_futex, reinterpret_cast<int *>( &state ), op, value, nullptr, nullptr, 0 ); }
+
+    static_assert( sizeof( std::atomic<int> ) == sizeof( int ), "futex needs a plain int" );
+    std::atomic<int> state;
+#else
+    adaptive_mutex( void ) { }
+
+    void lock( void ) {
+        for ( unsigned i = 0; i < kSpinRounds; ++i ) {
+            if ( mutex.try_lock() ) return;
+            detail::cpu_relax();
+        }
+        mutex.lock();
+    }
+
+    bool try_lock( void ) { return mutex.try_lock(); }
+
+    void unlock( void ) { mutex.unlock(); }
+
+private:
+    std::mutex mutex;
+#endif
+};
+
+}
+
+#ifndef THREAD_SAFE_STL_LOCK
+#define THREAD_SAFE_STL_LOCK std::mutex
+#endif
+
+#endif // THREAD_SAFE_LOCKS_H_INCLUDED
@@ -8,11 +8,18 @@ Author: tashaxing
 
 #include <map>
 #include <mutex>
+#include <string>
+#include <tuple>
+#include <utility>
+
+#include "thread_safe_lock_stats.h"
+#include "thread_safe_locked.h"
 
 namespace thread_safe {
 
 template < class Key, class T, class Compare = std::less<Key>, class Allocator = std::allocator<std::pair<const Key,T> > >
-class map {
+class map : public detail::cache_aligned {
+    friend struct detail::container_access;
 public:
     typedef typename std::map<Key, T, Compare, Allocator>::iterator iterator;
     typedef typename std::map<Key, T, Compare, Allocator>::const_iterator const_iterator;
@@ -27,79 +34,111 @@ public:
     // Constructors
     explicit map ( const Compare& comp = Compare(), const Allocator & alloc = Allocator() ) : storage( comp, alloc ) { }
     template <class InputIterator> map ( InputIterator first, InputIterator last, const Compare& comp = Compare(), const Allocator & alloc = Allocator() ) : storage( first, last, comp, alloc ) { }
-    map( const thread_safe::map<Key, T, Compare, Allocator> & x ) : storage( x.storage ) { }
+    map( const thread_safe::map<Key, T, Compare, Allocator> & x ) : storage( x.copy_storage() ) { }
 
     // Copy
-    thread_safe::map<Key, Compare, Allocator> & operator=( const thread_safe::map<Key,Compare,Allocator> & x ) { std::lock_guard<std::mutex> lock( mutex ); std::lock_guard<std::mutex> lock2( x.mutex ); storage = x.storage; return *this; }
+    thread_safe::map<Key, T, Compare, Allocator> & operator=( const thread_safe::map<Key, T, Compare, Allocator> & x ) { detail::container_pair_guard lock( mutex, x.mutex, "operator=" ); storage = x.storage; return *this; }
 
     // Destructor
     ~map( void ) { }
 
     // Iterators
-    iterator begin( void ) { std::lock_guard<std::mutex> lock( mutex ); return storage.begin(); }
-    const_iterator begin( void ) const { std::lock_guard<std::mutex> lock( mutex ); return storage.begin(); }
+    iterator begin( void ) { detail::container_guard lock( mutex, "begin" ); return storage.begin(); }
+    const_iterator begin( void ) const { detail::container_guard lock( mutex, "begin" ); return storage.begin(); }
 
-    iterator end( void ) { std::lock_guard<std::mutex> lock( mutex ); return storage.end(); }
-    const_iterator end( void ) const { std::lock_guard<std::mutex> lock( mutex ); return storage.end(); }
+    iterator end( void ) { detail::container_guard lock( mutex, "end" ); return storage.end(); }
+    const_iterator end( void ) const { detail::container_guard lock( mutex, "end" ); return storage.end(); }
 
-    reverse_iterator rbegin( void ) { std::lock_guard<std::mutex> lock( mutex ); return storage.rbegin(); }
-    const_reverse_iterator rbegin( void ) const { std::lock_guard<std::mutex> lock( mutex ); return storage.rbegin(); }
+    reverse_iterator rbegin( void ) { detail::container_guard lock( mutex, "rbegin" ); return storage.rbegin(); }
+    const_reverse_iterator rbegin( void ) const { detail::container_guard lock( mutex, "rbegin" ); return storage.rbegin(); }
 
-    reverse_iterator rend( void ) { std::lock_guard<std::mutex> lock( mutex ); return storage.rend(); }
-    const_reverse_iterator rend( void ) const { std::lock_guard<std::mutex> lock( mutex ); return storage.rend(); }
+    reverse_iterator rend( void ) { detail::container_guard lock( mutex, "rend" ); return storage.rend(); }
+    const_reverse_iterator rend( void ) const { detail::container_guard lock( mutex, "rend" ); return storage.rend(); }
 
     // Capacity
-    size_type size( void ) const { std::lock_guard<std::mutex> lock( mutex ); return storage.size(); }
+    size_type size( void ) const { detail::container_guard lock( mutex, "size" ); return storage.size(); }
 
-    size_type max_size( void ) const { std::lock_guard<std::mutex> lock( mutex ); return storage.max_size(); }
+    size_type max_size( void ) const { detail::container_guard lock( mutex, "max_size" ); return storage.max_size(); }
 
-    bool empty( void ) const { std::lock_guard<std::mutex> lock( mutex ); return storage.empty(); }
+    bool empty( void ) const { detail::container_guard lock( mutex, "empty" ); return storage.empty(); }
 
     // Element Access
-    T & operator[]( const Key & x ) { std::lock_guard<std::mutex> lock( mutex ); return storage[x]; }
+    T & operator[]( const Key & x ) { detail::container_guard lock( mutex, "operator[]" ); return storage[x]; }
+    T & operator[]( Key && x ) { detail::container_guard lock( mutex, "operator[]" ); return storage[std::move( x )]; }
 
     // Modifiers
-    std::pair<iterator, bool> insert( const value_type & x ) { std::lock_guard<std::mutex> lock( mutex ); return storage.insert( x ); }
-    iterator insert( iterator position, const value_type & x ) { std::lock_guard<std::mutex> lock( mutex ); return storage.insert( position, x ); }
-    template <class InputIterator> void insert( InputIterator first, InputIterator last ) { std::lock_guard<std::mutex> lock( mutex ); storage.insert( first, last ); }
-
-    void erase( iterator pos ) { std::lock_guard<std::mutex> lock( mutex ); storage.erase( pos ); }
-    size_type erase( const Key & x ) { std::lock_guard<std::mutex> lock( mutex ); return storage.erase( x ); }
-    void erase( iterator begin, iterator end ) { std::lock_guard<std::mutex> lock( mutex ); storage.erase( begin, end ); }
-
-    void swap( thread_safe::map<Key, T, Compare, Allocator> & x ) { std::lock_guard<std::mutex> lock( mutex ); std::lock_guard<std::mutex> lock2( x.mutex ); storage.swap( x.storage ); }
-
-    void clear( void ) { std::lock_guard<std::mutex> lock( mutex ); storage.clear(); }
+    std::pair<iterator, bool> insert( const value_type & x ) { detail::container_guard lock( mutex, "insert" ); return storage.insert( x ); }
+    std::pair<iterator, bool> insert( value_type && x ) { detail::container_guard lock( mutex, "insert" ); return storage.insert( std::move( x ) ); }
+    iterator insert( iterator position, const value_type & x ) { detail::container_guard lock( mutex, "insert" ); return storage.insert( position, x ); }
+    template <class InputIterator> void insert( InputIterator first, InputIterator last ) { detail::container_guard lock( mutex, "insert" ); storage.insert( first, last ); }
+
+    template <class... Args> std::pair<iterator, bool> emplace( Args&&... args ) { detail::container_guard lock( mutex, "emplace" ); return storage.emplace( std::forward<Args>( args )... ); }
+
+    // Construct the mapped value from args only if the key is absent, args are left untouched otherwise
+    template <class... Args> std::pair<iterator, bool> try_emplace( const Key & k, Args&&... args ) {
+        detail::container_guard lock( mutex, "try_emplace" );
+        iterator it = storage.lower_bound( k );
+        if ( it != storage.end() && !storage.key_comp()( k, it->first ) ) return std::make_pair( it, false );
+        return std::make_pair( storage.emplace_hint( it, std::piecewise_construct, std::forward_as_tuple( k ), std::forward_as_tuple( std::forward<Args>( args )... ) ), true );
+    }
+    template <class... Args> std::pair<iterator, bool> try_emplace( Key && k, Args&&... args ) {
+        detail::container_guard lock( mutex, "try_emplace" );
+        iterator it = storage.lower_bound( k );
+        if ( it != storage.end() && !storage.key_comp()( k, it->first ) ) return std::make_pair( it, false );
+        return std::make_pair( storage.emplace_hint( it, std::piecewise_construct, std::forward_as_tuple( std::move( k ) ), std::forward_as_tuple( std::forward<Args>( args )... ) ), true );
+    }
+
+    void erase( iterator pos ) { detail::container_guard lock( mutex, "erase" ); storage.erase( pos ); }
+    size_type erase( const Key & x ) { detail::container_guard lock( mutex, "erase" ); return storage.erase( x ); }
+    void erase( iterator begin, iterator end ) { detail::container_guard lock( mutex, "erase" ); storage.erase( begin, end ); }
+
+    void swap( thread_safe::map<Key, T, Compare, Allocator> & x ) { detail::container_pair_guard lock( mutex, x.mutex, "swap" ); storage.swap( x.storage ); }
+
+    void clear( void ) { detail::container_guard lock( mutex, "clear" ); storage.clear(); }
 
     // Observers
-    key_compare key_comp( void ) const { std::lock_guard<std::mutex> lock( mutex ); return storage.key_comp(); }
-    value_compare value_comp( void ) const { std::lock_guard<std::mutex> lock( mutex ); return storage.value_comp(); }
+    key_compare key_comp( void ) const { detail::container_guard lock( mutex, "key_comp" ); return storage.key_comp(); }
+    value_compare value_comp( void ) const { detail::container_guard lock( mutex, "value_comp" ); return storage.value_comp(); }
 
     // Operations
-    const_iterator find( const Key & x ) const { std::lock_guard<std::mutex> lock( mutex ); return storage.find( x ); }
-    iterator find( const Key & x ) { std::lock_guard<std::mutex> lock( mutex ); return storage.find( x ); }
+    const_iterator find( const Key & x ) const { detail::container_guard lock( mutex, "find" ); return storage.find( x ); }
+    iterator find( const Key & x ) { detail::container_guard lock( mutex, "find" ); return storage.find( x ); }
 
-    size_type count( const Key & x ) const { std::lock_guard<std::mutex> lock( mutex ); return storage.count( x ); }
+    size_type count( const Key & x ) const { detail::container_guard lock( mutex, "count" ); return storage.count( x ); }
 
-    const_iterator lower_bound( const Key & x ) const { std::lock_guard<std::mutex> lock( mutex ); return storage.lower_bound( x ); }
-    iterator lower_bound( const Key & x ) { std::lock_guard<std::mutex> lock( mutex ); return storage.lower_bound( x ); }
+    const_iterator lower_bound( const Key & x ) const { detail::container_guard lock( mutex, "lower_bound" ); return storage.lower_bound( x ); }
+    iterator lower_bound( const Key & x ) { detail::container_guard lock( mutex, "lower_bound" ); return storage.lower_bound( x ); }
 
-    const_iterator upper_bound( const Key & x ) const { std::lock_guard<std::mutex> lock( mutex ); return storage.upper_bound( x ); }
-    iterator upper_bound( const Key & x ) { std::lock_guard<std::mutex> lock( mutex ); return storage.upper_bound( x ); }
+    const_iterator upper_bound( const Key & x ) const { detail::container_guard lock( mutex, "upper_bound" ); return storage.upper_bound( x ); }
+    iterator upper_bound( const Key & x ) { detail::container_guard lock( mutex, "upper_bound" ); return storage.upper_bound( x ); }
 
-    std::pair<const_iterator,const_iterator> equal_range( const Key & x ) const { std::lock_guard<std::mutex> lock( mutex ); return storage.equal_range( x ); }
-    std::pair<iterator,iterator> equal_range( const Key & x ) { std::lock_guard<std::mutex> lock( mutex ); return storage.equal_range( x ); }
+    std::pair<const_iterator,const_iterator> equal_range( const Key & x ) const { detail::container_guard lock( mutex, "equal_range" ); return storage.equal_range( x ); }
+    std::pair<iterator,iterator> equal_range( const Key & x ) { detail::container_guard lock( mutex, "equal_range" ); return storage.equal_range( x ); }
 
     // Allocator
-    allocator_type get_allocator( void ) const { std::lock_guard<std::mutex> lock( mutex ); return storage.get_allocator(); }
+    allocator_type get_allocator( void ) const { detail::container_guard lock( mutex, "get_allocator" ); return storage.get_allocator(); }
+
+    // Locked access to the underlying std container for multi-step operations, see thread_safe_locked.h
+    typedef std::map<Key, T, Compare, Allocator> storage_type;
+    locked<storage_type> lock( void ) { return locked<storage_type>( storage, mutex, "lock" ); }
+    locked<const storage_type> lock( void ) const { return locked<const storage_type>( storage, mutex, "lock" ); }
+    template <class Function> typename std::result_of<Function( storage_type & )>::type with_lock( Function fn ) { detail::container_guard lock( mutex, "with_lock" ); return fn( storage ); }
+    template <class Function> typename std::result_of<Function( const storage_type & )>::type with_lock( Function fn ) const { detail::container_guard lock( mutex, "with_lock" ); return fn( storage ); }
+
+    // Lock statistics, empty unless built with THREAD_SAFE_STL_ENABLE_STATS
+    lock_stats stats( void ) const { return detail::stats_of( mutex ); }
+    void set_name( const std::string & name ) { detail::set_name_of( mutex, name ); }
 
 private:
-    std::map<Key, T, Compare, Allocator> storage;
-    mutable std::mutex mutex;
+    storage_type copy_storage( void ) const { detail::container_guard lock( mutex, "copy" ); return storage; }
+
+    alignas( hardware_destructive_interference_size ) std::map<Key, T, Compare, Allocator> storage;
+    alignas( hardware_destructive_interference_size ) mutable detail::container_mutex mutex;
 };
 
 template < class Key, class T, class Compare = std::less<Key>, class Allocator = std::allocator<std::pair<const Key,T> > >
-class multimap {
+class multimap : public detail::cache_aligned {
+    friend struct detail::container_access;
 public:
     typedef typename std::multimap<Key, T, Compare, Allocator>::iterator iterator;
     typedef typename std::multimap<Key, T, Compare, Allocator>::const_iterator const_iterator;
@@ -114,72 +153,88 @@ public:
     // Constructors
     explicit multimap ( const Compare& comp = Compare(), const Allocator & alloc = Allocator() ) : storage( comp, alloc ) { }
     template <class InputIterator> multimap ( InputIterator first, InputIterator last, const Compare& comp = Compare(), const Allocator & alloc = Allocator() ) : storage( first, last, comp, alloc ) { }
-    multimap( const thread_safe::multimap<Key, T, Compare, Allocator> & x ) : storage( x.storage ) { }
+    multimap( const thread_safe::multimap<Key, T, Compare, Allocator> & x ) : storage( x.copy_storage() ) { }
 
     // Copy
-    thread_safe::multimap<Key, Compare, Allocator> & operator=( const thread_safe::multimap<Key,Compare,Allocator> & x ) { std::lock_guard<std::mutex> lock( mutex ); std::lock_guard<std::mutex> lock2( x.mutex ); storage = x.storage; return *this; }
+    thread_safe::multimap<Key, T, Compare, Allocator> & operator=( const thread_safe::multimap<Key, T, Compare, Allocator> & x ) { detail::container_pair_guard lock( mutex, x.mutex, "operator=" ); storage = x.storage; return *this; }
 
     // Destructor
     ~multimap( void ) { }
 
     // Iterators
-    iterator begin( void ) { std::lock_guard<std::mutex> lock( mutex ); return storage.begin(); }
-    const_iterator begin( void ) const { std::lock_guard<std::mutex> lock( mutex ); return storage.begin(); }
+    iterator begin( void ) { detail::container_guard lock( mutex, "begin" ); return storage.begin(); }
+    const_iterator begin( void ) const { detail::container_guard lock( mutex, "begin" ); return storage.begin(); }
 
-    iterator end( void ) { std::lock_guard<std::mutex> lock( mutex ); return storage.end(); }
-    const_iterator end( void ) const { std::lock_guard<std::mutex> lock( mutex ); return storage.end(); }
+    iterator end( void ) { detail::container_guard lock( mutex, "end" ); return storage.end(); }
+    const_iterator end( void ) const { detail::container_guard lock( mutex, "end" ); return storage.end(); }
 
-    reverse_iterator rbegin( void ) { std::lock_guard<std::mutex> lock( mutex ); return storage.rbegin(); }
-    const_reverse_iterator rbegin( void ) const { std::lock_guard<std::mutex> lock( mutex ); return storage.rbegin(); }
+    reverse_iterator rbegin( void ) { detail::container_guard lock( mutex, "rbegin" ); return storage.rbegin(); }
+    const_reverse_iterator rbegin( void ) const { detail::container_guard lock( mutex, "rbegin" ); return storage.rbegin(); }
 
-    reverse_iterator rend( void ) { std::lock_guard<std::mutex> lock( mutex ); return storage.rend(); }
-    const_reverse_iterator rend( void ) const { std::lock_guard<std::mutex> lock( mutex ); return storage.rend(); }
+    reverse_iterator rend( void ) { detail::container_guard lock( mutex, "rend" ); return storage.rend(); }
+    const_reverse_iterator rend( void ) const { detail::container_guard lock( mutex, "rend" ); return storage.rend(); }
 
     // Capacity
-    size_type size( void ) const { std::lock_guard<std::mutex> lock( mutex ); return storage.size(); }
+    size_type size( void ) const { detail::container_guard lock( mutex, "size" ); return storage.size(); }
 
-    size_type max_size( void ) const { std::lock_guard<std::mutex> lock( mutex ); return storage.max_size(); }
+    size_type max_size( void ) const { detail::container_guard lock( mutex, "max_size" ); return storage.max_size(); }
 
-    bool empty( void ) const { std::lock_guard<std::mutex> lock( mutex ); return storage.empty(); }
+    bool empty( void ) const { detail::container_guard lock( mutex, "empty" ); return storage.empty(); }
 
     // Modifiers
-    std::pair<iterator, bool> insert( const value_type & x ) { std::lock_guard<std::mutex> lock( mutex ); return storage.insert( x ); }
-    iterator insert( iterator position, const value_type & x ) { std::lock_guard<std::mutex> lock( mutex ); return storage.insert( position, x ); }
-    template <class InputIterator> void insert( InputIterator first, InputIterator last ) { std::lock_guard<std::mutex> lock( mutex ); storage.insert( first, last ); }
+    iterator insert( const value_type & x ) { detail::container_guard lock( mutex, "insert" ); return storage.insert( x ); }
+    iterator insert( value_type && x ) { detail::container_guard lock( mutex, "insert" ); return storage.insert( std::move( x ) ); }
+    iterator insert( iterator position, const value_type & x ) { detail::container_guard lock( mutex, "insert" ); return storage.insert( position, x ); }
+    template <class InputIterator> void insert( InputIterator first, InputIterator last ) { detail::container_guard lock( mutex, "insert" ); storage.insert( first, last ); }
+
+    template <class... Args> iterator emplace( Args&&... args ) { detail::container_guard lock( mutex, "emplace" ); return storage.emplace( std::forward<Args>( args )... ); }
 
-    void erase( iterator pos ) { std::lock_guard<std::mutex> lock( mutex ); storage.erase( pos ); }
-    size_type erase( const Key & x ) { std::lock_guard<std::mutex> lock( mutex ); return storage.erase( x ); }
-    void erase( iterator begin, iterator end ) { std::lock_guard<std::mutex> lock( mutex ); storage.erase( begin, end ); }
+    void erase( iterator pos ) { detail::container_guard lock( mutex, "erase" ); storage.erase( pos ); }
+    size_type erase( const Key & x ) { detail::container_guard lock( mutex, "erase" ); return storage.erase( x ); }
+    void erase( iterator begin, iterator end ) { detail::container_guard lock( mutex, "erase" ); storage.erase( begin, end ); }
 
-    void swap( thread_safe::multimap<Key, T, Compare, Allocator> & x ) { std::lock_guard<std::mutex> lock( mutex ); std::lock_guard<std::mutex> lock2( x.mutex ); storage.swap( x.storage ); }
+    void swap( thread_safe::multimap<Key, T, Compare, Allocator> & x ) { detail::container_pair_guard lock( mutex, x.mutex, "swap" ); storage.swap( x.storage ); }
 
-    void clear( void ) { std::lock_guard<std::mutex> lock( mutex ); storage.clear(); }
+    void clear( void ) { detail::container_guard lock( mutex, "clear" ); storage.clear(); }
 
     // Observers
-    key_compare key_comp( void ) const { std::lock_guard<std::mutex> lock( mutex ); return storage.key_comp(); }
-    value_compare value_comp( void ) const { std::lock_guard<std::mutex> lock( mutex ); return storage.value_comp(); }
+    key_compare key_comp( void ) const { detail::container_guard lock( mutex, "key_comp" ); return storage.key_comp(); }
+    value_compare value_comp( void ) const { detail::container_guard lock( mutex, "value_comp" ); return storage.value_comp(); }
 
     // Operations
-    const_iterator find( const Key & x ) const { std::lock_guard<std::mutex> lock( mutex ); return storage.find( x ); }
-    iterator find( const Key & x ) { std::lock_guard<std::mutex> lock( mutex ); return storage.find( x ); }
+    const_iterator find( const Key & x ) const { detail::container_guard lock( mutex, "find" ); return storage.find( x ); }
+    iterator find( const Key & x ) { detail::container_guard lock( mutex, "find" ); return storage.find( x ); }
 
-    size_type count( const Key & x ) const { std::lock_guard<std::mutex> lock( mutex ); return storage.count( x ); }
+    size_type count( const Key & x ) const { detail::container_guard lock( mutex, "count" ); return storage.count( x ); }
 
-    const_iterator lower_bound( const Key & x ) const { std::lock_guard<std::mutex> lock( mutex ); return storage.lower_bound( x ); }
-    iterator lower_bound( const Key & x ) { std::lock_guard<std::mutex> lock( mutex ); return storage.lower_bound( x ); }
+    const_iterator lower_bound( const Key & x ) const { detail::container_guard lock( mutex, "lower_bound" ); return storage.lower_bound( x ); }
+    iterator lower_bound( const Key & x ) { detail::container_guard lock( mutex, "lower_bound" ); return storage.lower_bound( x ); }
 
-    const_iterator upper_bound( const Key & x ) const { std::lock_guard<std::mutex> lock( mutex ); return storage.upper_bound( x ); }
-    iterator upper_bound( const Key & x ) { std::lock_guard<std::mutex> lock( mutex ); return storage.upper_bound( x ); }
+    const_iterator upper_bound( const Key & x ) const { detail::container_guard lock( mutex, "upper_bound" ); return storage.upper_bound( x ); }
+    iterator upper_bound( const Key & x ) { detail::container_guard lock( mutex, "upper_bound" ); return storage.upper_bound( x ); }
 
-    std::pair<const_iterator,const_iterator> equal_range( const Key & x ) const { std::lock_guard<std::mutex> lock( mutex ); return storage.equal_range( x ); }
-    std::pair<iterator,iterator> equal_range( const Key & x ) { std::lock_guard<std::mutex> lock( mutex ); return storage.equal_range( x ); }
+    std::pair<const_iterator,const_iterator> equal_range( const Key & x ) const { detail::container_guard lock( mutex, "equal_range" ); return storage.equal_range( x ); }
+    std::pair<iterator,iterator> equal_range( const Key & x ) { detail::container_guard lock( mutex, "equal_range" ); return storage.equal_range( x ); }
 
     // Allocator
-    allocator_type get_allocator( void ) const { std::lock_guard<std::mutex> lock( mutex ); return storage.get_allocator(); }
+    allocator_type get_allocator( void ) const { detail::container_guard lock( mutex, "get_allocator" ); return storage.get_allocator(); }
+
+    // Locked access to the underlying std container for multi-step operations, see thread_safe_locked.h
+    typedef std::multimap<Key, T, Compare, Allocator> storage_type;
+    locked<storage_type> lock( void ) { return locked<storage_type>( storage, mutex, "lock" ); }
+    locked<const storage_type> lock( void ) const { return locked<const storage_type>( storage, mutex, "lock" ); }
+    template <class Function> typename std::result_of<Function( storage_type & )>::type with_lock( Function fn ) { detail::container_guard lock( mutex, "with_lock" ); return fn( storage ); }
+    template <class Function> typename std::result_of<Function( const storage_type & )>::type with_lock( Function fn ) const { detail::container_guard lock( mutex, "with_lock" ); return fn( storage ); }
+
+    // Lock statistics, empty unless built with THREAD_SAFE_STL_ENABLE_STATS
+    lock_stats stats( void ) const { return detail::stats_of( mutex ); }
+    void set_name( const std::string & name ) { detail::set_name_of( mutex, name ); }
 
 private:
-    std::multimap<Key, T, Compare, Allocator> storage;
-    mutable std::mutex mutex;
+    storage_type copy_storage( void ) const { detail::container_guard lock( mutex, "copy" ); return storage; }
+
+    alignas( hardware_destructive_interference_size ) std::multimap<Key, T, Compare, Allocator> storage;
+    alignas( hardware_destructive_interference_size ) mutable detail::container_mutex mutex;
 };
 
 
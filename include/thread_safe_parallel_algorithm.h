@@ -0,0 +1,123 @@
+/*
+Thread Safe Version STL in C++11
+Copyright(c) 2021
+Author: tashaxing
+*/
+#ifndef THREAD_SAFE_PARALLEL_ALGORITHM_H_INCLUDED
+#define THREAD_SAFE_PARALLEL_ALGORITHM_H_INCLUDED
+
+#include <algorithm>
+#include <cstddef>
+#include <functional>
+#include <iterator>
+#include <numeric>
+#include <vector>
+
+#include "thread_safe_thread_pool.h"
+
+namespace thread_safe {
+
+// Chunked algorithms over random access ranges, run on thread_pool::instance()
+// or on the pool passed as first argument. They do no locking of their own;
+// the containers call them under their mutex.
+namespace parallel {
+
+// Ranges shorter than this run on the calling thread only
+const size_t kGrain = 4096;
+
+namespace detail {
+
+// How many pieces to cut n elements into, oversubscribed for load balance
+inline size_t chunk_count( const thread_pool & pool, size_t n, size_t per_thread ) {
+    size_t threads = pool.size() + 1;
+    size_t chunks = std::min( threads * per_thread, n / kGrain );
+    return chunks ? chunks : 1;
+}
+
+inline size_t chunk_begin( size_t n, size_t chunks, size_t i ) { return n / chunks * i + std::min( i, n % chunks ); }
+
+}
+
+template <class RandomIt, class Function>
+void for_each( thread_pool & pool, RandomIt first, RandomIt last, Function fn ) {
+    size_t n = static_cast<size_t>( last - first );
+    size_t chunks = detail::chunk_count( pool, n, 4 );
+    pool.parallel_for( chunks, [&]( size_t i ) {
+        std::for_each( first + detail::chunk_begin( n, chunks, i ), first + detail::chunk_begin( n, chunks, i + 1 ), fn );
+    } );
+}
+
+template <class RandomIt, class OutputRandomIt, class UnaryOperation>
+OutputRandomIt transform( thread_pool & pool, RandomIt first, RandomIt last, OutputRandomIt d_first, UnaryOperation op ) {
+    size_t n = static_cast<size_t>( last - first );
+    size_t chunks = detail::chunk_count( pool, n, 4 );
+    pool.parallel_for( chunks, [&]( size_t i ) {
+        size_t b = detail::chunk_begin( n, chunks, i ), e = detail::chunk_begin( n, chunks, i + 1 );
+        std::transform( first + b, first + e, d_first + b, op );
+    } );
+    return d_first + n;
+}
+
+// op must be associative; partial results are combined left to right
+template <class RandomIt, class T, class BinaryOperation>
+T reduce( thread_pool & pool, RandomIt first, RandomIt last, T init, BinaryOperation op ) {
+    size_t n = static_cast<size_t>( last - first );
+    size_t chunks = detail::chunk_count( pool, n, 1 );
+    if ( chunks == 1 ) return std::accumulate( first, last, init, op );
+
+    std::vector<T> partials( chunks, init );
+    pool.parallel_for( chunks, [&]( size_t i ) {
+        RandomIt b = first + detail::chunk_begin( n, chunks, i ), e = first + detail::chunk_begin( n, chunks, i + 1 );
+        T acc = *b;
+        for ( ++b; b != e; ++b ) acc = op( acc, *b );
+        partials[i] = acc;
+    } );
+    return std::accumulate( partials.begin(), partials.end(), init, op );
+}
+
+// Sort equal slices in parallel, then merge neighbours pairwise, halving the
+// number of runs each round.
+template <class RandomIt, class Compare>
+void sort( thread_pool & pool, RandomIt first, RandomIt last, Compare comp ) {
+    size_t n = static_cast<size_t>( last - first );
+    size_t chunks = detail::chunk_count( pool, n, 1 );
+    if ( chunks == 1 ) { std::sort( first, last, comp ); return; }
+
+    std::vector<size_t> bounds;
+    for ( size_t i = 0; i <= chunks; ++i ) bounds.push_back( detail::chunk_begin( n, chunks, i ) );
+
+    pool.parallel_for( chunks, [&]( size_t i ) { std::sort( first + bounds[i], first + bounds[i + 1], comp ); } );
+
+    while ( bounds.size() > 2 ) {
+        size_t runs = bounds.size() - 1;
+        pool.parallel_for( runs / 2, [&]( size_t i ) {
+            std::inplace_merge( first + bounds[2 * i], first + bounds[2 * i + 1], first + bounds[2 * i + 2], comp );
+        } );
+        std::vector<size_t> merged;
+        for ( size_t i = 0; i < bounds.size(); i += 2 ) merged.push_back( bounds[i] );
+        if ( merged.back() != n ) merged.push_back( n );
+        bounds.swap( merged );
+    }
+}
+
+// Same on the process wide pool
+template <class RandomIt, class Function>
+void for_each( RandomIt first, RandomIt last, Function fn ) { parallel::for_each( thread_pool::instance(), first, last, fn ); }
+
+template <class RandomIt, class OutputRandomIt, class UnaryOperation>
+OutputRandomIt transform( RandomIt first, RandomIt last, OutputRandomIt d_first, UnaryOperation op ) { return parallel::transform( thread_pool::instance(), first, last, d_first, op ); }
+
+template <class RandomIt, class T, class BinaryOperation>
+T reduce( RandomIt first, RandomIt last, T init, BinaryOperation op ) { return parallel::reduce( thread_pool::instance(), first, last, init, op ); }
+
+template <class RandomIt, class Compare>
+void sort( RandomIt first, RandomIt last, Compare comp ) { parallel::sort( thread_pool::instance(), first, last, comp ); }
+
+template <class RandomIt>
+void sort( RandomIt first, RandomIt last ) { parallel::sort( first, last, std::less<typename std::iterator_traits<RandomIt>::value_type>() ); }
+
+}
+
+}
+
+#endif // THREAD_SAFE_PARALLEL_ALGORITHM_H_INCLUDED
@@ -0,0 +1,229 @@
+/*
+Thread Safe Version STL in C++11
+Copyright(c) 2021
+Author: tashaxing
+*/
+#ifndef THREAD_SAFE_POOL_ALLOCATOR_H_INCLUDED
+#define THREAD_SAFE_POOL_ALLOCATOR_H_INCLUDED
+
+#include <cstddef>
+#include <mutex>
+#include <new>
+#include <type_traits>
+#include <vector>
+
+#include "thread_safe_cache_line.h"
+
+namespace thread_safe {
+
+namespace detail {
+
+// Pooled sizes are rounded up to the granule, one size class per granule step
+const size_t kPoolGranule = 16;
+const size_t kPoolMaxSize = 256;
+const size_t kPoolClasses = kPoolMaxSize / kPoolGranule;
+// Nodes move between a thread and the global pool this many at a time
+const size_t kPoolBatch = 64;
+const size_t kPoolChunkBytes = 64 * 1024;
+
+struct pool_node { pool_node * next; };
+
+// Free nodes of one size class shared by all threads. Nodes are carved from
+// 64 KiB chunks that are never returned to the system. Each class sits on
+// its own cache line, threads allocating other sizes do not disturb it.
+class alignas( hardware_destructive_interference_size ) node_pool {
+public:
+    node_pool( void ) : node_size( 0 ), chunk( nullptr ), chunk_used( kPoolChunkBytes ) { }
+
+    void init( size_t size ) { node_size = size; }
+
+    // Hand out a list of up to kPoolBatch nodes, the count goes to n
+    pool_node * take_batch( size_t & n ) {
+        std::lock_guard<std::mutex> lock( mutex );
+        if ( !batches.empty() ) {
+            batch b = batches.back();
+            batches.pop_back();
+            n = b.count;
+            return b.head;
+        }
+        pool_node * head = nullptr;
+        for ( n = 0; n < kPoolBatch; ++n ) {
+            if ( chunk_used + node_size > kPoolChunkBytes ) {
+                chunk = static_cast<char *>( ::operator new( kPoolChunkBytes ) );
+                chunk_used = 0;
+            }
+            pool_node * node = reinterpret_cast<pool_node *>( chunk + chunk_used );
+            chunk_used += node_size;
+            node->next = head;
+            head = node;
+        }
+        return head;
+    }
+
+    void give_batch( pool_node * head, size_t n ) {
+        batch b = { head, n };
+        std::lock_guard<std::mutex> lock( mutex );
+        batches.push_back( b );
+    }
+
+private:
+    struct batch { pool_node * head; size_t count; };
+
+    size_t node_size;
+    char * chunk;
+    size_t chunk_used;
+    std::vector<batch> batches;
+    std::mutex mutex;
+};
+
+// Never destroyed, containers that die during static destruction can still
+// free into it. Static storage rather than new, which ignores over-alignment
+// before C++17.
+inline node_pool & global_node_pool( size_t cls ) {
+    static node_pool * pools = [] {
+        static std::aligned_storage<sizeof( node_pool ), alignof( node_pool )>::type storage[kPoolClasses];
+        node_pool * p = reinterpret_cast<node_pool *>( storage );
+        for ( size_t i = 0; i < kPoolClasses; ++i ) {
+            new ( &p[i] ) node_pool();
+            p[i].init( ( i + 1 ) * kPoolGranule );
+        }
+        return p;
+    }();
+    return pools[cls];
+}
+
+// Per thread free lists. "hot" serves allocations; once it holds a full batch
+// it moves to "spare", and a second full batch goes back to the global pool,
+// so each thread keeps at most two batches per class. Plain data so it stays
+// usable while other thread_local objects are destroyed.
+struct thread_node_cache {
+    struct lists {
+        pool_node * hot;
+        size_t hot_count;
+        pool_node * spare;
+        size_t spare_count;
+    };
+    lists classes[kPoolClasses];
+    bool retired;
+};
+
+inline thread_node_cache & thread_cache( void ) {
+    static thread_local thread_node_cache cache; // zero initialized
+    return cache;
+}
+
+// Hands the thread's cached nodes back to the global pools when the thread exits
+struct thread_cache_flusher {
+    ~thread_cache_flusher( void ) {
+        thread_node_cache & cache = thread_cache();
+        for ( size_t i = 0; i < kPoolClasses; ++i ) {
+            thread_node_cache::lists & l = cache.classes[i];
+            if ( l.hot ) global_node_pool( i ).give_batch( l.hot, l.hot_count );
+            if ( l.spare ) global_node_pool( i ).give_batch( l.spare, l.spare_count );
+            l.hot = l.spare = nullptr;
+            l.hot_count = l.spare_count = 0;
+        }
+        cache.retired = true;
+    }
+};
+
+inline void register_thread_cache( void ) { static thread_local thread_cache_flusher flusher; ( void )flusher; }
+
+inline void * pool_allocate( size_t cls ) {
+    thread_node_cache & cache = thread_cache();
+    if ( cache.retired ) {
+        // thread is exiting, take a batch, keep one node and return the rest
+        size_t n;
+        pool_node * head = global_node_pool( cls ).take_batch( n );
+        if ( n > 1 ) global_node_pool( cls ).give_batch( head->next, n - 1 );
+        return head;
+    }
+    thread_node_cache::lists & l = cache.classes[cls];
+    if ( !l.hot ) {
+        if ( l.spare ) {
+            l.hot = l.spare;
+            l.hot_count = l.spare_count;
+            l.spare = nullptr;
+            l.spare_count = 0;
+        } else {
+            register_thread_cache();
+            l.hot = global_node_pool( cls ).take_batch( l.hot_count );
+        }
+    }
+    pool_node * node = l.hot;
+    l.hot = node->next;
+    --l.hot_count;
+    return node;
+}
+
+inline void pool_deallocate( void * p, size_t cls ) {
+    pool_node * node = static_cast<pool_node *>( p );
+    thread_node_cache & cache = thread_cache();
+    if ( cache.retired ) {
+        node->next = nullptr;
+        global_node_pool( cls ).give_batch( node, 1 );
+        return;
+    }
+    thread_node_cache::lists & l = cache.classes[cls];
+    if ( !l.hot && !l.spare ) register_thread_cache();
+    if ( l.hot_count == kPoolBatch ) {
+        if ( l.spare ) global_node_pool( cls ).give_batch( l.spare, l.spare_count );
+        l.spare = l.hot;
+        l.spare_count = l.hot_count;
+        l.hot = nullptr;
+        l.hot_count = 0;
+    }
+    node->next = l.hot;
+    l.hot = node;
+    ++l.hot_count;
+}
+
+}
+
+// Stateless allocator for node based containers (list, map, set, unordered_*).
+// Single object allocations up to 256 bytes come from per thread free lists
+// refilled from, and drained to, process wide pools in batches, so the common
+// case takes no lock. A node may be freed on any thread. Arrays and larger
+// objects, such as hash buckets or vector storage, go to ::operator new.
+// Pooled memory is reused but never released back to the system.
+template <class T>
+class pool_allocator {
+public:
+    typedef T value_type;
+    typedef T * pointer;
+    typedef const T * const_pointer;
+    typedef T & reference;
+    typedef const T & const_reference;
+    typedef size_t size_type;
+    typedef ptrdiff_t difference_type;
+
+    template <class U> struct rebind { typedef pool_allocator<U> other; };
+
+    pool_allocator( void ) noexcept { }
+    template <class U> pool_allocator( const pool_allocator<U> & ) noexcept { }
+
+    T * allocate( size_type n ) {
+        // n * sizeof( T ) would wrap and hand back a block that is too small
+        if ( n > max_size() ) throw std::bad_array_new_length();
+        if ( n == 1 && pooled() ) return static_cast<T *>( detail::pool_allocate( size_class() ) );
+        return static_cast<T *>( ::operator new( n * sizeof( T ) ) );
+    }
+
+    void deallocate( T * p, size_type n ) {
+        if ( n == 1 && pooled() ) detail::pool_deallocate( p, size_class() );
+        else ::operator delete( p );
+    }
+
+    size_type max_size( void ) const noexcept { return size_type( -1 ) / sizeof( T ); }
+
+private:
+    static bool pooled( void ) { return sizeof( T ) <= detail::kPoolMaxSize && alignof( T ) <= detail::kPoolGranule; }
+    static size_t size_class( void ) { return ( sizeof( T ) + detail::kPoolGranule - 1 ) / detail::kPoolGranule - 1; }
+};
+
+template <class T, class U> bool operator==( const pool_allocator<T> &, const pool_allocator<U> & ) { return true; }
+template <class T, class U> bool operator!=( const pool_allocator<T> &, const pool_allocator<U> & ) { return false; }
+
+}
+
+#endif // THREAD_SAFE_POOL_ALLOCATOR_H_INCLUDED
@@ -10,49 +10,125 @@ Author: tashaxing
 #include <vector>
 #include <deque>
 #include <mutex>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <utility>
+
+#include "thread_safe_chunk_deque.h"
+#include "thread_safe_lock_stats.h"
+#include "thread_safe_locked.h"
 
 namespace thread_safe {
 
+namespace detail {
+
+// std::queue keeps its container protected; this opens it up for shrink_to
+template < class T, class Container >
+struct queue_storage : std::queue<T, Container> {
+    explicit queue_storage( const Container & ctnr ) : std::queue<T, Container>( ctnr ) { }
+    explicit queue_storage( Container && ctnr ) : std::queue<T, Container>( std::move( ctnr ) ) { }
+    Container & container( void ) { return this->c; }
+};
+
+template < class Container > struct is_chunk_deque : std::false_type { };
+template < class T > struct is_chunk_deque< chunk_deque<T> > : std::true_type { };
+
+}
+
+// Container defaults to std::deque. For a queue that does not allocate in
+// steady state use queue<T, thread_safe::chunk_deque<T>>: it recycles storage
+// chunks, so a queue whose length stays within its chunk cache makes no heap
+// allocations, and shrink_to() trims that cache; see thread_safe_chunk_deque.h.
+// It is opt-in because each such queue by default keeps up to 64 KiB of chunks
+// after it drains, and because the default keeps storage_type, and so lock() and
+// with_lock(), the same std::queue<T, std::deque<T>> as before.
 template < class T, class Container = std::deque<T> >
-class queue {
+class queue : public detail::cache_aligned {
+    friend struct detail::container_access;
 public:
-    explicit queue( const Container & ctnr = Container() ) : storage( ctnr ) { }
-    bool empty( void ) const { std::lock_guard<std::mutex> lock( mutex ); return storage.empty(); }
+    explicit queue( const Container & ctnr ) : storage( ctnr ) { }
+    explicit queue( Container && ctnr = Container() ) : storage( std::move( ctnr ) ) { }
+    bool empty( void ) const { detail::container_guard lock( mutex, "empty" ); return storage.empty(); }
 
-    size_t size( void ) const { std::lock_guard<std::mutex> lock( mutex ); return storage.size(); }
+    size_t size( void ) const { detail::container_guard lock( mutex, "size" ); return storage.size(); }
 
-    T & back( void ) { std::lock_guard<std::mutex> lock( mutex ); return storage.back(); }
-    const T & back( void ) const { std::lock_guard<std::mutex> lock( mutex ); return storage.back(); }
+    T & back( void ) { detail::container_guard lock( mutex, "back" ); return storage.back(); }
+    const T & back( void ) const { detail::container_guard lock( mutex, "back" ); return storage.back(); }
 
-    T & front( void ) { std::lock_guard<std::mutex> lock( mutex ); return storage.front(); }
-    const T & front( void ) const { std::lock_guard<std::mutex> lock( mutex ); return storage.front(); }
+    T & front( void ) { detail::container_guard lock( mutex, "front" ); return storage.front(); }
+    const T & front( void ) const { detail::container_guard lock( mutex, "front" ); return storage.front(); }
 
-    void push( const T & u ) { std::lock_guard<std::mutex> lock( mutex ); storage.push( u ); }
+    void push( const T & u ) { detail::container_guard lock( mutex, "push" ); storage.push( u ); }
+    void push( T && u ) { detail::container_guard lock( mutex, "push" ); storage.push( std::move( u ) ); }
+    template <class... Args> void emplace( Args&&... args ) { detail::container_guard lock( mutex, "emplace" ); storage.emplace( std::forward<Args>( args )... ); }
 
-    void pop( void ) { std::lock_guard<std::mutex> lock( mutex ); storage.pop(); }
+    void pop( void ) { detail::container_guard lock( mutex, "pop" ); storage.pop(); }
+
+    // Move the front element out and remove it; throws out_of_range when empty
+    T pop_value( void ) { detail::container_guard lock( mutex, "pop_value" ); if ( storage.empty() ) throw std::out_of_range( "queue::pop_value" ); T value( std::move( storage.front() ) ); storage.pop(); return value; }
+    bool try_pop( T & value ) { detail::container_guard lock( mutex, "try_pop" ); if ( storage.empty() ) return false; value = std::move( storage.front() ); storage.pop(); return true; }
+
+    // Free recycled storage down to bytes; only queue<T, chunk_deque<T>> caches it
+    void shrink_to( size_t bytes ) {
+        static_assert( detail::is_chunk_deque<Container>::value, "queue::shrink_to needs Container = thread_safe::chunk_deque<T>" );
+        detail::container_guard lock( mutex, "shrink_to" );
+        storage.container().shrink_to( bytes );
+    }
+
+    // Locked access to the underlying std container for multi-step operations, see thread_safe_locked.h
+    typedef std::queue<T, Container> storage_type;
+    locked<storage_type> lock( void ) { return locked<storage_type>( storage, mutex, "lock" ); }
+    locked<const storage_type> lock( void ) const { return locked<const storage_type>( storage, mutex, "lock" ); }
+    template <class Function> typename std::result_of<Function( storage_type & )>::type with_lock( Function fn ) { detail::container_guard lock( mutex, "with_lock" ); return fn( storage ); }
+    template <class Function> typename std::result_of<Function( const storage_type & )>::type with_lock( Function fn ) const { detail::container_guard lock( mutex, "with_lock" ); return fn( storage ); }
+
+    // Lock statistics, empty unless built with THREAD_SAFE_STL_ENABLE_STATS
+    lock_stats stats( void ) const { return detail::stats_of( mutex ); }
+    void set_name( const std::string & name ) { detail::set_name_of( mutex, name ); }
 private:
-    std::queue<T, Container> storage;
-    mutable std::mutex mutex;
+    alignas( hardware_destructive_interference_size ) detail::queue_storage<T, Container> storage;
+    alignas( hardware_destructive_interference_size ) mutable detail::container_mutex mutex;
 };
 
 template < class T, class Container = std::vector<T>, class Compare = std::less<typename Container::value_type> >
-class priority_queue {
+class priority_queue : public detail::cache_aligned {
+    friend struct detail::container_access;
 public:
-    explicit priority_queue ( const Compare& x = Compare(), const Container& y = Container() ) : storage( x, y ) { }
+    priority_queue ( const Compare& x, const Container& y ) : storage( x, y ) { }
+    explicit priority_queue ( const Compare& x = Compare(), Container&& y = Container() ) : storage( x, std::move( y ) ) { }
     template <class InputIterator> priority_queue ( InputIterator first, InputIterator last, const Compare& x = Compare(), const Container& y = Container() ) : storage( first, last, x, y ) { }
 
-    bool empty( void ) const { std::lock_guard<std::mutex> lock( mutex ); return storage.empty(); }
+    bool empty( void ) const { detail::container_guard lock( mutex, "empty" ); return storage.empty(); }
+
+    size_t size( void ) const { detail::container_guard lock( mutex, "size" ); return storage.size(); }
+
+    const T & top( void ) const { detail::container_guard lock( mutex, "top" ); return storage.top(); }
+
+    void push( const T & u ) { detail::container_guard lock( mutex, "push" ); storage.push(u); }
+    void push( T && u ) { detail::container_guard lock( mutex, "push" ); storage.push( std::move( u ) ); }
+    template <class... Args> void emplace( Args&&... args ) { detail::container_guard lock( mutex, "emplace" ); storage.emplace( std::forward<Args>( args )... ); }
 
-    size_t size( void ) const { std::lock_guard<std::mutex> lock( mutex ); return storage.size(); }
+    void pop( void ) { detail::container_guard lock( mutex, "pop" ); storage.pop(); }
 
-    const T & top( void ) const { std::lock_guard<std::mutex> lock( mutex ); return storage.top(); }
+    // Move the top element out and remove it; throws out_of_range when empty. top() is
+    // const only to protect the heap order, which pop() restores right after the move.
+    T pop_value( void ) { detail::container_guard lock( mutex, "pop_value" ); if ( storage.empty() ) throw std::out_of_range( "priority_queue::pop_value" ); T value( std::move( const_cast<T &>( storage.top() ) ) ); storage.pop(); return value; }
+    bool try_pop( T & value ) { detail::container_guard lock( mutex, "try_pop" ); if ( storage.empty() ) return false; value = std::move( const_cast<T &>( storage.top() ) ); storage.pop(); return true; }
 
-    void push( const T & u ) { std::lock_guard<std::mutex> lock( mutex ); storage.push(u); }
+    // Locked access to the underlying std container for multi-step operations, see thread_safe_locked.h
+    typedef std::priority_queue< T, Container, Compare > storage_type;
+    locked<storage_type> lock( void ) { return locked<storage_type>( storage, mutex, "lock" ); }
+    locked<const storage_type> lock( void ) const { return locked<const storage_type>( storage, mutex, "lock" ); }
+    template <class Function> typename std::result_of<Function( storage_type & )>::type with_lock( Function fn ) { detail::container_guard lock( mutex, "with_lock" ); return fn( storage ); }
+    template <class Function> typename std::result_of<Function( const storage_type & )>::type with_lock( Function fn ) const { detail::container_guard lock( mutex, "with_lock" ); return fn( storage ); }
 
-    void pop( void ) { std::lock_guard<std::mutex> lock( mutex ); storage.pop(); }
+    // Lock statistics, empty unless built with THREAD_SAFE_STL_ENABLE_STATS
+    lock_stats stats( void ) const { return detail::stats_of( mutex ); }
+    void set_name( const std::string & name ) { detail::set_name_of( mutex, name ); }
 private:
-    std::priority_queue< T, Container, Compare > storage;
-    mutable std::mutex mutex;
+    alignas( hardware_destructive_interference_size ) std::priority_queue< T, Container, Compare > storage;
+    alignas( hardware_destructive_interference_size ) mutable detail::container_mutex mutex;
 };
 
 }
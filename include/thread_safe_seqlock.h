@@ -0,0 +1,183 @@
+/*
+Thread Safe Version STL in C++11
+Copyright(c) 2021
+Author: tashaxing
+*/
+#ifndef THREAD_SAFE_SEQLOCK_H_INCLUDED
+#define THREAD_SAFE_SEQLOCK_H_INCLUDED
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <type_traits>
+
+#include "thread_safe_locks.h"
+
+namespace thread_safe {
+
+namespace detail {
+
+// One value of trivially copyable T kept in relaxed atomic words, guarded by a
+// sequence counter that is odd while a write is in progress. Readers copy the
+// words and retry if the counter moved, so they never write shared memory.
+// Writers take the counter from even to odd with a CAS, which also serializes them.
+// Readers and writers back off between attempts, a writer holding the counter
+// odd may have been preempted.
+// T need not be default constructible, values are copied out through raw storage.
+template <class T>
+class seqlock_cell {
+public:
+    static_assert( std::is_trivially_copyable<T>::value, "seqlock needs a trivially copyable type" );
+
+    static const size_t kWords = ( sizeof( T ) + sizeof( uint64_t ) - 1 ) / sizeof( uint64_t );
+
+    void init( const T & value ) {
+        seq.store( 0, std::memory_order_relaxed );
+        put( value );
+    }
+
+    T load( void ) const {
+        uint64_t buffer[kWords];
+        backoff wait;
+        for ( ;; ) {
+            uint64_t before = seq.load( std::memory_order_acquire );
+            if ( !( before & 1 ) ) { // else a writer is inside
+                for ( size_t i = 0; i < kWords; ++i ) buffer[i] = words[i].load( std::memory_order_relaxed );
+                std::atomic_thread_fence( std::memory_order_acquire );
+                if ( seq.load( std::memory_order_relaxed ) == before ) break;
+            }
+            wait.wait();
+        }
+        return from_words( buffer );
+    }
+
+    void store( const T & value ) { uint64_t s = begin_write(); put( value ); end_write( s ); }
+
+    // Read, modify and write back as one write; fn must not throw
+    template <class Function> T update( Function fn ) {
+        uint64_t s = begin_write();
+        T value = get();
+        fn( value );
+        put( value );
+        end_write( s );
+        return value;
+    }
+
+    // Bumped by two for every completed write
+    uint64_t version( void ) const { return seq.load( std::memory_order_acquire ); }
+
+private:
+    uint64_t begin_write( void ) {
+        uint64_t s = seq.load( std::memory_order_relaxed );
+        backoff wait;
+        for ( ;; ) {
+            if ( !( s & 1 ) && seq.compare_exchange_weak( s, s + 1, std::memory_order_relaxed ) ) break;
+            wait.wait();
+            s = seq.load( std::memory_order_relaxed );
+        }
+        // keep the payload stores below from moving above the odd counter
+        std::atomic_thread_fence( std::memory_order_release );
+        return s;
+    }
+
+    void end_write( uint64_t s ) { seq.store( s + 2, std::memory_order_release ); }
+
+    // only called by the writer holding the counter odd
+    T get( void ) const {
+        uint64_t buffer[kWords];
+        for ( size_t i = 0; i < kWords; ++i ) buffer[i] = words[i].load( std::memory_order_relaxed );
+        return from_words( buffer );
+    }
+
+    static T from_words( const uint64_t * buffer ) {
+        typename std::aligned_storage<sizeof( T ), alignof( T )>::type raw;
+        std::memcpy( &raw, buffer, sizeof( T ) );
+        return *reinterpret_cast<const T *>( &raw );
+    }
+
+    void put( const T & value ) {
+        uint64_t buffer[kWords] = { 0 };
+        std::memcpy( buffer, &value, sizeof( T ) );
+        for ( size_t i = 0; i < kWords; ++i ) words[i].store( buffer[i], std::memory_order_relaxed );
+    }
+
+    std::atomic<uint64_t> seq;
+    std::atomic<uint64_t> words[kWords];
+};
+
+}
+
+// A single value for read mostly data: load() takes no lock and writes
+// nothing, it only retries while a store() is running. Best for small records
+// (a few cache lines at most) that are read far more often than written.
+template <class T>
+class seqlock {
+public:
+    // Constructors
+    seqlock( void ) { cell.init( T() ); }
+    explicit seqlock( const T & value ) { cell.init( value ); }
+
+    seqlock( const thread_safe::seqlock<T> & x ) { cell.init( x.load() ); }
+    thread_safe::seqlock<T> & operator=( const thread_safe::seqlock<T> & x ) { if ( this != &x ) store( x.load() ); return *this; }
+
+    // Access
+    T load( void ) const { return cell.load(); }
+    operator T( void ) const { return cell.load(); }
+
+    void store( const T & value ) { cell.store( value ); }
+    thread_safe::seqlock<T> & operator=( const T & value ) { cell.store( value ); return *this; }
+
+    template <class Function> T update( Function fn ) { return cell.update( fn ); }
+
+    uint64_t version( void ) const { return cell.version(); }
+
+private:
+    detail::seqlock_cell<T> cell;
+};
+
+// Fixed size array with one sequence counter per element, so a write only
+// makes readers of that element retry. Elements are read and written whole;
+// there are no references into the array.
+template <class T, size_t N>
+class seqlock_array {
+public:
+    // Constructors
+    seqlock_array( void ) { for ( size_t i = 0; i < N; ++i ) cells[i].init( T() ); }
+    explicit seqlock_array( const T & value ) { for ( size_t i = 0; i < N; ++i ) cells[i].init( value ); }
+
+    seqlock_array( const thread_safe::seqlock_array<T, N> & ) = delete;
+    thread_safe::seqlock_array<T, N> & operator=( const thread_safe::seqlock_array<T, N> & ) = delete;
+
+    // Element access
+    T operator[]( size_t n ) const { return cells[n].load(); }
+    T load( size_t n ) const { return cells[n].load(); }
+    T at( size_t n ) const { check( n ); return cells[n].load(); }
+
+    // Modifiers
+    void store( size_t n, const T & value ) { cells[n].store( value ); }
+    template <class Function> T update( size_t n, Function fn ) { return cells[n].update( fn ); }
+
+    // Each element is stored atomically, the fill as a whole is not
+    void fill( const T & value ) { for ( size_t i = 0; i < N; ++i ) cells[i].store( value ); }
+
+    // Copy out every element, each one consistent on its own
+    template <class OutputIterator> OutputIterator copy_to( OutputIterator out ) const {
+        for ( size_t i = 0; i < N; ++i ) *out++ = cells[i].load();
+        return out;
+    }
+
+    // Capacity
+    size_t size( void ) const { return N; }
+    bool empty( void ) const { return N == 0; }
+
+private:
+    static void check( size_t n ) { if ( n >= N ) throw std::out_of_range( "seqlock_array::at" ); }
+
+    detail::seqlock_cell<T> cells[N ? N : 1];
+};
+
+}
+
+#endif // THREAD_SAFE_SEQLOCK_H_INCLUDED
@@ -8,11 +8,96 @@ Author: tashaxing
 
 #include <set>
 #include <mutex>
+#include <string>
+#include <atomic>
+#include <algorithm>
+#include <functional>
+#include <iterator>
+#include <utility>
+#include <vector>
+
+#include "thread_safe_bloom_filter.h"
+#include "thread_safe_lock_stats.h"
+#include "thread_safe_locked.h"
+#include "thread_safe_thread_pool.h"
 
 namespace thread_safe {
 
+namespace detail {
+
+struct set_union_op {
+    template <class It, class Out, class Cmp> Out operator()( It first1, It last1, It first2, It last2, Out out, Cmp comp ) const { return std::set_union( first1, last1, first2, last2, out, comp ); }
+};
+
+struct set_intersection_op {
+    template <class It, class Out, class Cmp> Out operator()( It first1, It last1, It first2, It last2, Out out, Cmp comp ) const { return std::set_intersection( first1, last1, first2, last2, out, comp ); }
+};
+
+struct set_difference_op {
+    template <class It, class Out, class Cmp> Out operator()( It first1, It last1, It first2, It last2, Out out, Cmp comp ) const { return std::set_difference( first1, last1, first2, last2, out, comp ); }
+};
+
+// Below this many keys per worker the split is not worth the thread handoff
+const size_t kParallelSetGrain = 16384;
+
+// Merge-style set operation over two sorted trees, into sorted slices that
+// concatenate to the result. The key space is cut at split keys taken from
+// the larger operand, both trees are positioned with lower_bound, and every
+// slice is merged on the thread pool independently. The split keys are found
+// by two walks, one from each end of the larger tree, that run in parallel.
+template <class Tree, class Op>
+std::vector< std::vector<typename Tree::value_type> > parallel_set_slices( const Tree & a, const Tree & b, Op op ) {
+    typedef typename Tree::const_iterator const_iterator;
+    typedef typename Tree::value_type value_type;
+
+    thread_pool & pool = thread_pool::instance();
+    const Tree & larger = a.size() >= b.size() ? a : b;
+    size_t chunks = std::min( pool.size() + 1, larger.size() / kParallelSetGrain );
+    if ( chunks <= 1 ) {
+        std::vector< std::vector<value_type> > whole( 1 );
+        op( a.begin(), a.end(), b.begin(), b.end(), std::back_inserter( whole[0] ), a.key_comp() );
+        return whole;
+    }
+
+    // split key k is the element at k * stride in larger
+    std::vector<const_iterator> splits( chunks );
+    size_t stride = larger.size() / chunks, half = chunks / 2;
+    pool.parallel_for( 2, [&]( size_t from_end ) {
+        if ( !from_end ) {
+            const_iterator it = larger.begin();
+            for ( size_t k = 1; k <= half; ++k ) { std::advance( it, stride ); splits[k] = it; }
+        } else {
+            const_iterator it = larger.end();
+            size_t pos = larger.size();
+            for ( size_t k = chunks - 1; k > half; --k ) {
+                for ( ; pos > k * stride; --pos ) --it;
+                splits[k] = it;
+            }
+        }
+    } );
+
+    std::vector< std::vector<value_type> > parts( chunks );
+    pool.parallel_for( chunks, [&]( size_t i ) {
+        const_iterator a_first = i == 0 ? a.begin() : a.lower_bound( *splits[i] );
+        const_iterator b_first = i == 0 ? b.begin() : b.lower_bound( *splits[i] );
+        const_iterator a_last = i + 1 == chunks ? a.end() : a.lower_bound( *splits[i + 1] );
+        const_iterator b_last = i + 1 == chunks ? b.end() : b.lower_bound( *splits[i + 1] );
+        op( a_first, a_last, b_first, b_last, std::back_inserter( parts[i] ), a.key_comp() );
+    } );
+    return parts;
+}
+
+}
+
 template < class Key, class Compare = std::less<Key>, class Allocator = std::allocator<Key> >
-class set {
+class set : public detail::cache_aligned {
+    friend struct detail::container_access;
+    template <class K, class C, class A> friend thread_safe::set<K, C, A> set_union( const thread_safe::set<K, C, A> & lhs, const thread_safe::set<K, C, A> & rhs );
+    template <class K, class C, class A> friend thread_safe::set<K, C, A> set_intersection( const thread_safe::set<K, C, A> & lhs, const thread_safe::set<K, C, A> & rhs );
+    template <class K, class C, class A> friend thread_safe::set<K, C, A> set_difference( const thread_safe::set<K, C, A> & lhs, const thread_safe::set<K, C, A> & rhs );
+    template <class K, class C, class A, class O> friend O set_union( const thread_safe::set<K, C, A> & lhs, const thread_safe::set<K, C, A> & rhs, O out );
+    template <class K, class C, class A, class O> friend O set_intersection( const thread_safe::set<K, C, A> & lhs, const thread_safe::set<K, C, A> & rhs, O out );
+    template <class K, class C, class A, class O> friend O set_difference( const thread_safe::set<K, C, A> & lhs, const thread_safe::set<K, C, A> & rhs, O out );
 public:
     typedef typename std::set<Key, Compare, Allocator>::iterator iterator;
     typedef typename std::set<Key, Compare, Allocator>::const_iterator const_iterator;
@@ -24,78 +109,220 @@ public:
     typedef typename std::set<Key, Compare, Allocator>::value_compare value_compare;
 
     // Constructors
-    explicit set ( const Compare& comp = Compare(), const Allocator & alloc = Allocator() ) : storage( comp, alloc ) { }
-    template <class InputIterator> set ( InputIterator first, InputIterator last, const Compare& comp = Compare(), const Allocator & alloc = Allocator() ) : storage( first, last, comp, alloc ) { }
-    set( const thread_safe::set<Key, Compare, Allocator> & x ) : storage( x.storage ) { }
+    explicit set ( const Compare& comp = Compare(), const Allocator & alloc = Allocator() ) : storage( comp, alloc ), filter( nullptr ) { }
+    template <class InputIterator> set ( InputIterator first, InputIterator last, const Compare& comp = Compare(), const Allocator & alloc = Allocator() ) : storage( first, last, comp, alloc ), filter( nullptr ) { }
+    set( const thread_safe::set<Key, Compare, Allocator> & x ) : storage( x.copy_storage() ), filter( nullptr ) { }
 
     // Copy
-    thread_safe::set<Key, Compare, Allocator> & operator=( const thread_safe::set<Key,Compare,Allocator> & x ) { std::lock_guard<std::mutex> lock( mutex ); std::lock_guard<std::mutex> lock2( x.mutex ); storage = x.storage; return *this; }
+    thread_safe::set<Key, Compare, Allocator> & operator=( const thread_safe::set<Key,Compare,Allocator> & x ) { detail::container_pair_guard lock( mutex, x.mutex, "operator=" ); storage = x.storage; filter_add_all(); return *this; }
 
     // Destructor
-    ~set( void ) { }
+    ~set( void ) { delete filter.load(); }
 
     // Iterators
-    iterator begin( void ) { std::lock_guard<std::mutex> lock( mutex ); return storage.begin(); }
-    const_iterator begin( void ) const { std::lock_guard<std::mutex> lock( mutex ); return storage.begin(); }
+    iterator begin( void ) { detail::container_guard lock( mutex, "begin" ); return storage.begin(); }
+    const_iterator begin( void ) const { detail::container_guard lock( mutex, "begin" ); return storage.begin(); }
 
-    iterator end( void ) { std::lock_guard<std::mutex> lock( mutex ); return storage.end(); }
-    const_iterator end( void ) const { std::lock_guard<std::mutex> lock( mutex ); return storage.end(); }
+    iterator end( void ) { detail::container_guard lock( mutex, "end" ); return storage.end(); }
+    const_iterator end( void ) const { detail::container_guard lock( mutex, "end" ); return storage.end(); }
 
-    reverse_iterator rbegin( void ) { std::lock_guard<std::mutex> lock( mutex ); return storage.rbegin(); }
-    const_reverse_iterator rbegin( void ) const { std::lock_guard<std::mutex> lock( mutex ); return storage.rbegin(); }
+    reverse_iterator rbegin( void ) { detail::container_guard lock( mutex, "rbegin" ); return storage.rbegin(); }
+    const_reverse_iterator rbegin( void ) const { detail::container_guard lock( mutex, "rbegin" ); return storage.rbegin(); }
 
-    reverse_iterator rend( void ) { std::lock_guard<std::mutex> lock( mutex ); return storage.rend(); }
-    const_reverse_iterator rend( void ) const { std::lock_guard<std::mutex> lock( mutex ); return storage.rend(); }
+    reverse_iterator rend( void ) { detail::container_guard lock( mutex, "rend" ); return storage.rend(); }
+    const_reverse_iterator rend( void ) const { detail::container_guard lock( mutex, "rend" ); return storage.rend(); }
 
     // Capacity
-    size_type size( void ) const { std::lock_guard<std::mutex> lock( mutex ); return storage.size(); }
+    size_type size( void ) const { detail::container_guard lock( mutex, "size" ); return storage.size(); }
 
-    size_type max_size( void ) const { std::lock_guard<std::mutex> lock( mutex ); return storage.max_size(); }
+    size_type max_size( void ) const { detail::container_guard lock( mutex, "max_size" ); return storage.max_size(); }
 
-    bool empty( void ) const { std::lock_guard<std::mutex> lock( mutex ); return storage.empty(); }
+    bool empty( void ) const { detail::container_guard lock( mutex, "empty" ); return storage.empty(); }
 
     // Modifiers
-    std::pair<iterator, bool> insert( const Key & x ) { std::lock_guard<std::mutex> lock( mutex ); return storage.insert( x ); }
-    iterator insert( iterator position, const Key & x ) { std::lock_guard<std::mutex> lock( mutex ); return storage.insert( position, x ); }
-    template <class InputIterator> void insert( InputIterator first, InputIterator last ) { std::lock_guard<std::mutex> lock( mutex ); storage.insert( first, last ); }
+    std::pair<iterator, bool> insert( const Key & x ) { detail::container_guard lock( mutex, "insert" ); filter_add( x ); return storage.insert( x ); }
+    std::pair<iterator, bool> insert( Key && x ) { detail::container_guard lock( mutex, "insert" ); filter_add( x ); return storage.insert( std::move( x ) ); }
+    template <class... Args> std::pair<iterator, bool> emplace( Args&&... args ) { detail::container_guard lock( mutex, "emplace" ); std::pair<iterator, bool> result = storage.emplace( std::forward<Args>( args )... ); filter_add( *result.first ); return result; }
+    iterator insert( iterator position, const Key & x ) { detail::container_guard lock( mutex, "insert" ); filter_add( x ); return storage.insert( position, x ); }
+    template <class InputIterator> void insert( InputIterator first, InputIterator last ) { detail::container_guard lock( mutex, "insert" ); for ( ; first != last; ++first ) filter_add( *storage.insert( storage.end(), *first ) ); }
 
-    void erase( iterator pos ) { std::lock_guard<std::mutex> lock( mutex ); storage.erase( pos ); }
-    size_type erase( const Key & x ) { std::lock_guard<std::mutex> lock( mutex ); return storage.erase( x ); }
-    void erase( iterator begin, iterator end ) { std::lock_guard<std::mutex> lock( mutex ); storage.erase( begin, end ); }
+    void erase( iterator pos ) { detail::container_guard lock( mutex, "erase" ); storage.erase( pos ); }
+    size_type erase( const Key & x ) { detail::container_guard lock( mutex, "erase" ); return storage.erase( x ); }
+    void erase( iterator begin, iterator end ) { detail::container_guard lock( mutex, "erase" ); storage.erase( begin, end ); }
 
-    void swap( thread_safe::set<Key, Compare, Allocator> & x ) { std::lock_guard<std::mutex> lock( mutex ); std::lock_guard<std::mutex> lock2( x.mutex ); storage.swap( x.storage ); }
+    void swap( thread_safe::set<Key, Compare, Allocator> & x ) { detail::container_pair_guard lock( mutex, x.mutex, "swap" ); storage.swap( x.storage ); filter_invalidate(); x.filter_invalidate(); }
 
-    void clear( void ) { std::lock_guard<std::mutex> lock( mutex ); storage.clear(); }
+    void clear( void ) { detail::container_guard lock( mutex, "clear" ); storage.clear(); filter_clear(); }
 
     // Observers
-    key_compare key_comp( void ) const { std::lock_guard<std::mutex> lock( mutex ); return storage.key_comp(); }
-    value_compare value_comp( void ) const { std::lock_guard<std::mutex> lock( mutex ); return storage.value_comp(); }
+    key_compare key_comp( void ) const { detail::container_guard lock( mutex, "key_comp" ); return storage.key_comp(); }
+    value_compare value_comp( void ) const { detail::container_guard lock( mutex, "value_comp" ); return storage.value_comp(); }
 
     // Operations
-    const_iterator find( const Key & x ) const { std::lock_guard<std::mutex> lock( mutex ); return storage.find( x ); }
-    iterator find( const Key & x ) { std::lock_guard<std::mutex> lock( mutex ); return storage.find( x ); }
+    const_iterator find( const Key & x ) const { detail::container_guard lock( mutex, "find" ); return storage.find( x ); }
+    iterator find( const Key & x ) { detail::container_guard lock( mutex, "find" ); return storage.find( x ); }
 
-    size_type count( const Key & x ) const { std::lock_guard<std::mutex> lock( mutex ); return storage.count( x ); }
+    size_type count( const Key & x ) const {
+        key_filter * f = filter.load( std::memory_order_acquire );
+        if ( f && !f->stale.load( std::memory_order_acquire ) && !f->bits.may_contain_hash( f->hash( x ) ) ) return 0; // definite miss, no lock taken
+        detail::container_guard lock( mutex, "count" );
+        filter_refresh();
+        size_type n = storage.count( x );
+        if ( f && n == 0 ) f->bits.record_false_positive();
+        return n;
+    }
 
-    const_iterator lower_bound( const Key & x ) const { std::lock_guard<std::mutex> lock( mutex ); return storage.lower_bound( x ); }
-    iterator lower_bound( const Key & x ) { std::lock_guard<std::mutex> lock( mutex ); return storage.lower_bound( x ); }
+    const_iterator lower_bound( const Key & x ) const { detail::container_guard lock( mutex, "lower_bound" ); return storage.lower_bound( x ); }
+    iterator lower_bound( const Key & x ) { detail::container_guard lock( mutex, "lower_bound" ); return storage.lower_bound( x ); }
 
-    const_iterator upper_bound( const Key & x ) const { std::lock_guard<std::mutex> lock( mutex ); return storage.upper_bound( x ); }
-    iterator upper_bound( const Key & x ) { std::lock_guard<std::mutex> lock( mutex ); return storage.upper_bound( x ); }
+    const_iterator upper_bound( const Key & x ) const { detail::container_guard lock( mutex, "upper_bound" ); return storage.upper_bound( x ); }
+    iterator upper_bound( const Key & x ) { detail::container_guard lock( mutex, "upper_bound" ); return storage.upper_bound( x ); }
 
-    std::pair<const_iterator,const_iterator> equal_range( const Key & x ) const { std::lock_guard<std::mutex> lock( mutex ); return storage.equal_range( x ); }
-    std::pair<iterator,iterator> equal_range( const Key & x ) { std::lock_guard<std::mutex> lock( mutex ); return storage.equal_range( x ); }
+    std::pair<const_iterator,const_iterator> equal_range( const Key & x ) const { detail::container_guard lock( mutex, "equal_range" ); return storage.equal_range( x ); }
+    std::pair<iterator,iterator> equal_range( const Key & x ) { detail::container_guard lock( mutex, "equal_range" ); return storage.equal_range( x ); }
 
     // Allocator
-    allocator_type get_allocator( void ) const { std::lock_guard<std::mutex> lock( mutex ); return storage.get_allocator(); }
+    allocator_type get_allocator( void ) const { detail::container_guard lock( mutex, "get_allocator" ); return storage.get_allocator(); }
+
+    // Bloom filter
+    // Front count() with a lock-free filter so that most negative lookups skip the mutex.
+    // The filter is sized for max(expected_keys, size()) and cannot be disabled again.
+    // Erased keys stay in the filter until clear(), they only cost extra false positives.
+    // Mutable lock() and with_lock() cannot see what was inserted, so releasing them marks the
+    // filter stale: count() takes the lock until the next count() re-adds every key under it.
+    // Hash must agree with Compare: keys Compare treats as equivalent must hash alike, or count()
+    // misses keys the set holds. A case-insensitive Compare needs a case-insensitive Hash.
+    template <class Hash = std::hash<Key> >
+    void enable_bloom_filter( size_type expected_keys, double false_positive_rate = 0.01 ) {
+        detail::container_guard lock( mutex, "enable_bloom_filter" );
+        if ( filter.load( std::memory_order_relaxed ) ) return;
+        key_filter * f = new key_filter( std::max( expected_keys, storage.size() ), false_positive_rate, &hash_key<Hash> );
+        for ( const_iterator it = storage.begin(); it != storage.end(); ++it ) f->bits.add_hash( f->hash( *it ) );
+        filter.store( f, std::memory_order_release );
+    }
+
+    bool bloom_filter_enabled( void ) const { return filter.load( std::memory_order_acquire ) != nullptr; }
+
+    bloom_filter_stats bloom_stats( void ) const {
+        key_filter * f = filter.load( std::memory_order_acquire );
+        if ( f ) return f->bits.stats();
+        bloom_filter_stats empty = bloom_filter_stats();
+        return empty;
+    }
+
+    // Locked access to the underlying std container for multi-step operations, see thread_safe_locked.h
+    typedef std::set< Key, Compare, Allocator > storage_type;
+    locked<storage_type> lock( void ) { return locked<storage_type>( storage, mutex, "lock", &invalidate_filter, this ); }
+    locked<const storage_type> lock( void ) const { return locked<const storage_type>( storage, mutex, "lock" ); }
+    template <class Function> typename std::result_of<Function( storage_type & )>::type with_lock( Function fn ) { locked<storage_type> access( storage, mutex, "with_lock", &invalidate_filter, this ); return fn( storage ); }
+    template <class Function> typename std::result_of<Function( const storage_type & )>::type with_lock( Function fn ) const { detail::container_guard lock( mutex, "with_lock" ); return fn( storage ); }
+
+    // Lock statistics, empty unless built with THREAD_SAFE_STL_ENABLE_STATS
+    lock_stats stats( void ) const { return detail::stats_of( mutex ); }
+    void set_name( const std::string & name ) { detail::set_name_of( mutex, name ); }
 
 private:
-    std::set< Key, Compare, Allocator > storage;
-    mutable std::mutex mutex;
+    storage_type copy_storage( void ) const { detail::container_guard lock( mutex, "copy" ); return storage; }
+
+    struct key_filter : detail::cache_aligned {
+        key_filter( size_t expected_keys, double false_positive_rate, size_t (*h)( const Key & ) ) : bits( expected_keys, false_positive_rate ), hash( h ), stale( false ) { }
+        bloom_filter bits;
+        size_t (*hash)( const Key & );
+        std::atomic<bool> stale; // keys may be missing, set by mutable lock() and with_lock()
+    };
+
+    template <class Hash> static size_t hash_key( const Key & x ) { return Hash()( x ); }
+
+    // Merge under both locks (deadlock-free, in any argument order) for a
+    // consistent view. Returns an empty tree with lhs's comparator and
+    // allocator, read under the same locks, to build a result in.
+    template <class Op>
+    static storage_type merge_slices( const thread_safe::set<Key, Compare, Allocator> & lhs, const thread_safe::set<Key, Compare, Allocator> & rhs, Op op, std::vector< std::vector<Key> > & parts ) {
+        detail::container_pair_guard lock( lhs.mutex, rhs.mutex, "combine" );
+        parts = detail::parallel_set_slices( lhs.storage, rhs.storage, op );
+        return storage_type( lhs.storage.key_comp(), lhs.storage.get_allocator() );
+    }
+
+    // Building the result tree allocates a node per key on one thread, so it
+    // runs after the operands' locks are released
+    template <class Op>
+    static thread_safe::set<Key, Compare, Allocator> combine( const thread_safe::set<Key, Compare, Allocator> & lhs, const thread_safe::set<Key, Compare, Allocator> & rhs, Op op ) {
+        std::vector< std::vector<Key> > parts;
+        storage_type empty( merge_slices( lhs, rhs, op, parts ) );
+        thread_safe::set<Key, Compare, Allocator> result( empty.key_comp(), empty.get_allocator() );
+        // slices are ordered, so every insert is an amortized O(1) hinted append
+        for ( size_t i = 0; i < parts.size(); ++i )
+            for ( size_t j = 0; j < parts[i].size(); ++j ) result.storage.insert( result.storage.end(), std::move( parts[i][j] ) );
+        return result;
+    }
+
+    template <class Op, class OutputIterator>
+    static OutputIterator combine( const thread_safe::set<Key, Compare, Allocator> & lhs, const thread_safe::set<Key, Compare, Allocator> & rhs, Op op, OutputIterator out ) {
+        std::vector< std::vector<Key> > parts;
+        merge_slices( lhs, rhs, op, parts );
+        for ( size_t i = 0; i < parts.size(); ++i ) out = std::move( parts[i].begin(), parts[i].end(), out );
+        return out;
+    }
+
+    // the helpers below are called with the mutex held
+    void filter_add( const Key & x ) const { key_filter * f = filter.load( std::memory_order_relaxed ); if ( f ) f->bits.add_hash( f->hash( x ) ); }
+    void filter_add_all( void ) const { if ( filter.load( std::memory_order_relaxed ) ) for ( const_iterator it = storage.begin(); it != storage.end(); ++it ) filter_add( *it ); }
+    void filter_clear( void ) { key_filter * f = filter.load( std::memory_order_relaxed ); if ( f ) { f->bits.clear(); f->stale.store( false, std::memory_order_release ); } }
+
+    // Storage changed behind the filter's back, count() rebuilds it on first use
+    void filter_invalidate( void ) { key_filter * f = filter.load( std::memory_order_relaxed ); if ( f ) f->stale.store( true, std::memory_order_release ); }
+    static void invalidate_filter( void * self ) { static_cast<set *>( self )->filter_invalidate(); }
+    void filter_refresh( void ) const {
+        key_filter * f = filter.load( std::memory_order_relaxed );
+        if ( !f || !f->stale.load( std::memory_order_relaxed ) ) return;
+        filter_add_all();
+        f->stale.store( false, std::memory_order_release );
+    }
+
+    alignas( hardware_destructive_interference_size ) std::set< Key, Compare, Allocator > storage;
+    alignas( hardware_destructive_interference_size ) mutable detail::container_mutex mutex;
+    alignas( hardware_destructive_interference_size ) std::atomic<key_filter *> filter; // read without the lock
 };
 
+// Set algebra, split across the shared thread pool for large operands
+template <class Key, class Compare, class Allocator>
+thread_safe::set<Key, Compare, Allocator> set_union( const thread_safe::set<Key, Compare, Allocator> & lhs, const thread_safe::set<Key, Compare, Allocator> & rhs ) {
+    return thread_safe::set<Key, Compare, Allocator>::combine( lhs, rhs, detail::set_union_op() );
+}
+
+template <class Key, class Compare, class Allocator>
+thread_safe::set<Key, Compare, Allocator> set_intersection( const thread_safe::set<Key, Compare, Allocator> & lhs, const thread_safe::set<Key, Compare, Allocator> & rhs ) {
+    return thread_safe::set<Key, Compare, Allocator>::combine( lhs, rhs, detail::set_intersection_op() );
+}
+
+template <class Key, class Compare, class Allocator>
+thread_safe::set<Key, Compare, Allocator> set_difference( const thread_safe::set<Key, Compare, Allocator> & lhs, const thread_safe::set<Key, Compare, Allocator> & rhs ) {
+    return thread_safe::set<Key, Compare, Allocator>::combine( lhs, rhs, detail::set_difference_op() );
+}
+
+// The same into an output iterator, in sorted order. This skips building a
+// result tree, which is the part that does not run in parallel:
+//
+//     std::vector<int> both;
+//     thread_safe::set_intersection( a, b, std::back_inserter( both ) );
+template <class Key, class Compare, class Allocator, class OutputIterator>
+OutputIterator set_union( const thread_safe::set<Key, Compare, Allocator> & lhs, const thread_safe::set<Key, Compare, Allocator> & rhs, OutputIterator out ) {
+    return thread_safe::set<Key, Compare, Allocator>::combine( lhs, rhs, detail::set_union_op(), out );
+}
+
+template <class Key, class Compare, class Allocator, class OutputIterator>
+OutputIterator set_intersection( const thread_safe::set<Key, Compare, Allocator> & lhs, const thread_safe::set<Key, Compare, Allocator> & rhs, OutputIterator out ) {
+    return thread_safe::set<Key, Compare, Allocator>::combine( lhs, rhs, detail::set_intersection_op(), out );
+}
+
+template <class Key, class Compare, class Allocator, class OutputIterator>
+OutputIterator set_difference( const thread_safe::set<Key, Compare, Allocator> & lhs, const thread_safe::set<Key, Compare, Allocator> & rhs, OutputIterator out ) {
+    return thread_safe::set<Key, Compare, Allocator>::combine( lhs, rhs, detail::set_difference_op(), out );
+}
+
 template < class Key, class Compare = std::less<Key>, class Allocator = std::allocator<Key> >
-class multiset {
+class multiset : public detail::cache_aligned {
+    friend struct detail::container_access;
 public:
     typedef typename std::multiset<Key, Compare, Allocator>::iterator iterator;
     typedef typename std::multiset<Key, Compare, Allocator>::const_iterator const_iterator;
@@ -109,74 +336,89 @@ public:
     // Constructors
     explicit multiset ( const Compare& comp = Compare(), const Allocator & alloc = Allocator() ) : storage( comp, alloc ) { }
     template <class InputIterator>multiset ( InputIterator first, InputIterator last, const Compare& comp = Compare(), const Allocator & alloc = Allocator() ) : storage( first, last, comp, alloc ) { }
-    multiset( const thread_safe::multiset<Key, Compare, Allocator> & x ) : storage( x.storage ) { }
+    multiset( const thread_safe::multiset<Key, Compare, Allocator> & x ) : storage( x.copy_storage() ) { }
 
     // Copy
-    thread_safe::multiset<Key, Compare, Allocator> & operator=( const thread_safe::multiset<Key,Compare,Allocator> & x ) { std::lock_guard<std::mutex> lock( mutex ); std::lock_guard<std::mutex> lock2( x.mutex ); storage = x.storage; return *this; }
+    thread_safe::multiset<Key, Compare, Allocator> & operator=( const thread_safe::multiset<Key,Compare,Allocator> & x ) { detail::container_pair_guard lock( mutex, x.mutex, "operator=" ); storage = x.storage; return *this; }
 
     // Destructor
     ~multiset( void ) { }
 
     // Iterators
-    iterator begin( void ) { std::lock_guard<std::mutex> lock( mutex ); return storage.begin(); }
-    const_iterator begin( void ) const { std::lock_guard<std::mutex> lock( mutex ); return storage.begin(); }
+    iterator begin( void ) { detail::container_guard lock( mutex, "begin" ); return storage.begin(); }
+    const_iterator begin( void ) const { detail::container_guard lock( mutex, "begin" ); return storage.begin(); }
 
-    iterator end( void ) { std::lock_guard<std::mutex> lock( mutex ); return storage.end(); }
-    const_iterator end( void ) const { std::lock_guard<std::mutex> lock( mutex ); return storage.end(); }
+    iterator end( void ) { detail::container_guard lock( mutex, "end" ); return storage.end(); }
+    const_iterator end( void ) const { detail::container_guard lock( mutex, "end" ); return storage.end(); }
 
-    reverse_iterator rbegin( void ) { std::lock_guard<std::mutex> lock( mutex ); return storage.rbegin(); }
-    const_reverse_iterator rbegin( void ) const { std::lock_guard<std::mutex> lock( mutex ); return storage.rbegin(); }
+    reverse_iterator rbegin( void ) { detail::container_guard lock( mutex, "rbegin" ); return storage.rbegin(); }
+    const_reverse_iterator rbegin( void ) const { detail::container_guard lock( mutex, "rbegin" ); return storage.rbegin(); }
 
-    reverse_iterator rend( void ) { std::lock_guard<std::mutex> lock( mutex ); return storage.rend(); }
-    const_reverse_iterator rend( void ) const { std::lock_guard<std::mutex> lock( mutex ); return storage.rend(); }
+    reverse_iterator rend( void ) { detail::container_guard lock( mutex, "rend" ); return storage.rend(); }
+    const_reverse_iterator rend( void ) const { detail::container_guard lock( mutex, "rend" ); return storage.rend(); }
 
     // Capacity
-    size_type size( void ) const { std::lock_guard<std::mutex> lock( mutex ); return storage.size(); }
+    size_type size( void ) const { detail::container_guard lock( mutex, "size" ); return storage.size(); }
 
-    size_type max_size( void ) const { std::lock_guard<std::mutex> lock( mutex ); return storage.max_size(); }
+    size_type max_size( void ) const { detail::container_guard lock( mutex, "max_size" ); return storage.max_size(); }
 
-    bool empty( void ) const { std::lock_guard<std::mutex> lock( mutex ); return storage.empty(); }
+    bool empty( void ) const { detail::container_guard lock( mutex, "empty" ); return storage.empty(); }
 
-    void reserve(size_type n) { std::lock_guard<std::mutex> lock(mutex); storage.reserve(n); }
+    void reserve(size_type n) { detail::container_guard lock(mutex, "reserve"); storage.reserve(n); }
 
     // Modifiers
-    std::pair<iterator, bool> insert( const Key & x ) { std::lock_guard<std::mutex> lock( mutex ); return storage.insert( x ); }
-    iterator insert( iterator position, const Key & x ) { std::lock_guard<std::mutex> lock( mutex ); return storage.insert( position, x ); }
-    template <class InputIterator> void insert( InputIterator first, InputIterator last ) { std::lock_guard<std::mutex> lock( mutex ); storage.insert( first, last ); }
+    iterator insert( const Key & x ) { detail::container_guard lock( mutex, "insert" ); return storage.insert( x ); }
+    iterator insert( Key && x ) { detail::container_guard lock( mutex, "insert" ); return storage.insert( std::move( x ) ); }
+    template <class... Args> iterator emplace( Args&&... args ) { detail::container_guard lock( mutex, "emplace" ); return storage.emplace( std::forward<Args>( args )... ); }
+    iterator insert( iterator position, const Key & x ) { detail::container_guard lock( mutex, "insert" ); return storage.insert( position, x ); }
+    template <class InputIterator> void insert( InputIterator first, InputIterator last ) { detail::container_guard lock( mutex, "insert" ); storage.insert( first, last ); }
 
-    void erase( iterator pos ) { std::lock_guard<std::mutex> lock( mutex ); storage.erase( pos ); }
-    size_type erase( const Key & x ) { std::lock_guard<std::mutex> lock( mutex ); return storage.erase( x ); }
-    void erase( iterator begin, iterator end ) { std::lock_guard<std::mutex> lock( mutex ); storage.erase( begin, end ); }
+    void erase( iterator pos ) { detail::container_guard lock( mutex, "erase" ); storage.erase( pos ); }
+    size_type erase( const Key & x ) { detail::container_guard lock( mutex, "erase" ); return storage.erase( x ); }
+    void erase( iterator begin, iterator end ) { detail::container_guard lock( mutex, "erase" ); storage.erase( begin, end ); }
 
-    void swap( thread_safe::multiset<Key, Compare, Allocator> & x ) { std::lock_guard<std::mutex> lock( mutex ); std::lock_guard<std::mutex> lock2( x.mutex ); storage.swap( x.storage ); }
+    void swap( thread_safe::multiset<Key, Compare, Allocator> & x ) { detail::container_pair_guard lock( mutex, x.mutex, "swap" ); storage.swap( x.storage ); }
 
-    void clear( void ) { std::lock_guard<std::mutex> lock( mutex ); storage.clear(); }
+    void clear( void ) { detail::container_guard lock( mutex, "clear" ); storage.clear(); }
 
     // Observers
-    key_compare key_comp( void ) const { std::lock_guard<std::mutex> lock( mutex ); return storage.key_comp(); }
-    value_compare value_comp( void ) const { std::lock_guard<std::mutex> lock( mutex ); return storage.value_comp(); }
+    key_compare key_comp( void ) const { detail::container_guard lock( mutex, "key_comp" ); return storage.key_comp(); }
+    value_compare value_comp( void ) const { detail::container_guard lock( mutex, "value_comp" ); return storage.value_comp(); }
 
     // Operations
-    const_iterator find( const Key & x ) const { std::lock_guard<std::mutex> lock( mutex ); return storage.find( x ); }
-    iterator find( const Key & x ) { std::lock_guard<std::mutex> lock( mutex ); return storage.find( x ); }
+    const_iterator find( const Key & x ) const { detail::container_guard lock( mutex, "find" ); return storage.find( x ); }
+    iterator find( const Key & x ) { detail::container_guard lock( mutex, "find" ); return storage.find( x ); }
 
-    size_type count( const Key & x ) const { std::lock_guard<std::mutex> lock( mutex ); return storage.count( x ); }
+    size_type count( const Key & x ) const { detail::container_guard lock( mutex, "count" ); return storage.count( x ); }
 
-    const_iterator lower_bound( const Key & x ) const { std::lock_guard<std::mutex> lock( mutex ); return storage.lower_bound( x ); }
-    iterator lower_bound( const Key & x ) { std::lock_guard<std::mutex> lock( mutex ); return storage.lower_bound( x ); }
+    const_iterator lower_bound( const Key & x ) const { detail::container_guard lock( mutex, "lower_bound" ); return storage.lower_bound( x ); }
+    iterator lower_bound( const Key & x ) { detail::container_guard lock( mutex, "lower_bound" ); return storage.lower_bound( x ); }
 
-    const_iterator upper_bound( const Key & x ) const { std::lock_guard<std::mutex> lock( mutex ); return storage.upper_bound( x ); }
-    iterator upper_bound( const Key & x ) { std::lock_guard<std::mutex> lock( mutex ); return storage.upper_bound( x ); }
+    const_iterator upper_bound( const Key & x ) const { detail::container_guard lock( mutex, "upper_bound" ); return storage.upper_bound( x ); }
+    iterator upper_bound( const Key & x ) { detail::container_guard lock( mutex, "upper_bound" ); return storage.upper_bound( x ); }
 
-    std::pair<const_iterator,const_iterator> equal_range( const Key & x ) const { std::lock_guard<std::mutex> lock( mutex ); return storage.equal_range( x ); }
-    std::pair<iterator,iterator> equal_range( const Key & x ) { std::lock_guard<std::mutex> lock( mutex ); return storage.equal_range( x ); }
+    std::pair<const_iterator,const_iterator> equal_range( const Key & x ) const { detail::container_guard lock( mutex, "equal_range" ); return storage.equal_range( x ); }
+    std::pair<iterator,iterator> equal_range( const Key & x ) { detail::container_guard lock( mutex, "equal_range" ); return storage.equal_range( x ); }
 
     // Allocator
-    allocator_type get_allocator( void ) const { std::lock_guard<std::mutex> lock( mutex ); return storage.get_allocator(); }
+    allocator_type get_allocator( void ) const { detail::container_guard lock( mutex, "get_allocator" ); return storage.get_allocator(); }
+
+    // Locked access to the underlying std container for multi-step operations, see thread_safe_locked.h
+    typedef std::multiset< Key, Compare, Allocator > storage_type;
+    locked<storage_type> lock( void ) { return locked<storage_type>( storage, mutex, "lock" ); }
+    locked<const storage_type> lock( void ) const { return locked<const storage_type>( storage, mutex, "lock" ); }
+    template <class Function> typename std::result_of<Function( storage_type & )>::type with_lock( Function fn ) { detail::container_guard lock( mutex, "with_lock" ); return fn( storage ); }
+    template <class Function> typename std::result_of<Function( const storage_type & )>::type with_lock( Function fn ) const { detail::container_guard lock( mutex, "with_lock" ); return fn( storage ); }
+
+    // Lock statistics, empty unless built with THREAD_SAFE_STL_ENABLE_STATS
+    lock_stats stats( void ) const { return detail::stats_of( mutex ); }
+    void set_name( const std::string & name ) { detail::set_name_of( mutex, name ); }
 
 private:
-    std::multiset< Key, Compare, Allocator > storage;
-    mutable std::mutex mutex;
+    storage_type copy_storage( void ) const { detail::container_guard lock( mutex, "copy" ); return storage; }
+
+    alignas( hardware_destructive_interference_size ) std::multiset< Key, Compare, Allocator > storage;
+    alignas( hardware_destructive_interference_size ) mutable detail::container_mutex mutex;
 };
 
 }
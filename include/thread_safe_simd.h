@@ -0,0 +1,269 @@
+/*
+Thread Safe Version STL in C++11
+Copyright(c) 2021
+Author: tashaxing
+*/
+#ifndef THREAD_SAFE_SIMD_H_INCLUDED
+#define THREAD_SAFE_SIMD_H_INCLUDED
+
+#include <cstddef>
+#include <cstdint>
+
+#include "thread_safe_bit_util.h"
+
+// SSE2 and AVX2 kernels are compiled with function level target attributes
+// and picked at runtime, so the library itself needs no -mavx2. SSE2 has no
+// byte shuffle for a vector popcount, the SSE2 tier counts with popcnt. Define
+// THREAD_SAFE_STL_NO_SIMD to always use the portable loops.
+#if !defined(THREAD_SAFE_STL_NO_SIMD) && ( defined(__GNUC__) || defined(__clang__) ) && ( defined(__x86_64__) || defined(__i386__) )
+#define THREAD_SAFE_SIMD_X86 1
+#include <immintrin.h>
+#endif
+
+namespace thread_safe {
+
+namespace simd {
+
+// Word array kernels used by the bitsets. dst and src may not partially overlap.
+struct kernels {
+    void (*and_words)( uint64_t * dst, const uint64_t * src, size_t n );
+    void (*or_words)( uint64_t * dst, const uint64_t * src, size_t n );
+    void (*xor_words)( uint64_t * dst, const uint64_t * src, size_t n );
+    void (*andnot_words)( uint64_t * dst, const uint64_t * src, size_t n ); // dst &= ~src
+    size_t (*popcount_words)( const uint64_t * src, size_t n );
+    size_t (*and_popcount_words)( const uint64_t * a, const uint64_t * b, size_t n );
+    bool (*any_words)( const uint64_t * src, size_t n );
+    bool (*and_any_words)( const uint64_t * a, const uint64_t * b, size_t n );
+    const char * name;
+};
+
+namespace scalar {
+
+inline void and_words( uint64_t * dst, const uint64_t * src, size_t n ) { for ( size_t i = 0; i < n; ++i ) dst[i] &= src[i]; }
+inline void or_words( uint64_t * dst, const uint64_t * src, size_t n ) { for ( size_t i = 0; i < n; ++i ) dst[i] |= src[i]; }
+inline void xor_words( uint64_t * dst, const uint64_t * src, size_t n ) { for ( size_t i = 0; i < n; ++i ) dst[i] ^= src[i]; }
+inline void andnot_words( uint64_t * dst, const uint64_t * src, size_t n ) { for ( size_t i = 0; i < n; ++i ) dst[i] &= ~src[i]; }
+
+inline size_t popcount_words( const uint64_t * src, size_t n ) {
+    size_t count = 0;
+    for ( size_t i = 0; i < n; ++i ) count += detail::popcount64( src[i] );
+    return count;
+}
+
+inline size_t and_popcount_words( const uint64_t * a, const uint64_t * b, size_t n ) {
+    size_t count = 0;
+    for ( size_t i = 0; i < n; ++i ) count += detail::popcount64( a[i] & b[i] );
+    return count;
+}
+
+inline bool any_words( const uint64_t * src, size_t n ) {
+    for ( size_t i = 0; i < n; ++i ) if ( src[i] ) return true;
+    return false;
+}
+
+inline bool and_any_words( const uint64_t * a, const uint64_t * b, size_t n ) {
+    for ( size_t i = 0; i < n; ++i ) if ( a[i] & b[i] ) return true;
+    return false;
+}
+
+}
+
+#ifdef THREAD_SAFE_SIMD_X86
+
+// Scalar loops, but with the hardware popcnt instruction
+namespace popcnt {
+
+__attribute__(( target( "popcnt" ) )) inline size_t popcount_words( const uint64_t * src, size_t n ) {
+    size_t count = 0;
+    for ( size_t i = 0; i < n; ++i ) count += static_cast<size_t>( __builtin_popcountll( src[i] ) );
+    return count;
+}
+
+__attribute__(( target( "popcnt" ) )) inline size_t and_popcount_words( const uint64_t * a, const uint64_t * b, size_t n ) {
+    size_t count = 0;
+    for ( size_t i = 0; i < n; ++i ) count += static_cast<size_t>( __builtin_popcountll( a[i] & b[i] ) );
+    return count;
+}
+
+}
+
+namespace sse2 {
+
+#define THREAD_SAFE_SSE2_BINARY( name, expr ) \
+    __attribute__(( target( "sse2" ) )) inline void name( uint64_t * dst, const uint64_t * src, size_t n ) { \
+        size_t i = 0; \
+        for ( ; i + 2 <= n; i += 2 ) { \
+            __m128i d = _mm_loadu_si128( reinterpret_cast<const __m128i *>( dst + i ) ); \
+            __m128i s = _mm_loadu_si128( reinterpret_cast<const __m128i *>( src + i ) ); \
+            _mm_storeu_si128( reinterpret_cast<__m128i *>( dst + i ), expr ); \
+        } \
+        for ( ; i < n; ++i ) scalar::name( dst + i, src + i, 1 ); \
+    }
+
+THREAD_SAFE_SSE2_BINARY( and_words, _mm_and_si128( d, s ) )
+THREAD_SAFE_SSE2_BINARY( or_words, _mm_or_si128( d, s ) )
+THREAD_SAFE_SSE2_BINARY( xor_words, _mm_xor_si128( d, s ) )
+THREAD_SAFE_SSE2_BINARY( andnot_words, _mm_andnot_si128( s, d ) )
+
+#undef THREAD_SAFE_SSE2_BINARY
+
+// No ptest before SSE4.1: compare the bytes against zero instead
+__attribute__(( target( "sse2" ) )) inline bool nonzero( __m128i v ) { return _mm_movemask_epi8( _mm_cmpeq_epi8( v, _mm_setzero_si128() ) ) != 0xffff; }
+
+__attribute__(( target( "sse2" ) )) inline bool any_words( const uint64_t * src, size_t n ) {
+    size_t i = 0;
+    for ( ; i + 2 <= n; i += 2 ) if ( nonzero( _mm_loadu_si128( reinterpret_cast<const __m128i *>( src + i ) ) ) ) return true;
+    return scalar::any_words( src + i, n - i );
+}
+
+__attribute__(( target( "sse2" ) )) inline bool and_any_words( const uint64_t * a, const uint64_t * b, size_t n ) {
+    size_t i = 0;
+    for ( ; i + 2 <= n; i += 2 ) {
+        __m128i va = _mm_loadu_si128( reinterpret_cast<const __m128i *>( a + i ) );
+        __m128i vb = _mm_loadu_si128( reinterpret_cast<const __m128i *>( b + i ) );
+        if ( nonzero( _mm_and_si128( va, vb ) ) ) return true;
+    }
+    return scalar::and_any_words( a + i, b + i, n - i );
+}
+
+}
+
+namespace avx2 {
+
+#define THREAD_SAFE_AVX2_BINARY( name, expr ) \
+    __attribute__(( target( "avx2" ) )) inline void name( uint64_t * dst, const uint64_t * src, size_t n ) { \
+        size_t i = 0; \
+        for ( ; i + 4 <= n; i += 4 ) { \
+            __m256i d = _mm256_loadu_si256( reinterpret_cast<const __m256i *>( dst + i ) ); \
+            __m256i s = _mm256_loadu_si256( reinterpret_cast<const __m256i *>( src + i ) ); \
+            _mm256_storeu_si256( reinterpret_cast<__m256i *>( dst + i ), expr ); \
+        } \
+        for ( ; i < n; ++i ) scalar::name( dst + i, src + i, 1 ); \
+    }
+
+THREAD_SAFE_AVX2_BINARY( and_words, _mm256_and_si256( d, s ) )
+THREAD_SAFE_AVX2_BINARY( or_words, _mm256_or_si256( d, s ) )
+THREAD_SAFE_AVX2_BINARY( xor_words, _mm256_xor_si256( d, s ) )
+THREAD_SAFE_AVX2_BINARY( andnot_words, _mm256_andnot_si256( s, d ) )
+
+#undef THREAD_SAFE_AVX2_BINARY
+
+// Per byte popcount through a nibble lookup table (vpshufb), summed with vpsadbw
+__attribute__(( target( "avx2" ) )) inline __m256i popcount_bytes( __m256i v ) {
+    const __m256i lookup = _mm256_setr_epi8( 0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4,
+                                             0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4 );
+    const __m256i low_mask = _mm256_set1_epi8( 0x0f );
+    __m256i lo = _mm256_and_si256( v, low_mask );
+    __m256i hi = _mm256_and_si256( _mm256_srli_epi16( v, 4 ), low_mask );
+    __m256i bytes = _mm256_add_epi8( _mm256_shuffle_epi8( lookup, lo ), _mm256_shuffle_epi8( lookup, hi ) );
+    return _mm256_sad_epu8( bytes, _mm256_setzero_si256() );
+}
+
+__attribute__(( target( "avx2" ) )) inline size_t horizontal_sum( __m256i acc ) {
+    uint64_t lanes[4];
+    _mm256_storeu_si256( reinterpret_cast<__m256i *>( lanes ), acc );
+    return static_cast<size_t>( lanes[0] + lanes[1] + lanes[2] + lanes[3] );
+}
+
+__attribute__(( target( "avx2,popcnt" ) )) inline size_t popcount_words( const uint64_t * src, size_t n ) {
+    __m256i acc = _mm256_setzero_si256();
+    size_t i = 0;
+    for ( ; i + 4 <= n; i += 4 )
+        acc = _mm256_add_epi64( acc, popcount_bytes( _mm256_loadu_si256( reinterpret_cast<const __m256i *>( src + i ) ) ) );
+    size_t count = horizontal_sum( acc );
+    for ( ; i < n; ++i ) count += static_cast<size_t>( __builtin_popcountll( src[i] ) );
+    return count;
+}
+
+__attribute__(( target( "avx2,popcnt" ) )) inline size_t and_popcount_words( const uint64_t * a, const uint64_t * b, size_t n ) {
+    __m256i acc = _mm256_setzero_si256();
+    size_t i = 0;
+    for ( ; i + 4 <= n; i += 4 ) {
+        __m256i va = _mm256_loadu_si256( reinterpret_cast<const __m256i *>( a + i ) );
+        __m256i vb = _mm256_loadu_si256( reinterpret_cast<const __m256i *>( b + i ) );
+        acc = _mm256_add_epi64( acc, popcount_bytes( _mm256_and_si256( va, vb ) ) );
+    }
+    size_t count = horizontal_sum( acc );
+    for ( ; i < n; ++i ) count += static_cast<size_t>( __builtin_popcountll( a[i] & b[i] ) );
+    return count;
+}
+
+__attribute__(( target( "avx2" ) )) inline bool any_words( const uint64_t * src, size_t n ) {
+    size_t i = 0;
+    for ( ; i + 4 <= n; i += 4 ) {
+        __m256i v = _mm256_loadu_si256( reinterpret_cast<const __m256i *>( src + i ) );
+        if ( !_mm256_testz_si256( v, v ) ) return true;
+    }
+    return scalar::any_words( src + i, n - i );
+}
+
+__attribute__(( target( "avx2" ) )) inline bool and_any_words( const uint64_t * a, const uint64_t * b, size_t n ) {
+    size_t i = 0;
+    for ( ; i + 4 <= n; i += 4 ) {
+        __m256i va = _mm256_loadu_si256( reinterpret_cast<const __m256i *>( a + i ) );
+        __m256i vb = _mm256_loadu_si256( reinterpret_cast<const __m256i *>( b + i ) );
+        if ( !_mm256_testz_si256( va, vb ) ) return true;
+    }
+    return scalar::and_any_words( a + i, b + i, n - i );
+}
+
+}
+
+#endif // THREAD_SAFE_SIMD_X86
+
+inline kernels make_scalar_kernels( void ) {
+    kernels k = { &scalar::and_words, &scalar::or_words, &scalar::xor_words, &scalar::andnot_words,
+                  &scalar::popcount_words, &scalar::and_popcount_words, &scalar::any_words, &scalar::and_any_words, "scalar" };
+    return k;
+}
+
+inline kernels detect_kernels( void ) {
+    kernels k = make_scalar_kernels();
+#ifdef THREAD_SAFE_SIMD_X86
+    __builtin_cpu_init();
+    if ( __builtin_cpu_supports( "sse2" ) ) {
+        k.and_words = &sse2::and_words;
+        k.or_words = &sse2::or_words;
+        k.xor_words = &sse2::xor_words;
+        k.andnot_words = &sse2::andnot_words;
+        k.any_words = &sse2::any_words;
+        k.and_any_words = &sse2::and_any_words;
+        k.name = "sse2";
+    }
+    if ( __builtin_cpu_supports( "popcnt" ) ) {
+        k.popcount_words = &popcnt::popcount_words;
+        k.and_popcount_words = &popcnt::and_popcount_words;
+        k.name = __builtin_cpu_supports( "sse2" ) ? "sse2+popcnt" : "popcnt";
+    }
+    if ( __builtin_cpu_supports( "avx2" ) && __builtin_cpu_supports( "popcnt" ) ) {
+        kernels v = { &avx2::and_words, &avx2::or_words, &avx2::xor_words, &avx2::andnot_words,
+                      &avx2::popcount_words, &avx2::and_popcount_words, &avx2::any_words, &avx2::and_any_words, "avx2" };
+        k = v;
+    }
+#endif
+    return k;
+}
+
+// Kernels for the running CPU, resolved once
+inline const kernels & active( void ) {
+    static const kernels k = detect_kernels();
+    return k;
+}
+
+// Below this size the indirect call costs more than the vector loop saves
+const size_t kMinSimdWords = 8;
+
+inline void and_words( uint64_t * dst, const uint64_t * src, size_t n ) { if ( n < kMinSimdWords ) scalar::and_words( dst, src, n ); else active().and_words( dst, src, n ); }
+inline void or_words( uint64_t * dst, const uint64_t * src, size_t n ) { if ( n < kMinSimdWords ) scalar::or_words( dst, src, n ); else active().or_words( dst, src, n ); }
+inline void xor_words( uint64_t * dst, const uint64_t * src, size_t n ) { if ( n < kMinSimdWords ) scalar::xor_words( dst, src, n ); else active().xor_words( dst, src, n ); }
+inline void andnot_words( uint64_t * dst, const uint64_t * src, size_t n ) { if ( n < kMinSimdWords ) scalar::andnot_words( dst, src, n ); else active().andnot_words( dst, src, n ); }
+inline size_t popcount_words( const uint64_t * src, size_t n ) { return n < kMinSimdWords ? scalar::popcount_words( src, n ) : active().popcount_words( src, n ); }
+inline size_t and_popcount_words( const uint64_t * a, const uint64_t * b, size_t n ) { return n < kMinSimdWords ? scalar::and_popcount_words( a, b, n ) : active().and_popcount_words( a, b, n ); }
+inline bool any_words( const uint64_t * src, size_t n ) { return n < kMinSimdWords ? scalar::any_words( src, n ) : active().any_words( src, n ); }
+inline bool and_any_words( const uint64_t * a, const uint64_t * b, size_t n ) { return n < kMinSimdWords ? scalar::and_any_words( a, b, n ) : active().and_any_words( a, b, n ); }
+
+}
+
+}
+
+#endif // THREAD_SAFE_SIMD_H_INCLUDED
@@ -8,26 +8,51 @@ Author: tashaxing
 
 #include <stack>
 #include <mutex>
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+#include "thread_safe_lock_stats.h"
+#include "thread_safe_locked.h"
 
 namespace thread_safe {
 
 template < class T, class Container = std::stack<T> >
-class stack {
+class stack : public detail::cache_aligned {
+    friend struct detail::container_access;
 public:
-    explicit stack( const Container & ctnr = Container() ) : storage( ctnr ) { }
-    bool empty( void ) const { std::lock_guard<std::mutex> lock( mutex ); return storage.empty(); }
+    explicit stack( const Container & ctnr ) : storage( ctnr ) { }
+    explicit stack( Container && ctnr = Container() ) : storage( std::move( ctnr ) ) { }
+    bool empty( void ) const { detail::container_guard lock( mutex, "empty" ); return storage.empty(); }
+
+    size_t size( void ) const { detail::container_guard lock( mutex, "size" ); return storage.size(); }
+
+    T & top( void ) { detail::container_guard lock( mutex, "top" ); return storage.top(); }
+    const T & top( void ) const { detail::container_guard lock( mutex, "top" ); return storage.top(); }
+
+    void push( const T & u ) { detail::container_guard lock( mutex, "push" ); storage.push( u ); }
+    void push( T && u ) { detail::container_guard lock( mutex, "push" ); storage.push( std::move( u ) ); }
+    template <class... Args> void emplace( Args&&... args ) { detail::container_guard lock( mutex, "emplace" ); storage.emplace( std::forward<Args>( args )... ); }
 
-    size_t size( void ) const { std::lock_guard<std::mutex> lock( mutex ); return storage.size(); }
+    void pop( void ) { detail::container_guard lock( mutex, "pop" ); storage.pop(); }
 
-    T & top( void ) { std::lock_guard<std::mutex> lock( mutex ); return storage.top(); }
-    const T & top( void ) const { std::lock_guard<std::mutex> lock( mutex ); return storage.top(); }
+    // Move the top element out and remove it; throws out_of_range when empty
+    T pop_value( void ) { detail::container_guard lock( mutex, "pop_value" ); if ( storage.empty() ) throw std::out_of_range( "stack::pop_value" ); T value( std::move( storage.top() ) ); storage.pop(); return value; }
+    bool try_pop( T & value ) { detail::container_guard lock( mutex, "try_pop" ); if ( storage.empty() ) return false; value = std::move( storage.top() ); storage.pop(); return true; }
 
-    void push( const T & u ) { std::lock_guard<std::mutex> lock( mutex ); storage.push( u ); }
+    // Locked access to the underlying std container for multi-step operations, see thread_safe_locked.h
+    typedef Container storage_type;
+    locked<storage_type> lock( void ) { return locked<storage_type>( storage, mutex, "lock" ); }
+    locked<const storage_type> lock( void ) const { return locked<const storage_type>( storage, mutex, "lock" ); }
+    template <class Function> typename std::result_of<Function( storage_type & )>::type with_lock( Function fn ) { detail::container_guard lock( mutex, "with_lock" ); return fn( storage ); }
+    template <class Function> typename std::result_of<Function( const storage_type & )>::type with_lock( Function fn ) const { detail::container_guard lock( mutex, "with_lock" ); return fn( storage ); }
 
-    void pop( void ) { std::lock_guard<std::mutex> lock( mutex ); storage.pop(); }
+    // Lock statistics, empty unless built with THREAD_SAFE_STL_ENABLE_STATS
+    lock_stats stats( void ) const { return detail::stats_of( mutex ); }
+    void set_name( const std::string & name ) { detail::set_name_of( mutex, name ); }
 private:
-    Container storage;
-    mutable std::mutex mutex;
+    alignas( hardware_destructive_interference_size ) Container storage;
+    alignas( hardware_destructive_interference_size ) mutable detail::container_mutex mutex;
 };
 
 }
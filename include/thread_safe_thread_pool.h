@@ -0,0 +1,133 @@
+/*
+Thread Safe Version STL in C++11
+Copyright(c) 2021
+Author: tashaxing
+*/
+#ifndef THREAD_SAFE_THREAD_POOL_H_INCLUDED
+#define THREAD_SAFE_THREAD_POOL_H_INCLUDED
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "thread_safe_cache_line.h"
+
+namespace thread_safe {
+
+// Fixed size worker pool used by the parallel container algorithms.
+class thread_pool {
+public:
+    // threads == 0 means one worker per hardware thread minus the caller
+    explicit thread_pool( size_t threads = 0 ) : stopping( false ) {
+        if ( threads == 0 ) {
+            size_t hw = std::thread::hardware_concurrency();
+            threads = hw > 1 ? hw - 1 : 1;
+        }
+        for ( size_t i = 0; i < threads; ++i ) workers.push_back( std::thread( &thread_pool::worker_loop, this ) );
+    }
+
+    ~thread_pool( void ) {
+        {
+            std::lock_guard<std::mutex> lock( mutex );
+            stopping = true;
+        }
+        wakeup.notify_all();
+        for ( size_t i = 0; i < workers.size(); ++i ) workers[i].join();
+    }
+
+    size_t size( void ) const { return workers.size(); }
+
+    void submit( const std::function<void()> & task ) {
+        {
+            std::lock_guard<std::mutex> lock( mutex );
+            tasks.push_back( task );
+        }
+        wakeup.notify_one();
+    }
+
+    // Run fn(0) .. fn(chunks - 1) on the workers and the calling thread and
+    // return once every chunk finished. The caller takes part in the work, so
+    // nested calls cannot starve. The first exception thrown is rethrown here.
+    template <class Function>
+    void parallel_for( size_t chunks, Function fn ) {
+        if ( chunks == 0 ) return;
+        if ( chunks == 1 ) { fn( size_t( 0 ) ); return; }
+
+        std::shared_ptr<batch> job = std::make_shared<batch>( chunks, std::function<void( size_t )>( fn ) );
+        size_t helpers = chunks - 1 < workers.size() ? chunks - 1 : workers.size();
+        for ( size_t i = 0; i < helpers; ++i ) submit( std::bind( &batch::run, job ) );
+        job->run();
+
+        std::unique_lock<std::mutex> lock( job->mutex );
+        job->finished.wait( lock, [&job]() { return job->done.load() == job->chunks; } );
+        if ( job->error ) std::rethrow_exception( job->error );
+    }
+
+    // Process wide pool shared by all containers
+    static thread_pool & instance( void ) {
+        static thread_pool pool;
+        return pool;
+    }
+
+private:
+    // Shared with the helper tasks, which may start after the caller returned
+    struct batch {
+        batch( size_t n, const std::function<void( size_t )> & f ) : chunks( n ), fn( f ), next( 0 ), done( 0 ) { }
+
+        void run( void ) {
+            size_t i;
+            while ( ( i = next.fetch_add( 1 ) ) < chunks ) {
+                try {
+                    fn( i );
+                } catch ( ... ) {
+                    std::lock_guard<std::mutex> lock( mutex );
+                    if ( !error ) error = std::current_exception();
+                }
+                if ( done.fetch_add( 1 ) + 1 == chunks ) {
+                    std::lock_guard<std::mutex> lock( mutex );
+                    finished.notify_all();
+                }
+            }
+        }
+
+        // every chunk bumps next and done, keep them off the line with fn
+        const size_t chunks;
+        std::function<void( size_t )> fn;
+        alignas( hardware_destructive_interference_size ) std::atomic<size_t> next;
+        alignas( hardware_destructive_interference_size ) std::atomic<size_t> done;
+        std::exception_ptr error;
+        std::mutex mutex;
+        std::condition_variable finished;
+    };
+
+    void worker_loop( void ) {
+        for ( ;; ) {
+            std::function<void()> task;
+            {
+                std::unique_lock<std::mutex> lock( mutex );
+                wakeup.wait( lock, [this]() { return stopping || !tasks.empty(); } );
+                if ( tasks.empty() ) return;
+                task = tasks.front();
+                tasks.pop_front();
+            }
+            task();
+        }
+    }
+
+    std::vector<std::thread> workers;
+    std::deque< std::function<void()> > tasks;
+    std::mutex mutex;
+    std::condition_variable wakeup;
+    bool stopping;
+};
+
+}
+
+#endif // THREAD_SAFE_THREAD_POOL_H_INCLUDED
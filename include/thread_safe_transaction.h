@@ -0,0 +1,136 @@
+/*
+Thread Safe Version STL in C++11
+Copyright(c) 2021
+Author: tashaxing
+*/
+#ifndef THREAD_SAFE_TRANSACTION_H_INCLUDED
+#define THREAD_SAFE_TRANSACTION_H_INCLUDED
+
+#include <algorithm>
+#include <cstddef>
+#include <functional>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+#include "thread_safe_lock_stats.h"
+#include "thread_safe_locked.h"
+
+namespace thread_safe {
+
+namespace detail {
+
+struct container_access {
+    template <class Container>
+    static container_mutex & mutex_of( Container & c ) { return c.mutex; }
+
+    template <class Container>
+    static auto storage_of( Container & c ) -> decltype( ( c.storage ) ) { return c.storage; }
+
+    // Containers with side data derived from the storage (the sets' bloom
+    // filters) mark it stale before their lock is released, as their own
+    // mutable lock() does; it is rebuilt on first use
+    template <class Container>
+    static auto refresh( Container & c, int ) -> decltype( c.filter_invalidate(), void() ) { c.filter_invalidate(); }
+    template <class Container>
+    static void refresh( Container &, long ) { }
+};
+
+template <size_t I, size_t N>
+struct refresh_all {
+    template <class Tuple>
+    static void run( Tuple & t ) {
+        container_access::refresh( std::get<I>( t ), 0 );
+        refresh_all<I + 1, N>::run( t );
+    }
+};
+
+template <size_t N>
+struct refresh_all<N, N> {
+    template <class Tuple>
+    static void run( Tuple & ) { }
+};
+
+}
+
+// The locks of several containers held together, with access to their std
+// containers until the transaction is destroyed or unlock() is called. The
+// locks are taken in address order, so transactions over the same
+// containers listed in any order cannot deadlock with each other or with
+// swap() and operator=, and a container listed twice is locked once.
+// Elements move between the containers without leaving the locks, so other
+// threads never see them in both or in neither:
+//
+//     thread_safe::list<job> pending, running;
+//     auto tx = thread_safe::transaction( pending, running );
+//     std::list<job> & from = tx.get<0>(), & to = tx.get<1>();
+//     if ( !from.empty() ) to.splice( to.end(), from, from.begin() );
+//
+// As with lock(), iterators and references must not outlive the
+// transaction and the containers' own members must not be called inside it.
+template <class... Containers>
+class transaction_lock {
+public:
+    static const size_t kCount = sizeof...( Containers );
+
+    template <size_t I>
+    struct storage_at {
+        typedef typename std::tuple_element<I, std::tuple<Containers...> >::type container;
+        typedef decltype( detail::container_access::storage_of( std::declval<container &>() ) ) type;
+    };
+
+    explicit transaction_lock( Containers &... c ) : containers( c... ), held( 0 ) {
+        detail::container_mutex * all[kCount] = { &detail::container_access::mutex_of( c )... };
+        std::sort( all, all + kCount, std::less<detail::container_mutex *>() );
+        size_t unique = 0;
+        for ( size_t i = 0; i < kCount; ++i ) if ( unique == 0 || mutexes[unique - 1] != all[i] ) mutexes[unique++] = all[i];
+        try {
+            for ( ; held < unique; ++held ) detail::lock_op( *mutexes[held], "transaction" );
+        } catch ( ... ) {
+            release();
+            throw;
+        }
+    }
+
+    transaction_lock( transaction_lock && x ) : containers( x.containers ), held( x.held ) {
+        std::copy( x.mutexes, x.mutexes + held, mutexes );
+        x.held = 0;
+    }
+
+    ~transaction_lock( void ) { unlock(); }
+
+    transaction_lock( const transaction_lock & ) = delete;
+    transaction_lock & operator=( const transaction_lock & ) = delete;
+
+    // The std container of the I-th argument, const for const containers
+    template <size_t I>
+    typename storage_at<I>::type get( void ) const { return detail::container_access::storage_of( std::get<I>( containers ) ); }
+
+    bool owns_lock( void ) const { return held != 0; }
+
+    // Release before the end of the scope, the transaction must not be used afterwards
+    void unlock( void ) {
+        if ( held == 0 ) return;
+        detail::refresh_all<0, kCount>::run( containers );
+        release();
+    }
+
+private:
+    void release( void ) {
+        while ( held ) mutexes[--held]->unlock();
+    }
+
+    std::tuple<Containers &...> containers;
+    detail::container_mutex * mutexes[kCount];
+    size_t held;
+};
+
+template <class... Containers>
+transaction_lock<Containers...> transaction( Containers &... c ) {
+    static_assert( sizeof...( Containers ) > 0, "a transaction needs at least one container" );
+    return transaction_lock<Containers...>( c... );
+}
+
+}
+
+#endif // THREAD_SAFE_TRANSACTION_H_INCLUDED
@@ -8,151 +8,250 @@ Author: tashaxing
 
 #include <unordered_set>
 #include <mutex>
+#include <string>
+#include <atomic>
+#include <algorithm>
+#include <functional>
+#include <memory>
+#include <utility>
+
+#include "thread_safe_bloom_filter.h"
+#include "thread_safe_lock_stats.h"
+#include "thread_safe_locked.h"
 
 namespace thread_safe {
 
-    template < class Key>
-    class unordered_set {
+    template < class Key, class Hash = std::hash<Key>, class KeyEqual = std::equal_to<Key>, class Allocator = std::allocator<Key> >
+    class unordered_set : public detail::cache_aligned {
+        friend struct detail::container_access;
     public:
-        typedef typename std::unordered_set<Key>::iterator iterator;
-        typedef typename std::unordered_set<Key>::const_iterator const_iterator;
-        typedef typename std::unordered_set<Key>::allocator_type allocator_type;
-        typedef typename std::unordered_set<Key>::size_type size_type;
+        typedef typename std::unordered_set<Key, Hash, KeyEqual, Allocator>::iterator iterator;
+        typedef typename std::unordered_set<Key, Hash, KeyEqual, Allocator>::const_iterator const_iterator;
+        typedef typename std::unordered_set<Key, Hash, KeyEqual, Allocator>::allocator_type allocator_type;
+        typedef typename std::unordered_set<Key, Hash, KeyEqual, Allocator>::size_type size_type;
 
         // Constructors
-        unordered_set() = default;
-        template <class InputIterator> unordered_set(InputIterator first, InputIterator last) : storage(first, last) { }
-        unordered_set(const thread_safe::unordered_set<Key>& x) : storage(x.storage) { }
+        unordered_set() : filter(nullptr) { }
+        explicit unordered_set(size_type bucket_count, const Hash& hash = Hash(), const KeyEqual& equal = KeyEqual(), const Allocator& alloc = Allocator()) : storage(bucket_count, hash, equal, alloc), filter(nullptr) { }
+        template <class InputIterator> unordered_set(InputIterator first, InputIterator last) : storage(first, last), filter(nullptr) { }
+        unordered_set(const thread_safe::unordered_set<Key, Hash, KeyEqual, Allocator>& x) : storage(x.copy_storage()), filter(nullptr) { }
 
         // Copy
-        thread_safe::unordered_set<Key>& operator=(const thread_safe::unordered_set<Key>& x) { std::lock_guard<std::mutex> lock(mutex); std::lock_guard<std::mutex> lock2(x.mutex); storage = x.storage; return *this; }
+        thread_safe::unordered_set<Key, Hash, KeyEqual, Allocator>& operator=(const thread_safe::unordered_set<Key, Hash, KeyEqual, Allocator>& x) { detail::container_pair_guard lock(mutex, x.mutex, "operator="); storage = x.storage; filter_add_all(); return *this; }
 
         // Destructor
-        ~unordered_set(void) { }
+        ~unordered_set(void) { delete filter.load(); }
 
         // Iterators
-        iterator begin(void) { std::lock_guard<std::mutex> lock(mutex); return storage.begin(); }
-        const_iterator begin(void) const { std::lock_guard<std::mutex> lock(mutex); return storage.begin(); }
+        iterator begin(void) { detail::container_guard lock(mutex, "begin"); return storage.begin(); }
+        const_iterator begin(void) const { detail::container_guard lock(mutex, "begin"); return storage.begin(); }
 
-        iterator end(void) { std::lock_guard<std::mutex> lock(mutex); return storage.end(); }
-        const_iterator end(void) const { std::lock_guard<std::mutex> lock(mutex); return storage.end(); }
+        iterator end(void) { detail::container_guard lock(mutex, "end"); return storage.end(); }
+        const_iterator end(void) const { detail::container_guard lock(mutex, "end"); return storage.end(); }
 
         // Capacity
-        size_type size(void) const { std::lock_guard<std::mutex> lock(mutex); return storage.size(); }
+        size_type size(void) const { detail::container_guard lock(mutex, "size"); return storage.size(); }
 
-        size_type max_size(void) const { std::lock_guard<std::mutex> lock(mutex); return storage.max_size(); }
+        size_type max_size(void) const { detail::container_guard lock(mutex, "max_size"); return storage.max_size(); }
 
-        bool empty(void) const { std::lock_guard<std::mutex> lock(mutex); return storage.empty(); }
+        bool empty(void) const { detail::container_guard lock(mutex, "empty"); return storage.empty(); }
 
-        void reserve(size_type n) { std::lock_guard<std::mutex> lock(mutex); storage.reserve(n); }
+        void reserve(size_type n) { detail::container_guard lock(mutex, "reserve"); storage.reserve(n); }
 
-        void rehash(size_type n) { std::lock_guard<std::mutex> lock(mutex); storage.rehash(n); }
+        void rehash(size_type n) { detail::container_guard lock(mutex, "rehash"); storage.rehash(n); }
 
         // Modifiers
-        std::pair<iterator, bool> insert(const Key& x) { std::lock_guard<std::mutex> lock(mutex); return storage.insert(x); }
-        iterator insert(iterator position, const Key& x) { std::lock_guard<std::mutex> lock(mutex); return storage.insert(position, x); }
-        template <class InputIterator> void insert(InputIterator first, InputIterator last) { std::lock_guard<std::mutex> lock(mutex); storage.insert(first, last); }
+        std::pair<iterator, bool> insert(const Key& x) { detail::container_guard lock(mutex, "insert"); filter_add(x); return storage.insert(x); }
+        std::pair<iterator, bool> insert(Key&& x) { detail::container_guard lock(mutex, "insert"); filter_add(x); return storage.insert(std::move(x)); }
+        template <class... Args> std::pair<iterator, bool> emplace(Args&&... args) { detail::container_guard lock(mutex, "emplace"); std::pair<iterator, bool> result = storage.emplace(std::forward<Args>(args)...); filter_add(*result.first); return result; }
+        iterator insert(iterator position, const Key& x) { detail::container_guard lock(mutex, "insert"); filter_add(x); return storage.insert(position, x); }
+        template <class InputIterator> void insert(InputIterator first, InputIterator last) { detail::container_guard lock(mutex, "insert"); for (; first != last; ++first) filter_add(*storage.insert(*first).first); }
 
-        void erase(iterator pos) { std::lock_guard<std::mutex> lock(mutex); storage.erase(pos); }
-        size_type erase(const Key& x) { std::lock_guard<std::mutex> lock(mutex); return storage.erase(x); }
-        void erase(iterator begin, iterator end) { std::lock_guard<std::mutex> lock(mutex); storage.erase(begin, end); }
+        void erase(iterator pos) { detail::container_guard lock(mutex, "erase"); storage.erase(pos); }
+        size_type erase(const Key& x) { detail::container_guard lock(mutex, "erase"); return storage.erase(x); }
+        void erase(iterator begin, iterator end) { detail::container_guard lock(mutex, "erase"); storage.erase(begin, end); }
 
-        void swap(thread_safe::unordered_set<Key>& x) { std::lock_guard<std::mutex> lock(mutex); std::lock_guard<std::mutex> lock2(x.mutex); storage.swap(x.storage); }
+        void swap(thread_safe::unordered_set<Key, Hash, KeyEqual, Allocator>& x) { detail::container_pair_guard lock(mutex, x.mutex, "swap"); storage.swap(x.storage); filter_invalidate(); x.filter_invalidate(); }
 
-        void clear(void) { std::lock_guard<std::mutex> lock(mutex); storage.clear(); }
+        void clear(void) { detail::container_guard lock(mutex, "clear"); storage.clear(); filter_clear(); }
 
         // Operations
-        const_iterator find(const Key& x) const { std::lock_guard<std::mutex> lock(mutex); return storage.find(x); }
-        iterator find(const Key& x) { std::lock_guard<std::mutex> lock(mutex); return storage.find(x); }
+        const_iterator find(const Key& x) const { detail::container_guard lock(mutex, "find"); return storage.find(x); }
+        iterator find(const Key& x) { detail::container_guard lock(mutex, "find"); return storage.find(x); }
 
-        size_type count(const Key& x) const { std::lock_guard<std::mutex> lock(mutex); return storage.count(x); }
+        size_type count(const Key& x) const {
+            key_filter* f = filter.load(std::memory_order_acquire);
+            if (f && !f->stale.load(std::memory_order_acquire) && !f->bits.may_contain_hash(f->hash(x))) return 0; // definite miss, no lock taken
+            detail::container_guard lock(mutex, "count");
+            filter_refresh();
+            size_type n = storage.count(x);
+            if (f && n == 0) f->bits.record_false_positive();
+            return n;
+        }
 
-        const_iterator lower_bound(const Key& x) const { std::lock_guard<std::mutex> lock(mutex); return storage.lower_bound(x); }
-        iterator lower_bound(const Key& x) { std::lock_guard<std::mutex> lock(mutex); return storage.lower_bound(x); }
+        const_iterator lower_bound(const Key& x) const { detail::container_guard lock(mutex, "lower_bound"); return storage.lower_bound(x); }
+        iterator lower_bound(const Key& x) { detail::container_guard lock(mutex, "lower_bound"); return storage.lower_bound(x); }
 
-        const_iterator upper_bound(const Key& x) const { std::lock_guard<std::mutex> lock(mutex); return storage.upper_bound(x); }
-        iterator upper_bound(const Key& x) { std::lock_guard<std::mutex> lock(mutex); return storage.upper_bound(x); }
+        const_iterator upper_bound(const Key& x) const { detail::container_guard lock(mutex, "upper_bound"); return storage.upper_bound(x); }
+        iterator upper_bound(const Key& x) { detail::container_guard lock(mutex, "upper_bound"); return storage.upper_bound(x); }
 
-        std::pair<const_iterator, const_iterator> equal_range(const Key& x) const { std::lock_guard<std::mutex> lock(mutex); return storage.equal_range(x); }
-        std::pair<iterator, iterator> equal_range(const Key& x) { std::lock_guard<std::mutex> lock(mutex); return storage.equal_range(x); }
+        std::pair<const_iterator, const_iterator> equal_range(const Key& x) const { detail::container_guard lock(mutex, "equal_range"); return storage.equal_range(x); }
+        std::pair<iterator, iterator> equal_range(const Key& x) { detail::container_guard lock(mutex, "equal_range"); return storage.equal_range(x); }
 
         // Allocator
-        allocator_type get_allocator(void) const { std::lock_guard<std::mutex> lock(mutex); return storage.get_allocator(); }
+        allocator_type get_allocator(void) const { detail::container_guard lock(mutex, "get_allocator"); return storage.get_allocator(); }
+
+        // Bloom filter
+        // Front count() with a lock-free filter so that most negative lookups skip the mutex.
+        // The filter is sized for max(expected_keys, size()) and cannot be disabled again.
+        // Erased keys stay in the filter until clear(), they only cost extra false positives.
+        // Mutable lock() and with_lock() cannot see what was inserted, so releasing them marks the
+        // filter stale: count() takes the lock until the next count() re-adds every key under it.
+        void enable_bloom_filter(size_type expected_keys, double false_positive_rate = 0.01) {
+            detail::container_guard lock(mutex, "enable_bloom_filter");
+            if (filter.load(std::memory_order_relaxed)) return;
+            key_filter* f = new key_filter(std::max(expected_keys, storage.size()), false_positive_rate, storage.hash_function());
+            for (const_iterator it = storage.begin(); it != storage.end(); ++it) f->bits.add_hash(f->hash(*it));
+            filter.store(f, std::memory_order_release);
+        }
+
+        bool bloom_filter_enabled(void) const { return filter.load(std::memory_order_acquire) != nullptr; }
+
+        bloom_filter_stats bloom_stats(void) const {
+            key_filter* f = filter.load(std::memory_order_acquire);
+            if (f) return f->bits.stats();
+            bloom_filter_stats empty = bloom_filter_stats();
+            return empty;
+        }
+
+        // Locked access to the underlying std container for multi-step operations, see thread_safe_locked.h
+        typedef std::unordered_set<Key, Hash, KeyEqual, Allocator> storage_type;
+        locked<storage_type> lock(void) { return locked<storage_type>(storage, mutex, "lock", &invalidate_filter, this); }
+        locked<const storage_type> lock(void) const { return locked<const storage_type>(storage, mutex, "lock"); }
+        template <class Function> typename std::result_of<Function(storage_type&)>::type with_lock(Function fn) { locked<storage_type> access(storage, mutex, "with_lock", &invalidate_filter, this); return fn(storage); }
+        template <class Function> typename std::result_of<Function(const storage_type&)>::type with_lock(Function fn) const { detail::container_guard lock(mutex, "with_lock"); return fn(storage); }
+
+        // Lock statistics, empty unless built with THREAD_SAFE_STL_ENABLE_STATS
+        lock_stats stats(void) const { return detail::stats_of(mutex); }
+        void set_name(const std::string& name) { detail::set_name_of(mutex, name); }
 
     private:
-        std::unordered_set< Key > storage;
-        mutable std::mutex mutex;
+        storage_type copy_storage(void) const { detail::container_guard lock(mutex, "copy"); return storage; }
+
+        // Keeps its own copy of the hasher, so count() can hash without the lock
+        struct key_filter : detail::cache_aligned {
+            key_filter(size_t expected_keys, double false_positive_rate, const Hash& h) : bits(expected_keys, false_positive_rate), hash(h), stale(false) { }
+            bloom_filter bits;
+            Hash hash;
+            std::atomic<bool> stale; // keys may be missing, set by mutable lock() and with_lock()
+        };
+
+        // the helpers below are called with the mutex held
+        void filter_add(const Key& x) const { key_filter* f = filter.load(std::memory_order_relaxed); if (f) f->bits.add_hash(f->hash(x)); }
+        void filter_add_all(void) const { if (filter.load(std::memory_order_relaxed)) for (const_iterator it = storage.begin(); it != storage.end(); ++it) filter_add(*it); }
+        void filter_clear(void) { key_filter* f = filter.load(std::memory_order_relaxed); if (f) { f->bits.clear(); f->stale.store(false, std::memory_order_release); } }
+
+        // Storage changed behind the filter's back, count() rebuilds it on first use
+        void filter_invalidate(void) { key_filter* f = filter.load(std::memory_order_relaxed); if (f) f->stale.store(true, std::memory_order_release); }
+        static void invalidate_filter(void* self) { static_cast<unordered_set*>(self)->filter_invalidate(); }
+        void filter_refresh(void) const {
+            key_filter* f = filter.load(std::memory_order_relaxed);
+            if (!f || !f->stale.load(std::memory_order_relaxed)) return;
+            filter_add_all();
+            f->stale.store(false, std::memory_order_release);
+        }
+
+        alignas(hardware_destructive_interference_size) std::unordered_set<Key, Hash, KeyEqual, Allocator> storage;
+        alignas(hardware_destructive_interference_size) mutable detail::container_mutex mutex;
+        alignas(hardware_destructive_interference_size) std::atomic<key_filter*> filter; // read without the lock
     };
 
-    template < class Key >
-    class unordered_multiset {
+    template < class Key, class Hash = std::hash<Key>, class KeyEqual = std::equal_to<Key>, class Allocator = std::allocator<Key> >
+    class unordered_multiset : public detail::cache_aligned {
+        friend struct detail::container_access;
     public:
-        typedef typename std::unordered_multiset<Key>::iterator iterator;
-        typedef typename std::unordered_multiset<Key>::const_iterator const_iterator;
-        typedef typename std::unordered_multiset<Key>::allocator_type allocator_type;
-        typedef typename std::unordered_multiset<Key>::size_type size_type;
+        typedef typename std::unordered_multiset<Key, Hash, KeyEqual, Allocator>::iterator iterator;
+        typedef typename std::unordered_multiset<Key, Hash, KeyEqual, Allocator>::const_iterator const_iterator;
+        typedef typename std::unordered_multiset<Key, Hash, KeyEqual, Allocator>::allocator_type allocator_type;
+        typedef typename std::unordered_multiset<Key, Hash, KeyEqual, Allocator>::size_type size_type;
 
         // Constructors
         unordered_multiset() = default;
+        explicit unordered_multiset(size_type bucket_count, const Hash& hash = Hash(), const KeyEqual& equal = KeyEqual(), const Allocator& alloc = Allocator()) : storage(bucket_count, hash, equal, alloc) { }
         template <class InputIterator>unordered_multiset(InputIterator first, InputIterator last) : storage(first, last) { }
-        unordered_multiset(const thread_safe::unordered_multiset<Key>& x) : storage(x.storage) { }
+        unordered_multiset(const thread_safe::unordered_multiset<Key, Hash, KeyEqual, Allocator>& x) : storage(x.copy_storage()) { }
 
         // Copy
-        thread_safe::unordered_multiset<Key>& operator=(const thread_safe::unordered_multiset<Key>& x) { std::lock_guard<std::mutex> lock(mutex); std::lock_guard<std::mutex> lock2(x.mutex); storage = x.storage; return *this; }
+        thread_safe::unordered_multiset<Key, Hash, KeyEqual, Allocator>& operator=(const thread_safe::unordered_multiset<Key, Hash, KeyEqual, Allocator>& x) { detail::container_pair_guard lock(mutex, x.mutex, "operator="); storage = x.storage; return *this; }
 
         // Destructor
         ~unordered_multiset(void) { }
 
         // Iterators
-        iterator begin(void) { std::lock_guard<std::mutex> lock(mutex); return storage.begin(); }
-        const_iterator begin(void) const { std::lock_guard<std::mutex> lock(mutex); return storage.begin(); }
+        iterator begin(void) { detail::container_guard lock(mutex, "begin"); return storage.begin(); }
+        const_iterator begin(void) const { detail::container_guard lock(mutex, "begin"); return storage.begin(); }
 
-        iterator end(void) { std::lock_guard<std::mutex> lock(mutex); return storage.end(); }
-        const_iterator end(void) const { std::lock_guard<std::mutex> lock(mutex); return storage.end(); }
+        iterator end(void) { detail::container_guard lock(mutex, "end"); return storage.end(); }
+        const_iterator end(void) const { detail::container_guard lock(mutex, "end"); return storage.end(); }
 
         // Capacity
-        size_type size(void) const { std::lock_guard<std::mutex> lock(mutex); return storage.size(); }
+        size_type size(void) const { detail::container_guard lock(mutex, "size"); return storage.size(); }
 
-        size_type max_size(void) const { std::lock_guard<std::mutex> lock(mutex); return storage.max_size(); }
+        size_type max_size(void) const { detail::container_guard lock(mutex, "max_size"); return storage.max_size(); }
 
-        bool empty(void) const { std::lock_guard<std::mutex> lock(mutex); return storage.empty(); }
+        bool empty(void) const { detail::container_guard lock(mutex, "empty"); return storage.empty(); }
 
-        void reserve(size_type n) { std::lock_guard<std::mutex> lock(mutex); storage.reserve(n); }
+        void reserve(size_type n) { detail::container_guard lock(mutex, "reserve"); storage.reserve(n); }
 
         // Modifiers
-        std::pair<iterator, bool> insert(const Key& x) { std::lock_guard<std::mutex> lock(mutex); return storage.insert(x); }
-        iterator insert(iterator position, const Key& x) { std::lock_guard<std::mutex> lock(mutex); return storage.insert(position, x); }
-        template <class InputIterator> void insert(InputIterator first, InputIterator last) { std::lock_guard<std::mutex> lock(mutex); storage.insert(first, last); }
+        iterator insert(const Key& x) { detail::container_guard lock(mutex, "insert"); return storage.insert(x); }
+        iterator insert(Key&& x) { detail::container_guard lock(mutex, "insert"); return storage.insert(std::move(x)); }
+        template <class... Args> iterator emplace(Args&&... args) { detail::container_guard lock(mutex, "emplace"); return storage.emplace(std::forward<Args>(args)...); }
+        iterator insert(iterator position, const Key& x) { detail::container_guard lock(mutex, "insert"); return storage.insert(position, x); }
+        template <class InputIterator> void insert(InputIterator first, InputIterator last) { detail::container_guard lock(mutex, "insert"); storage.insert(first, last); }
 
-        void erase(iterator pos) { std::lock_guard<std::mutex> lock(mutex); storage.erase(pos); }
-        size_type erase(const Key& x) { std::lock_guard<std::mutex> lock(mutex); return storage.erase(x); }
-        void erase(iterator begin, iterator end) { std::lock_guard<std::mutex> lock(mutex); storage.erase(begin, end); }
+        void erase(iterator pos) { detail::container_guard lock(mutex, "erase"); storage.erase(pos); }
+        size_type erase(const Key& x) { detail::container_guard lock(mutex, "erase"); return storage.erase(x); }
+        void erase(iterator begin, iterator end) { detail::container_guard lock(mutex, "erase"); storage.erase(begin, end); }
 
-        void swap(thread_safe::unordered_multiset<Key>& x) { std::lock_guard<std::mutex> lock(mutex); std::lock_guard<std::mutex> lock2(x.mutex); storage.swap(x.storage); }
+        void swap(thread_safe::unordered_multiset<Key, Hash, KeyEqual, Allocator>& x) { detail::container_pair_guard lock(mutex, x.mutex, "swap"); storage.swap(x.storage); }
 
-        void clear(void) { std::lock_guard<std::mutex> lock(mutex); storage.clear(); }
+        void clear(void) { detail::container_guard lock(mutex, "clear"); storage.clear(); }
 
         // Operations
-        const_iterator find(const Key& x) const { std::lock_guard<std::mutex> lock(mutex); return storage.find(x); }
-        iterator find(const Key& x) { std::lock_guard<std::mutex> lock(mutex); return storage.find(x); }
+        const_iterator find(const Key& x) const { detail::container_guard lock(mutex, "find"); return storage.find(x); }
+        iterator find(const Key& x) { detail::container_guard lock(mutex, "find"); return storage.find(x); }
 
-        size_type count(const Key& x) const { std::lock_guard<std::mutex> lock(mutex); return storage.count(x); }
+        size_type count(const Key& x) const { detail::container_guard lock(mutex, "count"); return storage.count(x); }
 
-        const_iterator lower_bound(const Key& x) const { std::lock_guard<std::mutex> lock(mutex); return storage.lower_bound(x); }
-        iterator lower_bound(const Key& x) { std::lock_guard<std::mutex> lock(mutex); return storage.lower_bound(x); }
+        const_iterator lower_bound(const Key& x) const { detail::container_guard lock(mutex, "lower_bound"); return storage.lower_bound(x); }
+        iterator lower_bound(const Key& x) { detail::container_guard lock(mutex, "lower_bound"); return storage.lower_bound(x); }
 
-        const_iterator upper_bound(const Key& x) const { std::lock_guard<std::mutex> lock(mutex); return storage.upper_bound(x); }
-        iterator upper_bound(const Key& x) { std::lock_guard<std::mutex> lock(mutex); return storage.upper_bound(x); }
+        const_iterator upper_bound(const Key& x) const { detail::container_guard lock(mutex, "upper_bound"); return storage.upper_bound(x); }
+        iterator upper_bound(const Key& x) { detail::container_guard lock(mutex, "upper_bound"); return storage.upper_bound(x); }
 
-        std::pair<const_iterator, const_iterator> equal_range(const Key& x) const { std::lock_guard<std::mutex> lock(mutex); return storage.equal_range(x); }
-        std::pair<iterator, iterator> equal_range(const Key& x) { std::lock_guard<std::mutex> lock(mutex); return storage.equal_range(x); }
+        std::pair<const_iterator, const_iterator> equal_range(const Key& x) const { detail::container_guard lock(mutex, "equal_range"); return storage.equal_range(x); }
+        std::pair<iterator, iterator> equal_range(const Key& x) { detail::container_guard lock(mutex, "equal_range"); return storage.equal_range(x); }
 
         // Allocator
-        allocator_type get_allocator(void) const { std::lock_guard<std::mutex> lock(mutex); return storage.get_allocator(); }
+        allocator_type get_allocator(void) const { detail::container_guard lock(mutex, "get_allocator"); return storage.get_allocator(); }
+
+        // Locked access to the underlying std container for multi-step operations, see thread_safe_locked.h
+        typedef std::unordered_multiset<Key, Hash, KeyEqual, Allocator> storage_type;
+        locked<storage_type> lock(void) { return locked<storage_type>(storage, mutex, "lock"); }
+        locked<const storage_type> lock(void) const { return locked<const storage_type>(storage, mutex, "lock"); }
+        template <class Function> typename std::result_of<Function(storage_type&)>::type with_lock(Function fn) { detail::container_guard lock(mutex, "with_lock"); return fn(storage); }
+        template <class Function> typename std::result_of<Function(const storage_type&)>::type with_lock(Function fn) const { detail::container_guard lock(mutex, "with_lock"); return fn(storage); }
+
+        // Lock statistics, empty unless built with THREAD_SAFE_STL_ENABLE_STATS
+        lock_stats stats(void) const { return detail::stats_of(mutex); }
+        void set_name(const std::string& name) { detail::set_name_of(mutex, name); }
 
     private:
-        std::unordered_multiset< Key > storage;
-        mutable std::mutex mutex;
+        storage_type copy_storage(void) const { detail::container_guard lock(mutex, "copy"); return storage; }
+
+        alignas(hardware_destructive_interference_size) std::unordered_multiset<Key, Hash, KeyEqual, Allocator> storage;
+        alignas(hardware_destructive_interference_size) mutable detail::container_mutex mutex;
     };
 
 }
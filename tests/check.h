@@ -0,0 +1,31 @@
+#ifndef TESTS_CHECK_H_INCLUDED
+#define TESTS_CHECK_H_INCLUDED
+
+#include <cstdio>
+
+// Minimal checks for the unit tests. A failed CHECK prints the expression and
+// the test carries on; main returns test::result() so ctest sees the failure.
+namespace test
+{
+
+inline int& failures()
+{
+	static int count = 0;
+	return count;
+}
+
+inline void check(bool ok, const char* expr, const char* file, int line)
+{
+	if (ok)
+		return;
+	std::fprintf(stderr, "%s:%d: CHECK(%s) failed\n", file, line, expr);
+	++failures();
+}
+
+inline int result() { return failures() == 0 ? 0 : 1; }
+
+}
+
+#define CHECK(expr) test::check(static_cast<bool>(expr), #expr, __FILE__, __LINE__)
+
+#endif // TESTS_CHECK_H_INCLUDED
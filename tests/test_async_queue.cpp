@@ -0,0 +1,147 @@
+// Built as C++20, see CMakeLists.txt
+#include <coroutine>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <optional>
+
+#include "thread_safe_async_queue.h"
+#include "thread_safe_deque.h"
+#include "thread_safe_list.h"
+#include "thread_safe_vector.h"
+#include "check.h"
+
+// Runs resumed coroutines only when asked, so every test is deterministic
+struct manual_executor
+{
+	std::deque<std::function<void()> > tasks;
+
+	void submit(std::function<void()> task) { tasks.push_back(std::move(task)); }
+
+	void run()
+	{
+		while (!tasks.empty())
+		{
+			std::function<void()> task = std::move(tasks.front());
+			tasks.pop_front();
+			task();
+		}
+	}
+};
+
+// Fire and forget coroutine
+struct detached
+{
+	struct promise_type
+	{
+		detached get_return_object() { return detached(); }
+		std::suspend_never initial_suspend() noexcept { return {}; }
+		std::suspend_never final_suspend() noexcept { return {}; }
+		void return_void() {}
+		void unhandled_exception() { std::terminate(); }
+	};
+};
+
+typedef thread_safe::async_queue<int> int_queue;
+
+static detached consume(int_queue& q, std::optional<int>& out, bool& done)
+{
+	out = co_await q.pop();
+	done = true;
+}
+
+static detached produce(int_queue& q, int value, bool& accepted, bool& done)
+{
+	accepted = co_await q.push(value);
+	done = true;
+}
+
+// Capacity 0 buffers nothing: a push only succeeds into a waiting popper,
+// and a pusher waits until a popper takes its value
+static void test_rendezvous()
+{
+	manual_executor ex;
+	int_queue q(ex, 0);
+	CHECK(!q.try_push(1));
+
+	std::optional<int> got;
+	bool popped = false;
+	consume(q, got, popped);
+	CHECK(!popped);
+	CHECK(q.try_push(2));
+	ex.run();
+	CHECK(popped && got == 2);
+
+	bool accepted = false, pushed = false;
+	produce(q, 3, accepted, pushed);
+	CHECK(!pushed);
+	CHECK(q.size() == 0);
+	int x = 0;
+	CHECK(q.try_pop(x) && x == 3);
+	ex.run();
+	CHECK(pushed && accepted);
+}
+
+// A full queue suspends pushers and refills from the first of them on pop
+static void test_backpressure()
+{
+	manual_executor ex;
+	int_queue q(ex, 1);
+	CHECK(q.try_push(1));
+	CHECK(!q.try_push(2));
+
+	bool accepted = false, pushed = false;
+	produce(q, 3, accepted, pushed);
+	CHECK(!pushed);
+	int x = 0;
+	CHECK(q.try_pop(x) && x == 1);
+	ex.run();
+	CHECK(pushed && accepted);
+	CHECK(q.size() == 1);
+	CHECK(q.try_pop(x) && x == 3);
+	CHECK(!q.try_pop(x));
+}
+
+// close() fails waiting pushers, ends waiting poppers and lets buffered
+// values drain
+static void test_close()
+{
+	manual_executor ex;
+	int_queue full(ex, 1);
+	CHECK(full.try_push(1));
+	bool accepted = true, pushed = false;
+	produce(full, 2, accepted, pushed);
+	full.close();
+	ex.run();
+	CHECK(pushed && !accepted);
+	CHECK(!full.try_push(3));
+	std::optional<int> got;
+	bool popped = false;
+	consume(full, got, popped);
+	CHECK(popped && got == 1);
+	popped = false;
+	consume(full, got, popped);
+	CHECK(popped && !got);
+
+	int_queue empty(ex, 4);
+	popped = false;
+	got = 7;
+	consume(empty, got, popped);
+	CHECK(!popped);
+	empty.close();
+	CHECK(empty.is_closed());
+	ex.run();
+	CHECK(popped && !got);
+}
+
+int main()
+{
+	test_rendezvous();
+	test_backpressure();
+	test_close();
+	// the sequence containers must compile as C++20 for coroutine users
+	thread_safe::vector<int> v;
+	thread_safe::list<int> l;
+	thread_safe::deque<int> d;
+	return test::result();
+}
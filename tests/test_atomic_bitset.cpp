@@ -0,0 +1,25 @@
+#include "thread_safe_atomic_bitset.h"
+#include "check.h"
+
+// Filling the bitset through acquire_free_slot() marks every word full.
+// Clearing a bit by any route must make its slot allocatable again.
+template <class Clear>
+static void test_slot_after_clear(Clear clear)
+{
+	thread_safe::atomic_bitset<200> b;
+	for (size_t i = 0; i < 200; ++i)
+		CHECK(b.acquire_free_slot() == i);
+	CHECK(b.acquire_free_slot() == 200);
+	clear(b, 130);
+	CHECK(b.acquire_free_slot() == 130);
+	CHECK(b.acquire_free_slot() == 200);
+}
+
+int main()
+{
+	test_slot_after_clear([](thread_safe::atomic_bitset<200>& b, size_t pos) { b.flip(pos); });
+	test_slot_after_clear([](thread_safe::atomic_bitset<200>& b, size_t pos) { b.reset(pos); });
+	test_slot_after_clear([](thread_safe::atomic_bitset<200>& b, size_t pos) { b.release_slot(pos); });
+	test_slot_after_clear([](thread_safe::atomic_bitset<200>& b, size_t pos) { b.fetch_xor_word(pos / 64, uint64_t(1) << (pos % 64)); });
+	return test::result();
+}
@@ -0,0 +1,39 @@
+#include <cstdint>
+#include <new>
+
+#include "thread_safe_cache_line.h"
+#include "check.h"
+
+struct padded : thread_safe::detail::cache_aligned
+{
+	char byte;
+};
+
+static bool on_line_start(const void* p)
+{
+	return reinterpret_cast<uintptr_t>(p) % thread_safe::hardware_destructive_interference_size == 0;
+}
+
+// new (std::nothrow) must compile against the class overloads and still hand
+// out cache line aligned blocks that the class delete can free.
+static void test_nothrow_new()
+{
+	padded* one = new (std::nothrow) padded;
+	CHECK(one != nullptr);
+	CHECK(on_line_start(one));
+	delete one;
+
+	padded* many = new (std::nothrow) padded[5];
+	CHECK(many != nullptr);
+	delete[] many;
+
+	padded* plain = new padded;
+	CHECK(on_line_start(plain));
+	delete plain;
+}
+
+int main()
+{
+	test_nothrow_new();
+	return test::result();
+}
@@ -0,0 +1,77 @@
+#include <cstdlib>
+#include <deque>
+
+#include "thread_safe_chunk_deque.h"
+#include "check.h"
+
+// Pushing on one end and reading or popping on the other, starting from
+// empty, must see the same elements as std::deque.
+static void test_opposite_ends()
+{
+	thread_safe::chunk_deque<int> d;
+	d.push_front(1);
+	CHECK(d.back() == 1);
+	d.pop_back();
+	CHECK(d.empty());
+
+	d.push_back(2);
+	CHECK(d.front() == 2);
+	d.pop_front();
+	CHECK(d.empty());
+
+	for (int i = 0; i < 1000; ++i)
+		d.push_front(i);
+	for (int i = 0; i < 1000; ++i)
+	{
+		CHECK(d.back() == i);
+		d.pop_back();
+	}
+	CHECK(d.empty());
+}
+
+static void test_random_ops()
+{
+	thread_safe::chunk_deque<int> d;
+	std::deque<int> expected;
+	std::srand(7);
+	for (int i = 0; i < 100000; ++i)
+	{
+		int op = std::rand() % 4;
+		if (op == 0)
+		{
+			d.push_front(i);
+			expected.push_front(i);
+		}
+		else if (op == 1)
+		{
+			d.push_back(i);
+			expected.push_back(i);
+		}
+		else if (!expected.empty())
+		{
+			CHECK(d.front() == expected.front());
+			CHECK(d.back() == expected.back());
+			if (op == 2)
+			{
+				d.pop_front();
+				expected.pop_front();
+			}
+			else
+			{
+				d.pop_back();
+				expected.pop_back();
+			}
+		}
+		CHECK(d.size() == expected.size());
+	}
+	std::deque<int> seen;
+	d.for_each([&seen](int x) { seen.push_back(x); });
+	CHECK(seen == expected);
+}
+
+int main()
+{
+	test_opposite_ends();
+	test_random_ops();
+	return test::result();
+}
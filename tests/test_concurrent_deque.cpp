@@ -0,0 +1,166 @@
+#include <deque>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#include "thread_safe_concurrent_deque.h"
+#include "check.h"
+
+typedef thread_safe::concurrent_deque<int> int_deque;
+
+// Single threaded runs against std::deque. The length swings well past
+// kSlowThreshold and back to empty, so pops take both the reserved fast path
+// and the locked slow path, and both ends cross block boundaries.
+static void test_both_ends_against_std()
+{
+	int_deque d;
+	std::deque<int> expected;
+	const int swing = static_cast<int>(int_deque::kSlowThreshold * 3);
+	int next = 0;
+	for (int round = 0; round < 6; ++round)
+	{
+		for (int i = 0; i < swing; ++i)
+		{
+			if ((i + round) % 3)
+			{
+				d.push_back(next);
+				expected.push_back(next);
+			}
+			else
+			{
+				d.push_front(next);
+				expected.push_front(next);
+			}
+			++next;
+		}
+		CHECK(d.size() == expected.size());
+		int x = 0;
+		while (!expected.empty())
+		{
+			bool from_front = (expected.size() + round) % 2 == 0;
+			CHECK(from_front ? d.try_pop_front(x) : d.try_pop_back(x));
+			CHECK(x == (from_front ? expected.front() : expected.back()));
+			if (from_front)
+				expected.pop_front();
+			else
+				expected.pop_back();
+		}
+		CHECK(d.empty());
+		CHECK(!d.try_pop_front(x) && !d.try_pop_back(x));
+	}
+}
+
+// Producers push at both ends while consumers pop at both ends; every value
+// comes out exactly once
+static void test_concurrent_ends()
+{
+	const int kPerProducer = 20000;
+	int_deque d;
+	std::vector<std::vector<int> > popped(2);
+	std::vector<std::thread> threads;
+	for (int p = 0; p < 2; ++p)
+	{
+		threads.push_back(std::thread([&d, p, kPerProducer]() {
+			for (int i = 0; i < kPerProducer; ++i)
+			{
+				if (p)
+					d.push_front(p * kPerProducer + i);
+				else
+					d.push_back(i);
+			}
+		}));
+	}
+	for (int c = 0; c < 2; ++c)
+	{
+		threads.push_back(std::thread([&d, &popped, c]() {
+			int x = 0;
+			for (int i = 0; i < 15000; ++i)
+				if (c ? d.try_pop_back(x) : d.try_pop_front(x))
+					popped[c].push_back(x);
+		}));
+	}
+	for (size_t t = 0; t < threads.size(); ++t)
+		threads[t].join();
+
+	std::vector<int> seen(2 * kPerProducer, 0);
+	for (int c = 0; c < 2; ++c)
+		for (size_t i = 0; i < popped[c].size(); ++i)
+			++seen[popped[c][i]];
+	int x = 0;
+	while (d.try_pop_front(x))
+		++seen[x];
+	bool once = true;
+	for (size_t i = 0; i < seen.size(); ++i)
+		once = once && seen[i] == 1;
+	CHECK(once);
+}
+
+// Move assignment that throws on request
+struct fragile
+{
+	static bool fail;
+	int value;
+
+	fragile(int v = 0) : value(v) {}
+	fragile(const fragile& x) : value(x.value) {}
+	fragile& operator=(fragile&& x)
+	{
+		if (fail)
+			throw std::runtime_error("fragile");
+		value = x.value;
+		return *this;
+	}
+};
+
+bool fragile::fail = false;
+
+static bool pop_throws(thread_safe::concurrent_deque<fragile>& d, bool front)
+{
+	fragile out;
+	fragile::fail = true;
+	bool threw = false;
+	try
+	{
+		if (front)
+			d.try_pop_front(out);
+		else
+			d.try_pop_back(out);
+	}
+	catch (const std::runtime_error&)
+	{
+		threw = true;
+	}
+	fragile::fail = false;
+	return threw;
+}
+
+// A pop whose move throws leaves the element and the count in place, on the
+// reserved fast path (long deque) and the locked slow path (short deque)
+static void test_throwing_move()
+{
+	thread_safe::concurrent_deque<fragile> d;
+	const int n = static_cast<int>(thread_safe::concurrent_deque<fragile>::kSlowThreshold * 2);
+	for (int i = 0; i < n; ++i)
+		d.push_back(fragile(i));
+	fragile out;
+
+	CHECK(pop_throws(d, false));
+	CHECK(d.size() == static_cast<size_t>(n));
+	CHECK(d.try_pop_back(out) && out.value == n - 1);
+
+	while (d.size() > 2)
+		d.try_pop_front(out);
+	CHECK(pop_throws(d, true));
+	CHECK(d.size() == 2);
+	CHECK(d.try_pop_front(out) && out.value == n - 3);
+	CHECK(d.try_pop_front(out) && out.value == n - 2);
+	CHECK(d.empty());
+}
+
+int main()
+{
+	test_both_ends_against_std();
+	test_concurrent_ends();
+	test_throwing_move();
+	return test::result();
+}
@@ -0,0 +1,87 @@
+#include <atomic>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include "thread_safe_concurrent_list.h"
+#include "check.h"
+
+// Walks every element in order, false if two neighbours are out of order;
+// counted receives the number of elements visited
+static bool walk_sorted(const thread_safe::concurrent_list<int>& l, size_t& counted)
+{
+	bool sorted = true, first = true;
+	int last = 0;
+	counted = 0;
+	l.for_each([&](int v) {
+		if (!first && v < last)
+			sorted = false;
+		first = false;
+		last = v;
+		++counted;
+	});
+	return sorted;
+}
+
+// Threads insert, remove, remove_if and clear at once while a reader walks;
+// every walk must see sorted elements, and once quiet the walk must visit
+// exactly size() elements
+static void test_concurrent_mutation()
+{
+	thread_safe::concurrent_list<int> l;
+	std::atomic<bool> stop(false);
+	std::atomic<int> unsorted(0);
+	std::vector<std::thread> threads;
+	for (int t = 0; t < 3; ++t)
+	{
+		threads.push_back(std::thread([&l, t]() {
+			std::minstd_rand random(17 + t);
+			for (int i = 0; i < 4000; ++i)
+			{
+				int v = static_cast<int>(random() % 500);
+				l.insert(v);
+				if (i % 3 == 0)
+					l.remove(static_cast<int>(random() % 500));
+			}
+		}));
+	}
+	threads.push_back(std::thread([&l]() {
+		for (int i = 0; i < 50; ++i)
+			l.remove_if([i](int v) { return v % 50 == i; });
+	}));
+	threads.push_back(std::thread([&l]() {
+		for (int i = 0; i < 5; ++i)
+		{
+			std::this_thread::yield();
+			l.clear();
+		}
+	}));
+	std::thread reader([&]() {
+		while (!stop.load())
+		{
+			size_t counted = 0;
+			if (!walk_sorted(l, counted))
+				++unsorted;
+		}
+	});
+	for (size_t t = 0; t < threads.size(); ++t)
+		threads[t].join();
+	stop = true;
+	reader.join();
+
+	CHECK(unsorted.load() == 0);
+	size_t counted = 0;
+	CHECK(walk_sorted(l, counted));
+	CHECK(counted == l.size());
+	l.insert(-1);
+	CHECK(l.contains(-1));
+	CHECK(walk_sorted(l, counted) && counted == l.size());
+	l.clear();
+	CHECK(l.empty() && walk_sorted(l, counted) && counted == 0);
+}
+
+int main()
+{
+	test_concurrent_mutation();
+	return test::result();
+}
@@ -0,0 +1,110 @@
+#include <memory>
+#include <new>
+#include <stdexcept>
+
+#include "thread_safe_concurrent_vector.h"
+#include "check.h"
+
+struct picky
+{
+	int value;
+
+	picky(int v) : value(v)
+	{
+		if (v < 0)
+			throw std::runtime_error("picky");
+	}
+};
+
+// Allocations bigger than this fail, which lets the small state array of a
+// segment through while its element storage is refused.
+static size_t allocation_limit = size_t(-1);
+
+template <class T>
+struct limited_allocator : std::allocator<T>
+{
+	template <class U>
+	struct rebind
+	{
+		typedef limited_allocator<U> other;
+	};
+
+	limited_allocator() {}
+	template <class U>
+	limited_allocator(const limited_allocator<U>&) {}
+
+	T* allocate(size_t n)
+	{
+		if (n * sizeof(T) > allocation_limit)
+			throw std::bad_alloc();
+		return std::allocator<T>::allocate(n);
+	}
+};
+
+// A throwing constructor leaves a broken index behind; size() moves past it
+// and at() reports it.
+static void test_throwing_constructor()
+{
+	thread_safe::concurrent_vector<picky> v;
+	v.push_back(picky(1));
+	bool threw = false;
+	try
+	{
+		v.emplace_back(-1);
+	}
+	catch (const std::runtime_error&)
+	{
+		threw = true;
+	}
+	CHECK(threw);
+	v.emplace_back(3);
+	CHECK(v.size() == 3);
+	CHECK(v.at(0).value == 1);
+	CHECK(v.at(2).value == 3);
+	threw = false;
+	try
+	{
+		v.at(1);
+	}
+	catch (const std::out_of_range&)
+	{
+		threw = true;
+	}
+	CHECK(threw);
+	int sum = 0;
+	v.for_each([&sum](const picky& p) { sum += p.value; });
+	CHECK(sum == 4);
+}
+
+// When a new segment's element storage cannot be allocated the claimed index
+// is still marked, so later appends get published once storage is available.
+static void test_failed_segment_allocation()
+{
+	thread_safe::concurrent_vector<long, limited_allocator<long> > v;
+	for (long i = 0; i < 32; ++i)
+		v.push_back(i);
+	allocation_limit = 64;
+	bool threw = false;
+	try
+	{
+		v.push_back(32);
+	}
+	catch (const std::bad_alloc&)
+	{
+		threw = true;
+	}
+	CHECK(threw);
+	CHECK(v.size() == 33);
+	allocation_limit = size_t(-1);
+	v.push_back(33);
+	CHECK(v.size() == 34);
+	CHECK(v.at(33) == 33);
+	CHECK(v[31] == 31);
+}
+
+int main()
+{
+	test_throwing_constructor();
+	test_failed_segment_allocation();
+	return test::result();
+}
@@ -0,0 +1,60 @@
+#include <atomic>
+#include <functional>
+#include <thread>
+
+#include "thread_safe_map.h"
+#include "thread_safe_set.h"
+#include "thread_safe_unordered_map.h"
+#include "thread_safe_unordered_set.h"
+#include "check.h"
+
+// A writer inserts keys two at a time under one lock while the main thread
+// copies the container. A copy taken under the source's lock always holds
+// an even number of keys.
+template <class Container, class Insert>
+static void test_copy_while_writing(Insert insert)
+{
+	Container source;
+	std::atomic<bool> stop(false);
+	std::thread writer([&] {
+		for (int k = 0; !stop.load(); k = (k + 2) % 2000)
+		{
+			if (k == 0)
+				source.clear();
+			source.with_lock([&](typename Container::storage_type& s) { insert(s, k); insert(s, k + 1); });
+		}
+	});
+	bool even = true;
+	for (int i = 0; i < 200; ++i)
+	{
+		Container copy(source);
+		even = even && copy.size() % 2 == 0;
+	}
+	stop = true;
+	writer.join();
+	CHECK(even);
+}
+
+static void test_copy_keeps_comparator()
+{
+	thread_safe::set<int, std::greater<int>> source;
+	source.insert(1);
+	source.insert(3);
+	source.insert(2);
+	thread_safe::set<int, std::greater<int>> copy(source);
+	CHECK(*copy.lock()->begin() == 3);
+}
+
+int main()
+{
+	test_copy_while_writing<thread_safe::map<int, int>>([](std::map<int, int>& s, int k) { s[k] = k; });
+	test_copy_while_writing<thread_safe::multimap<int, int>>([](std::multimap<int, int>& s, int k) { s.insert(std::make_pair(k, k)); });
+	test_copy_while_writing<thread_safe::set<int>>([](std::set<int>& s, int k) { s.insert(k); });
+	test_copy_while_writing<thread_safe::multiset<int>>([](std::multiset<int>& s, int k) { s.insert(k); });
+	test_copy_while_writing<thread_safe::unordered_map<int, int>>([](std::unordered_map<int, int>& s, int k) { s[k] = k; });
+	test_copy_while_writing<thread_safe::unordered_multimap<int, int>>([](std::unordered_multimap<int, int>& s, int k) { s.insert(std::make_pair(k, k)); });
+	test_copy_while_writing<thread_safe::unordered_set<int>>([](std::unordered_set<int>& s, int k) { s.insert(k); });
+	test_copy_while_writing<thread_safe::unordered_multiset<int>>([](std::unordered_multiset<int>& s, int k) { s.insert(k); });
+	test_copy_keeps_comparator();
+	return test::result();
+}
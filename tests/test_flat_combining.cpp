@@ -0,0 +1,61 @@
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "thread_safe_flat_combining.h"
+#include "check.h"
+
+typedef std::unique_ptr<int> item;
+
+struct by_value
+{
+	bool operator()(const item& a, const item& b) const { return *a < *b; }
+};
+
+static const int kThreads = 4;
+static const int kPerThread = 5000;
+
+// Threads push distinct values and pop concurrently; afterwards the rest is
+// drained. Every value must come out exactly once, whether a combiner ran it,
+// the batch handed it from a push to a pop, or its owner ran it alone.
+template <class Container>
+static void test_each_value_once()
+{
+	Container c;
+	std::vector<std::vector<int> > popped(kThreads);
+	std::vector<std::thread> threads;
+	for (int t = 0; t < kThreads; ++t)
+	{
+		threads.push_back(std::thread([&c, &popped, t]() {
+			for (int i = 0; i < kPerThread; ++i)
+			{
+				c.push(item(new int(t * kPerThread + i)));
+				item out;
+				if (i % 2 && c.try_pop(out))
+					popped[t].push_back(*out);
+			}
+		}));
+	}
+	for (size_t t = 0; t < threads.size(); ++t)
+		threads[t].join();
+
+	std::vector<int> seen(kThreads * kPerThread, 0);
+	for (int t = 0; t < kThreads; ++t)
+		for (size_t i = 0; i < popped[t].size(); ++i)
+			++seen[popped[t][i]];
+	item out;
+	while (c.try_pop(out))
+		++seen[*out];
+	CHECK(c.empty());
+	bool once = true;
+	for (size_t i = 0; i < seen.size(); ++i)
+		once = once && seen[i] == 1;
+	CHECK(once);
+}
+
+int main()
+{
+	test_each_value_once<thread_safe::combining_stack<item> >();
+	test_each_value_once<thread_safe::combining_priority_queue<item, std::vector<item>, by_value> >();
+	return test::result();
+}
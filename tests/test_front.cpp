@@ -0,0 +1,24 @@
+#include "thread_safe_deque.h"
+#include "thread_safe_list.h"
+#include "thread_safe_vector.h"
+#include "check.h"
+
+// front() and back() through a const reference read opposite ends
+template <class Sequence>
+static void test_const_front()
+{
+	Sequence s;
+	s.push_back(1);
+	s.push_back(2);
+	const Sequence& c = s;
+	CHECK(c.front() == 1);
+	CHECK(c.back() == 2);
+}
+
+int main()
+{
+	test_const_front<thread_safe::vector<int>>();
+	test_const_front<thread_safe::list<int>>();
+	test_const_front<thread_safe::deque<int>>();
+	return test::result();
+}
@@ -0,0 +1,46 @@
+#include <functional>
+#include <list>
+
+#include "thread_safe_list.h"
+#include "check.h"
+
+static std::list<int> contents(thread_safe::list<int>& l)
+{
+	return l.with_lock([](std::list<int>& s) { return s; });
+}
+
+static void test_merge()
+{
+	thread_safe::list<int> a, b;
+	for (int v : {1, 4, 7})
+		a.push_back(v);
+	for (int v : {2, 3, 8})
+		b.push_back(v);
+	a.merge(b);
+	CHECK(contents(a) == std::list<int>({1, 2, 3, 4, 7, 8}));
+	CHECK(b.empty());
+
+	thread_safe::list<int> c, d;
+	for (int v : {7, 4, 1})
+		c.push_back(v);
+	for (int v : {8, 2})
+		d.push_back(v);
+	c.merge(d, std::greater<int>());
+	CHECK(contents(c) == std::list<int>({8, 7, 4, 2, 1}));
+}
+
+static void test_reverse()
+{
+	thread_safe::list<int> l;
+	for (int v : {1, 2, 3})
+		l.push_back(v);
+	l.reverse();
+	CHECK(contents(l) == std::list<int>({3, 2, 1}));
+}
+
+int main()
+{
+	test_merge();
+	test_reverse();
+	return test::result();
+}
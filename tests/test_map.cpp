@@ -0,0 +1,35 @@
+#include <string>
+
+#include "thread_safe_map.h"
+#include "check.h"
+
+static void test_map_assign()
+{
+	thread_safe::map<int, std::string> a, b;
+	a.insert(std::make_pair(1, std::string("one")));
+	b.insert(std::make_pair(2, std::string("two")));
+	b.insert(std::make_pair(3, std::string("three")));
+	a = b;
+	CHECK(a.size() == 2);
+	CHECK(a.count(1) == 0);
+	CHECK(a[2] == "two");
+	a = a;
+	CHECK(a.size() == 2);
+}
+
+static void test_multimap_assign()
+{
+	thread_safe::multimap<int, std::string> a, b;
+	b.insert(std::make_pair(1, std::string("x")));
+	b.insert(std::make_pair(1, std::string("y")));
+	a = b;
+	CHECK(a.count(1) == 2);
+	CHECK(b.count(1) == 2);
+}
+
+int main()
+{
+	test_map_assign();
+	test_multimap_assign();
+	return test::result();
+}
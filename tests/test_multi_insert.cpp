@@ -0,0 +1,43 @@
+#include <string>
+#include <utility>
+
+#include "thread_safe_map.h"
+#include "thread_safe_set.h"
+#include "thread_safe_unordered_map.h"
+#include "thread_safe_unordered_set.h"
+#include "check.h"
+
+// The multi-containers always insert, so insert returns an iterator for
+// lvalues and rvalues alike, as in the std containers.
+template <class Map>
+static void test_map_insert()
+{
+	Map m;
+	const typename Map::value_type one(1, "one");
+	typename Map::iterator a = m.insert(one);
+	typename Map::iterator b = m.insert(one);
+	typename Map::iterator c = m.insert(typename Map::value_type(1, "uno"));
+	CHECK(a != b && b != c);
+	CHECK(m.count(1) == 3);
+}
+
+template <class Set>
+static void test_set_insert()
+{
+	Set s;
+	const std::string key("k");
+	typename Set::iterator a = s.insert(key);
+	typename Set::iterator b = s.insert(std::string("k"));
+	CHECK(a != b);
+	CHECK(*a == "k");
+	CHECK(s.count("k") == 2);
+}
+
+int main()
+{
+	test_map_insert<thread_safe::multimap<int, std::string> >();
+	test_map_insert<thread_safe::unordered_multimap<int, std::string> >();
+	test_set_insert<thread_safe::multiset<std::string> >();
+	test_set_insert<thread_safe::unordered_multiset<std::string> >();
+	return test::result();
+}
@@ -0,0 +1,103 @@
+#include <algorithm>
+#include <deque>
+#include <functional>
+#include <numeric>
+#include <random>
+#include <vector>
+
+#include "thread_safe_deque.h"
+#include "thread_safe_parallel_algorithm.h"
+#include "thread_safe_vector.h"
+#include "check.h"
+
+static std::vector<int> random_values(size_t n)
+{
+	std::minstd_rand rng(static_cast<unsigned>(n));
+	std::vector<int> values(n);
+	for (size_t i = 0; i < n; ++i)
+		values[i] = static_cast<int>(rng() % 1000);
+	return values;
+}
+
+// A pool of workers + 1 threads cuts a range of that many grains into that
+// many sort chunks, so an odd pool size leaves an odd run over in the first
+// merge round that is carried to the next one.
+static void test_sort_odd_chunks(size_t workers)
+{
+	thread_safe::thread_pool pool(workers);
+	size_t chunks = workers + 1;
+	size_t n = chunks * thread_safe::parallel::kGrain + 123;
+	CHECK(thread_safe::parallel::detail::chunk_count(pool, n, 1) == chunks);
+
+	std::vector<int> values = random_values(n);
+	std::vector<int> expected = values;
+	std::sort(expected.begin(), expected.end());
+	thread_safe::parallel::sort(pool, values.begin(), values.end(), std::less<int>());
+	CHECK(values == expected);
+
+	std::sort(expected.begin(), expected.end(), std::greater<int>());
+	thread_safe::parallel::sort(pool, values.begin(), values.end(), std::greater<int>());
+	CHECK(values == expected);
+}
+
+static void test_algorithms_on_pool()
+{
+	thread_safe::thread_pool pool(4);
+	size_t n = 7 * thread_safe::parallel::kGrain + 5;
+	std::vector<int> values = random_values(n);
+
+	std::vector<int> expected = values;
+	std::for_each(expected.begin(), expected.end(), [](int& x) { x += 3; });
+	thread_safe::parallel::for_each(pool, values.begin(), values.end(), [](int& x) { x += 3; });
+	CHECK(values == expected);
+
+	std::vector<int> out(n), expected_out(n);
+	std::transform(values.begin(), values.end(), expected_out.begin(), [](int x) { return 2 * x + 1; });
+	thread_safe::parallel::transform(pool, values.begin(), values.end(), out.begin(), [](int x) { return 2 * x + 1; });
+	CHECK(out == expected_out);
+
+	long long sum = std::accumulate(values.begin(), values.end(), 10LL);
+	CHECK(thread_safe::parallel::reduce(pool, values.begin(), values.end(), 10LL, std::plus<long long>()) == sum);
+	int largest = *std::max_element(values.begin(), values.end());
+	CHECK(thread_safe::parallel::reduce(pool, values.begin(), values.end(), -1, [](int a, int b) { return std::max(a, b); }) == largest);
+}
+
+// The container members run on the shared pool over their whole storage
+template <class Container, class Reference>
+static void test_container(size_t n)
+{
+	std::vector<int> values = random_values(n);
+	Container c(values.begin(), values.end());
+	Reference expected(values.begin(), values.end());
+
+	c.parallel_sort();
+	std::sort(expected.begin(), expected.end());
+	CHECK(c.with_lock([&expected](const typename Container::storage_type& s) { return s == expected; }));
+
+	c.parallel_for_each([](int& x) { x -= 7; });
+	std::for_each(expected.begin(), expected.end(), [](int& x) { x -= 7; });
+	CHECK(c.with_lock([&expected](const typename Container::storage_type& s) { return s == expected; }));
+
+	c.parallel_transform([](int x) { return x * 3; });
+	std::transform(expected.begin(), expected.end(), expected.begin(), [](int x) { return x * 3; });
+	CHECK(c.with_lock([&expected](const typename Container::storage_type& s) { return s == expected; }));
+
+	CHECK(c.parallel_reduce(0LL, std::plus<long long>()) == std::accumulate(expected.begin(), expected.end(), 0LL));
+
+	c.parallel_sort(std::greater<int>());
+	std::sort(expected.begin(), expected.end(), std::greater<int>());
+	CHECK(c.with_lock([&expected](const typename Container::storage_type& s) { return s == expected; }));
+}
+
+int main()
+{
+	test_sort_odd_chunks(2);
+	test_sort_odd_chunks(4);
+	test_algorithms_on_pool();
+	for (size_t n = thread_safe::parallel::kGrain + 1; n < 8 * thread_safe::parallel::kGrain; n += 3 * thread_safe::parallel::kGrain)
+	{
+		test_container<thread_safe::vector<int>, std::vector<int> >(n);
+		test_container<thread_safe::deque<int>, std::deque<int> >(n);
+	}
+	return test::result();
+}
@@ -0,0 +1,40 @@
+#include <new>
+
+#include "thread_safe_pool_allocator.h"
+#include "check.h"
+
+// A count whose byte size does not fit in size_t must throw, not allocate a
+// wrapped around, much smaller block.
+static void test_oversized_request()
+{
+	thread_safe::pool_allocator<double> alloc;
+	bool threw = false;
+	try
+	{
+		alloc.allocate(alloc.max_size() + 1);
+	}
+	catch (const std::bad_alloc&)
+	{
+		threw = true;
+	}
+	CHECK(threw);
+}
+
+static void test_round_trip()
+{
+	thread_safe::pool_allocator<double> alloc;
+	double* one = alloc.allocate(1);
+	double* many = alloc.allocate(100);
+	*one = 1.0;
+	many[99] = 2.0;
+	CHECK(*one + many[99] == 3.0);
+	alloc.deallocate(many, 100);
+	alloc.deallocate(one, 1);
+}
+
+int main()
+{
+	test_oversized_request();
+	test_round_trip();
+	return test::result();
+}
@@ -0,0 +1,98 @@
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+#include "thread_safe_deque.h"
+#include "thread_safe_list.h"
+#include "thread_safe_map.h"
+#include "thread_safe_queue.h"
+#include "thread_safe_stack.h"
+#include "thread_safe_unordered_map.h"
+#include "thread_safe_vector.h"
+#include "check.h"
+
+typedef std::unique_ptr<int> item;
+
+template <class Function>
+static bool throws_out_of_range(Function fn)
+{
+	try
+	{
+		fn();
+	}
+	catch (const std::out_of_range&)
+	{
+		return true;
+	}
+	return false;
+}
+
+// pop_value moves a move-only element out; on an empty container it throws
+// instead of reading past the end.
+template <class Adaptor>
+static void test_adaptor_pop_value()
+{
+	Adaptor a;
+	a.emplace(new int(7));
+	CHECK(*a.pop_value() == 7);
+	CHECK(a.empty());
+	CHECK(throws_out_of_range([&a]() { a.pop_value(); }));
+}
+
+template <class Sequence>
+static void test_pop_back_value()
+{
+	Sequence s;
+	s.emplace_back(new int(1));
+	s.emplace_back(new int(2));
+	CHECK(*s.pop_back_value() == 2);
+	CHECK(*s.pop_back_value() == 1);
+	CHECK(throws_out_of_range([&s]() { s.pop_back_value(); }));
+}
+
+template <class Sequence>
+static void test_pop_front_value()
+{
+	Sequence s;
+	s.emplace_front(new int(1));
+	s.emplace_back(new int(2));
+	CHECK(*s.pop_front_value() == 1);
+	CHECK(*s.pop_front_value() == 2);
+	CHECK(throws_out_of_range([&s]() { s.pop_front_value(); }));
+}
+
+// try_emplace constructs the mapped value only for a new key and leaves its
+// arguments alone otherwise; emplace forwards any number of arguments.
+template <class Map>
+static void test_try_emplace()
+{
+	Map m;
+	item first(new int(1));
+	CHECK(m.try_emplace(1, std::move(first)).second);
+	CHECK(!first);
+	item second(new int(2));
+	CHECK(!m.try_emplace(1, std::move(second)).second);
+	CHECK(second && *second == 2);
+	CHECK(m.emplace(std::piecewise_construct, std::forward_as_tuple(2), std::forward_as_tuple(new int(3))).second);
+	CHECK(m.size() == 2);
+}
+
+int main()
+{
+	test_adaptor_pop_value<thread_safe::queue<item> >();
+	test_adaptor_pop_value<thread_safe::stack<item> >();
+	test_adaptor_pop_value<thread_safe::priority_queue<item> >();
+	test_pop_back_value<thread_safe::vector<item> >();
+	test_pop_back_value<thread_safe::deque<item> >();
+	test_pop_back_value<thread_safe::list<item> >();
+	test_pop_front_value<thread_safe::deque<item> >();
+	test_pop_front_value<thread_safe::list<item> >();
+	test_try_emplace<thread_safe::map<int, item> >();
+	test_try_emplace<thread_safe::unordered_map<int, item> >();
+
+	thread_safe::queue<std::string> q;
+	q.emplace(3, 'x');
+	CHECK(q.pop_value() == "xxx");
+	return test::result();
+}
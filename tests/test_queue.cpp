@@ -0,0 +1,47 @@
+#include <deque>
+#include <queue>
+#include <type_traits>
+
+#include "thread_safe_queue.h"
+#include "check.h"
+
+static_assert(std::is_same<thread_safe::queue<int>::storage_type, std::queue<int, std::deque<int> > >::value, "queue defaults to std::queue over std::deque");
+
+// Both the default container and chunk_deque keep FIFO order, and lock()
+// hands out the std::queue adaptor.
+template <class Queue>
+static void test_fifo()
+{
+	Queue q;
+	for (int i = 0; i < 1000; ++i)
+		q.push(i);
+	q.emplace(1000);
+	CHECK(q.size() == 1001);
+	CHECK(q.front() == 0);
+	CHECK(q.back() == 1000);
+	for (int i = 0; i < 500; ++i)
+		CHECK(q.pop_value() == i);
+	int x = -1;
+	CHECK(q.try_pop(x) && x == 500);
+	{
+		auto locked = q.lock();
+		CHECK(locked->front() == 501);
+		locked->pop();
+	}
+	CHECK(q.front() == 502);
+	while (!q.empty())
+		q.pop();
+	CHECK(!q.try_pop(x));
+}
+
+int main()
+{
+	test_fifo<thread_safe::queue<int> >();
+	test_fifo<thread_safe::queue<int, thread_safe::chunk_deque<int> > >();
+	thread_safe::queue<int, thread_safe::chunk_deque<int> > q;
+	q.push(1);
+	q.pop();
+	q.shrink_to(0);
+	CHECK(q.empty());
+	return test::result();
+}
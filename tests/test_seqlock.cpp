@@ -0,0 +1,72 @@
+#include <atomic>
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+#include "thread_safe_seqlock.h"
+#include "check.h"
+
+// Trivially copyable without a default constructor, wider than one word
+struct record
+{
+	record(uint64_t v) : a(v), b(v), c(v) {}
+	uint64_t a, b, c;
+};
+
+// A writer stores {i, i, i}; readers must never see fields from two writes
+static void test_no_torn_reads()
+{
+	thread_safe::seqlock<record> cell(record(0));
+	std::atomic<bool> stop(false);
+	std::atomic<int> torn(0);
+	std::vector<std::thread> readers;
+	for (int r = 0; r < 3; ++r)
+	{
+		readers.push_back(std::thread([&]() {
+			uint64_t last = 0;
+			while (!stop.load())
+			{
+				record x = cell.load();
+				if (x.a != x.b || x.b != x.c || x.a < last)
+					++torn;
+				last = x.a;
+			}
+		}));
+	}
+	for (uint64_t i = 1; i <= 200000; ++i)
+		cell.store(record(i));
+	stop = true;
+	for (size_t r = 0; r < readers.size(); ++r)
+		readers[r].join();
+	CHECK(torn.load() == 0);
+	CHECK(cell.load().a == 200000);
+	CHECK(cell.version() == 2 * 200000);
+}
+
+// Concurrent update() calls serialize on the counter
+static void test_concurrent_updates()
+{
+	thread_safe::seqlock_array<record, 4> cells(record(0));
+	std::vector<std::thread> writers;
+	for (int w = 0; w < 4; ++w)
+	{
+		writers.push_back(std::thread([&cells]() {
+			for (int i = 0; i < 10000; ++i)
+				cells.update(i % 4, [](record& x) { ++x.a; ++x.b; ++x.c; });
+		}));
+	}
+	for (size_t w = 0; w < writers.size(); ++w)
+		writers[w].join();
+	for (size_t n = 0; n < cells.size(); ++n)
+	{
+		record x = cells[n];
+		CHECK(x.a == 10000 && x.b == 10000 && x.c == 10000);
+	}
+}
+
+int main()
+{
+	test_no_torn_reads();
+	test_concurrent_updates();
+	return test::result();
+}
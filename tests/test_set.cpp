@@ -0,0 +1,147 @@
+#include <algorithm>
+#include <cctype>
+#include <iterator>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "thread_safe_set.h"
+#include "thread_safe_unordered_set.h"
+#include "check.h"
+
+struct case_insensitive_less
+{
+	bool operator()(const std::string& a, const std::string& b) const
+	{
+		for (size_t i = 0; i < a.size() && i < b.size(); ++i)
+		{
+			int x = std::tolower(static_cast<unsigned char>(a[i]));
+			int y = std::tolower(static_cast<unsigned char>(b[i]));
+			if (x != y)
+				return x < y;
+		}
+		return a.size() < b.size();
+	}
+};
+
+struct case_insensitive_hash
+{
+	size_t operator()(const std::string& s) const
+	{
+		std::string lower(s);
+		for (char& c : lower)
+			c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+		return std::hash<std::string>()(lower);
+	}
+};
+
+static void test_bloom_filter_with_matching_hash()
+{
+	thread_safe::set<std::string, case_insensitive_less> s;
+	s.insert("Apple");
+	s.enable_bloom_filter<case_insensitive_hash>(100);
+	s.insert("Banana");
+	CHECK(s.count("apple") == 1);
+	CHECK(s.count("BANANA") == 1);
+	CHECK(s.count("cherry") == 0);
+}
+
+// Keys inserted through mutable lock(), with_lock() or swap() bypass the
+// filter; count() must still find them.
+template <class Set>
+static void test_bloom_filter_after_raw_access()
+{
+	Set s, other;
+	s.enable_bloom_filter(1000);
+	other.enable_bloom_filter(1000);
+	s.insert(1);
+	{
+		auto raw = s.lock();
+		for (int i = 2; i < 100; ++i)
+			raw->insert(i);
+	}
+	CHECK(s.count(50) == 1);
+	CHECK(s.count(99) == 1);
+	s.with_lock([](typename Set::storage_type& raw) { raw.insert(500); });
+	CHECK(s.count(500) == 1);
+	CHECK(s.count(501) == 0);
+	other.insert(700);
+	s.swap(other);
+	CHECK(s.count(700) == 1);
+	CHECK(other.count(500) == 1);
+	other.clear();
+	CHECK(other.count(500) == 0);
+}
+
+static void test_set_algebra()
+{
+	thread_safe::set<int> a, b;
+	for (int i = 0; i < 10; ++i)
+		a.insert(i);
+	for (int i = 5; i < 15; ++i)
+		b.insert(i);
+	CHECK(thread_safe::set_union(a, b).size() == 15);
+	CHECK(thread_safe::set_intersection(a, b).size() == 5);
+	CHECK(thread_safe::set_difference(a, b).size() == 5);
+	CHECK(thread_safe::set_intersection(a, a).size() == 10);
+}
+
+// Operands well above kParallelSetGrain take the split path; the results,
+// tree and output iterator forms alike, must match the std algorithms.
+template <class ThreadSafeOp, class IteratorOp, class StdOp>
+static void check_against_std(ThreadSafeOp op, IteratorOp into, StdOp reference)
+{
+	thread_safe::set<int> a, b;
+	std::set<int> std_a, std_b;
+	for (int i = 0; i < 400000; i += 2)
+	{
+		a.insert(i);
+		std_a.insert(i);
+	}
+	for (int i = 0; i < 300000; i += 3)
+	{
+		b.insert(i);
+		std_b.insert(i);
+	}
+	std::vector<int> expected;
+	reference(std_a.begin(), std_a.end(), std_b.begin(), std_b.end(), std::back_inserter(expected));
+
+	thread_safe::set<int> result = op(a, b);
+	std::vector<int> tree;
+	result.with_lock([&tree](const std::set<int>& raw) { tree.assign(raw.begin(), raw.end()); });
+	CHECK(tree == expected);
+
+	std::vector<int> flat;
+	into(a, b, std::back_inserter(flat));
+	CHECK(flat == expected);
+}
+
+typedef std::back_insert_iterator<std::vector<int> > int_inserter;
+typedef std::set<int>::const_iterator std_iterator;
+
+static void test_set_algebra_against_std()
+{
+	CHECK(thread_safe::detail::kParallelSetGrain * 2 < 150000);
+	check_against_std(
+		[](const thread_safe::set<int>& a, const thread_safe::set<int>& b) { return thread_safe::set_union(a, b); },
+		[](const thread_safe::set<int>& a, const thread_safe::set<int>& b, int_inserter out) { thread_safe::set_union(a, b, out); },
+		std::set_union<std_iterator, std_iterator, int_inserter>);
+	check_against_std(
+		[](const thread_safe::set<int>& a, const thread_safe::set<int>& b) { return thread_safe::set_intersection(a, b); },
+		[](const thread_safe::set<int>& a, const thread_safe::set<int>& b, int_inserter out) { thread_safe::set_intersection(a, b, out); },
+		std::set_intersection<std_iterator, std_iterator, int_inserter>);
+	check_against_std(
+		[](const thread_safe::set<int>& a, const thread_safe::set<int>& b) { return thread_safe::set_difference(a, b); },
+		[](const thread_safe::set<int>& a, const thread_safe::set<int>& b, int_inserter out) { thread_safe::set_difference(a, b, out); },
+		std::set_difference<std_iterator, std_iterator, int_inserter>);
+}
+
+int main()
+{
+	test_bloom_filter_with_matching_hash();
+	test_bloom_filter_after_raw_access<thread_safe::set<int> >();
+	test_bloom_filter_after_raw_access<thread_safe::unordered_set<int> >();
+	test_set_algebra();
+	test_set_algebra_against_std();
+	return test::result();
+}
@@ -0,0 +1,92 @@
+#include <cstdint>
+#include <random>
+#include <vector>
+
+#include "thread_safe_bitset.h"
+#include "thread_safe_simd.h"
+#include "check.h"
+
+using namespace thread_safe;
+
+// Every kernel tier the CPU supports must agree with the scalar loops,
+// including the tails shorter than a vector
+static void test_kernels_match_scalar(const simd::kernels& k)
+{
+	std::mt19937_64 rng(42);
+	for (size_t n = 0; n < 40; ++n)
+	{
+		std::vector<uint64_t> a(n), b(n);
+		for (size_t i = 0; i < n; ++i)
+		{
+			a[i] = rng() & rng();
+			b[i] = rng() & rng();
+		}
+		std::vector<uint64_t> x = a, y = a;
+		k.and_words(x.data(), b.data(), n);
+		simd::scalar::and_words(y.data(), b.data(), n);
+		CHECK(x == y);
+		x = a, y = a;
+		k.or_words(x.data(), b.data(), n);
+		simd::scalar::or_words(y.data(), b.data(), n);
+		CHECK(x == y);
+		x = a, y = a;
+		k.xor_words(x.data(), b.data(), n);
+		simd::scalar::xor_words(y.data(), b.data(), n);
+		CHECK(x == y);
+		x = a, y = a;
+		k.andnot_words(x.data(), b.data(), n);
+		simd::scalar::andnot_words(y.data(), b.data(), n);
+		CHECK(x == y);
+		CHECK(k.popcount_words(a.data(), n) == simd::scalar::popcount_words(a.data(), n));
+		CHECK(k.and_popcount_words(a.data(), b.data(), n) == simd::scalar::and_popcount_words(a.data(), b.data(), n));
+		std::vector<uint64_t> zero(n);
+		CHECK(!k.any_words(zero.data(), n));
+		if (n)
+		{
+			zero[n - 1] = 1;
+			CHECK(k.any_words(zero.data(), n));
+			CHECK(!k.and_any_words(zero.data(), std::vector<uint64_t>(n).data(), n));
+			CHECK(k.and_any_words(zero.data(), zero.data(), n));
+		}
+	}
+}
+
+static void test_kernel_tiers()
+{
+	test_kernels_match_scalar(simd::make_scalar_kernels());
+	test_kernels_match_scalar(simd::active());
+#ifdef THREAD_SAFE_SIMD_X86
+	if (__builtin_cpu_supports("sse2"))
+	{
+		simd::kernels k = simd::make_scalar_kernels();
+		k.and_words = &simd::sse2::and_words;
+		k.or_words = &simd::sse2::or_words;
+		k.xor_words = &simd::sse2::xor_words;
+		k.andnot_words = &simd::sse2::andnot_words;
+		k.any_words = &simd::sse2::any_words;
+		k.and_any_words = &simd::sse2::and_any_words;
+		test_kernels_match_scalar(k);
+	}
+#endif
+}
+
+static void test_bitset_operators()
+{
+	thread_safe::bitset<1000> a, b;
+	for (size_t i = 0; i < 1000; i += 3)
+		a.set(i);
+	for (size_t i = 0; i < 1000; i += 5)
+		b.set(i);
+	CHECK((a & b).count() == 67);
+	CHECK((a | b).count() == 334 + 200 - 67);
+	CHECK((a ^ b).count() == 334 + 200 - 2 * 67);
+	CHECK((a & a) == a);
+	CHECK((a ^ a).none());
+}
+
+int main()
+{
+	test_kernel_tiers();
+	test_bitset_operators();
+	return test::result();
+}
@@ -0,0 +1,133 @@
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <list>
+#include <mutex>
+#include <set>
+#include <thread>
+#include <unordered_set>
+#include <vector>
+
+#include "thread_safe_list.h"
+#include "thread_safe_set.h"
+#include "thread_safe_unordered_set.h"
+#include "thread_safe_transaction.h"
+#include "check.h"
+
+// Keys moved by a transaction bypass the destination's Bloom filter; count()
+// must still find them once the transaction is over.
+static void test_move_between_filtered_sets()
+{
+	thread_safe::set<int> from;
+	thread_safe::unordered_set<int> to;
+	from.enable_bloom_filter(100);
+	to.enable_bloom_filter(100);
+	for (int i = 0; i < 10; ++i)
+		from.insert(i);
+	{
+		auto tx = thread_safe::transaction(from, to);
+		std::set<int>& a = tx.get<0>();
+		std::unordered_set<int>& b = tx.get<1>();
+		b.insert(a.begin(), a.end());
+		a.clear();
+	}
+	CHECK(from.size() == 0);
+	for (int i = 0; i < 10; ++i)
+		CHECK(to.count(i) == 1);
+	CHECK(to.count(10) == 0);
+}
+
+// Fails the test instead of hanging ctest when the threads deadlock
+class watchdog
+{
+public:
+	explicit watchdog(int seconds) : done(false), timer([this, seconds]() {
+		std::unique_lock<std::mutex> lock(mutex);
+		if (!finished.wait_for(lock, std::chrono::seconds(seconds), [this]() { return done; }))
+		{
+			std::fprintf(stderr, "deadlock: threads still running after %d s\n", seconds);
+			std::_Exit(1);
+		}
+	}) {}
+
+	~watchdog()
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			done = true;
+		}
+		finished.notify_all();
+		timer.join();
+	}
+
+private:
+	std::mutex mutex;
+	std::condition_variable finished;
+	bool done;
+	std::thread timer;
+};
+
+// a.swap(b) against b.swap(a) and transaction(a, b) against transaction(b, a)
+// take the same two locks in opposite argument order; address ordering must
+// keep them from deadlocking. Elements only move, so the total stays put.
+static void test_opposite_orders()
+{
+	thread_safe::list<int> a, b;
+	for (int i = 0; i < 100; ++i)
+		a.push_back(i);
+	{
+		watchdog guard(60);
+		std::vector<std::thread> threads;
+		threads.push_back(std::thread([&]() { for (int i = 0; i < 20000; ++i) a.swap(b); }));
+		threads.push_back(std::thread([&]() { for (int i = 0; i < 20000; ++i) b.swap(a); }));
+		threads.push_back(std::thread([&]() {
+			for (int i = 0; i < 20000; ++i)
+			{
+				auto tx = thread_safe::transaction(a, b);
+				std::list<int>& from = tx.get<0>();
+				std::list<int>& to = tx.get<1>();
+				if (!from.empty())
+					to.splice(to.end(), from, from.begin());
+			}
+		}));
+		threads.push_back(std::thread([&]() {
+			for (int i = 0; i < 20000; ++i)
+			{
+				auto tx = thread_safe::transaction(b, a);
+				std::list<int>& from = tx.get<0>();
+				std::list<int>& to = tx.get<1>();
+				if (!from.empty())
+					to.splice(to.end(), from, from.begin());
+			}
+		}));
+		for (size_t t = 0; t < threads.size(); ++t)
+			threads[t].join();
+	}
+	CHECK(a.size() + b.size() == 100);
+}
+
+// A container listed twice is locked once: with a non-recursive mutex a
+// second lock would never return
+static void test_same_container_twice()
+{
+	thread_safe::list<int> a;
+	a.push_back(1);
+	{
+		watchdog guard(60);
+		auto tx = thread_safe::transaction(a, a);
+		CHECK(tx.owns_lock());
+		CHECK(&tx.get<0>() == &tx.get<1>());
+		tx.get<0>().push_back(2);
+	}
+	// released exactly once, so the container is usable again
+	CHECK(a.size() == 2);
+}
+
+int main()
+{
+	test_move_between_filtered_sets();
+	test_opposite_orders();
+	test_same_container_twice();
+	return test::result();
+}